@@ -1,20 +1,40 @@
 include(`general.m4')
 [threadpool]
 groups = THREADPOOL_GROUPS
-issteal = true
+steal = true
+work_stealing = false
+serial_lanes = 1024
+essential_maxsize = 4096
 
 [timer]
 interval = TIMER_INTERVAL
 poolsize = TIMER_POOL_SIZE
 
+[clock]
+resolution = 1
+
 [reactor]
 demultiplexer = REACTOR_DEMULTIPLEXER
-use_timer_thread = true
+use_timer_thread = false
+edge_triggered = false
 timeout = 1000
+sub_reactor_count = REACTOR_SUB_COUNT
+sub_reactor_affinity = false
+load_balance = round_robin
 
 [log]
 loglevel = 0
 asynclog = false
+binlog = false
+batch = false
+batch_size = 16384
+batch_interval = 20
+batch_compress = false
+spool = false
+spool_dir = ./logspool
+spool_segment_size = 4194304
+spool_max_mb = 256
+spool_replay_rate = 4194304
 pattern = LOG_PATTERN
 
 [logserver]
@@ -44,6 +64,8 @@ address = LOCAL_IP
 port = 8888
 read_buffer_size = READ_BUFFER_SIZE
 write_buffer_size = WRITE_BUFFER_SIZE
+sharded_listen = false
+reuseport_cbpf = false
 
 [httpserver]
 socktype = tcp
@@ -60,5 +82,5 @@ keepalive_timeout = 30000
 
 [monitor]
 exporter = influx
-collectors = cpu, memory, disk, process, network, system
+collectors = cpu, memory, disk, process, network, system, threadpool
 interval = 1000
\ No newline at end of file
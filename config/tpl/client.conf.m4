@@ -1,19 +1,36 @@
 include(`general.m4')
 [threadpool]
 groups = THREADPOOL_GROUPS
+work_stealing = false
+serial_lanes = 1024
+essential_maxsize = 4096
 
 [timer]
 interval = TIMER_INTERVAL
 poolsize = TIMER_POOL_SIZE
 
+[clock]
+resolution = 1
+
 [reactor]
 demultiplexer = REACTOR_DEMULTIPLEXER
-use_timer_thread = true
+use_timer_thread = false
+edge_triggered = false
 timeout = 1000
 
 [log]
 loglevel = 0
 asynclog = false
+binlog = false
+batch = false
+batch_size = 16384
+batch_interval = 20
+batch_compress = false
+spool = false
+spool_dir = ./logspool
+spool_segment_size = 4194304
+spool_max_mb = 256
+spool_replay_rate = 4194304
 pattern = LOG_PATTERN
 
 [logserver]
@@ -1,15 +1,25 @@
 include(`general.m4')
 [threadpool]
 groups = (524288, 4)
+work_stealing = false
+serial_lanes = 1024
+essential_maxsize = 4096
 
 [timer]
 interval = TIMER_INTERVAL
 poolsize = TIMER_POOL_SIZE
 
+[clock]
+resolution = 1
+
 [reactor]
 demultiplexer = REACTOR_DEMULTIPLEXER
-use_timer_thread = true
+use_timer_thread = false
+edge_triggered = false
 timeout = 1000
+sub_reactor_count = REACTOR_SUB_COUNT
+sub_reactor_affinity = false
+load_balance = round_robin
 
 [log]
 loglevel = 0
@@ -19,6 +29,18 @@ pattern = LOG_PATTERN
 asynclog = false
 interval = 5000
 threshold = 4096
+buffer_size = 524288
+backpressure = drop_newest
+rotate = day
+rotate_size = 0
+compress = none
+compress_level = 6
+retention_mb = 0
+retention_days = 0
+mmaplog = false
+mmap_chunk_size = 64
+mmap_sync = none
+mmap_sync_interval = 1000
 
 [influxlog]
 dir = INFLUXLOG_DIR
@@ -0,0 +1,56 @@
+#include "cached_clock.h"
+
+#include <thread>
+#include <unistd.h>
+
+#include "common.h"
+#include "glog.h"
+
+namespace bee
+{
+
+std::atomic<bool> cached_clock::_running = false;
+std::atomic<TIMETYPE> cached_clock::_realtime_us = 0;
+std::atomic<TIMETYPE> cached_clock::_monotonic_us = 0;
+
+static std::thread* g_clock_thread = nullptr;
+
+void cached_clock::start(TIMETYPE resolution)
+{
+    if(g_clock_thread) return;
+    if(resolution <= 0) resolution = 1;
+    update();
+    _running.store(true, std::memory_order_release);
+    g_clock_thread = new std::thread([resolution]()
+    {
+        local_log("cached clock thread tid:%d resolution:%ldms.", gettid(), resolution);
+        while(_running.load(std::memory_order_relaxed))
+        {
+            usleep(resolution * 1000);
+            update();
+        }
+    });
+}
+
+void cached_clock::stop()
+{
+    if(!g_clock_thread) return;
+    _running.store(false, std::memory_order_relaxed);
+    if(g_clock_thread->joinable())
+    {
+        g_clock_thread->join();
+    }
+    delete g_clock_thread;
+    g_clock_thread = nullptr;
+}
+
+// 刷新线程和各个reactor都会写，单调时钟只允许往前走，后读到的旧值不能覆盖新值
+void cached_clock::update()
+{
+    TIMETYPE monotonic = systemtime::get_monotonic_microseconds();
+    TIMETYPE cur = _monotonic_us.load(std::memory_order_relaxed);
+    while(monotonic > cur && !_monotonic_us.compare_exchange_weak(cur, monotonic, std::memory_order_relaxed));
+    _realtime_us.store(systemtime::get_microseconds(), std::memory_order_relaxed);
+}
+
+} // namespace bee
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+
+#include "systemtime.h"
+#include "types.h"
+
+namespace bee
+{
+
+/*
+ * 缓存时钟：后台线程按固定精度刷新，热点路径上读时间只是一次原子load
+ * 1.同时缓存单调时钟和墙上时钟（微秒），精度由[clock]resolution配置，读到的时间最多落后这么多毫秒；
+ * 2.reactor每轮循环也会刷新，处理网络事件时拿到的时间更及时；
+ * 3.刷新线程没有启动时（工具、benchmark）直接读系统时钟，结果和systemtime一致。
+ * 需要微秒级精度的统计（比如任务排队时间）还是用systemtime。
+ */
+class cached_clock
+{
+public:
+    static void start(TIMETYPE resolution/*ms*/);
+    static void stop();
+    static void update(); // 立即刷新一次，任意线程都可以调用
+
+    FORCE_INLINE static bool is_running() { return _running.load(std::memory_order_relaxed); }
+
+    // 墙上时钟
+    FORCE_INLINE static TIMETYPE get_time()         { return get_microseconds() / 1000000; }
+    FORCE_INLINE static TIMETYPE get_seconds()      { return get_microseconds() / 1000000; }
+    FORCE_INLINE static TIMETYPE get_millseconds()  { return get_microseconds() / 1000; }
+    FORCE_INLINE static TIMETYPE get_microseconds()
+    {
+        return is_running() ? _realtime_us.load(std::memory_order_relaxed) : systemtime::get_microseconds();
+    }
+
+    // 单调时钟
+    FORCE_INLINE static TIMETYPE get_monotonic_seconds()     { return get_monotonic_microseconds() / 1000000; }
+    FORCE_INLINE static TIMETYPE get_monotonic_millseconds() { return get_monotonic_microseconds() / 1000; }
+    FORCE_INLINE static TIMETYPE get_monotonic_microseconds()
+    {
+        return is_running() ? _monotonic_us.load(std::memory_order_relaxed) : systemtime::get_monotonic_microseconds();
+    }
+
+private:
+    static std::atomic<bool> _running;
+    ALIGN_CACHELINE_SIZE static std::atomic<TIMETYPE> _realtime_us;
+    static std::atomic<TIMETYPE> _monotonic_us;
+};
+
+} // namespace bee
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <memory>
 
 #include "concept.h"
 #include "octets.h"
@@ -53,6 +55,32 @@ public:
     octetsstream() = default;
     octetsstream(const octets& oct) : _data(oct) {}
     octetsstream(const octets& oct, size_t size) : _data(oct, size) {}
+    octetsstream(const octetsstream& rhs) : _data(rhs._data), _pos(rhs._pos), _transpos(rhs._transpos) {}
+    octetsstream(octetsstream&& rhs) { swap(rhs); }
+    ~octetsstream()
+    {
+        if(has_views()) _anchor->swap(_data); // 内存交给视图释放
+    }
+
+    octetsstream& operator=(const octetsstream& rhs)
+    {
+        if(&rhs != this)
+        {
+            detach_views(false);
+            _data = rhs._data;
+            _pos = rhs._pos;
+            _transpos = rhs._transpos;
+        }
+        return *this;
+    }
+    octetsstream& operator=(octetsstream&& rhs)
+    {
+        if(&rhs != this)
+        {
+            swap(rhs);
+        }
+        return *this;
+    }
 
     template<typename T> FORCE_INLINE octetsstream& operator <<(const T& val) { return push(val); }
     template<typename T> FORCE_INLINE octetsstream& operator >>(T&& val) { return pop(std::forward<T>(val)); }
@@ -62,22 +90,87 @@ public:
         _data.swap(rhs._data);
         std::swap(_pos, rhs._pos);
         std::swap(_transpos, rhs._transpos);
+        _anchor.swap(rhs._anchor);
     }
 
     FORCE_INLINE void try_shrink()
     {
         if(_pos > 0x100000)
         {
-            _data.erase(0, _pos);
-            _pos = 0;
-            _transpos = 0;
+            compact();
+        }
+    }
+
+    // 丢弃已解码的数据，把未解码的部分搬到缓冲区头部
+    FORCE_INLINE void compact()
+    {
+        if(_pos == 0) return;
+        if(has_views())
+        {
+            detach_views(true);
+            return;
+        }
+        _data.erase(0, _pos);
+        _pos = 0;
+        _transpos = 0;
+    }
+
+    // 接收缓冲区回收：全部解码完直接复位，否则剩余空间不足1/4时才搬移，避免每次收包都memmove
+    FORCE_INLINE void reclaim()
+    {
+        if(_pos == 0) return;
+        if(_pos == _data.size() && !has_views())
+        {
+            clear();
+        }
+        else if(_data.free_space() < _data.capacity() / 4)
+        {
+            compact();
+        }
+    }
+
+    // 零拷贝解码：开启后pop(octets_view&)直接引用_data，不再拷贝
+    // 视图共享_anchor的引用计数，_data被改写或释放前若还有视图存活，内存转交给_anchor，自己换一块新的
+    FORCE_INLINE void enable_views()
+    {
+        if(!_anchor) _anchor = std::make_shared<octets>();
+    }
+
+    FORCE_INLINE bool has_views() const
+    {
+        if(!_anchor) return false;
+        if(_anchor.use_count() == 1) // 只有解码线程会增加引用，这里看到1就不会再变
+        {
+            std::atomic_thread_fence(std::memory_order_acquire); // 与视图析构时的release配对，之后才能覆写内存
+            return false;
+        }
+        return true;
+    }
+
+    void detach_views(bool keep_unread)
+    {
+        if(!has_views()) return;
+        octets fresh;
+        fresh.reserve(_data.capacity());
+        if(keep_unread)
+        {
+            fresh.append(_data.peek(_pos), _data.size() - _pos);
         }
+        _anchor->swap(_data);
+        _data.swap(fresh);
+        _anchor.reset();
+        _pos = 0;
+        _transpos = 0;
     }
 
-    FORCE_INLINE void reserve(size_t cap) { _data.reserve(cap); }
-    FORCE_INLINE octets& data() { return _data; }
+    FORCE_INLINE void reserve(size_t cap)
+    {
+        if(cap > _data.capacity()) detach_views(true);
+        _data.reserve(cap);
+    }
+    FORCE_INLINE octets& data() { return _data; } // 开启视图后只允许在剩余空间内追加，不能触发扩容
     FORCE_INLINE void advance(size_t len) { _pos += len; }
-    FORCE_INLINE void clear() { _data.clear(); _pos = 0; _transpos = 0; }
+    FORCE_INLINE void clear() { detach_views(false); _data.clear(); _pos = 0; _transpos = 0; }
     FORCE_INLINE bool data_ready(size_t len) const { return (_data.size() - _pos) >= len; }
     FORCE_INLINE size_t get_pos() const { return _pos; }
     FORCE_INLINE size_t size() const { return _data.size(); }
@@ -142,6 +235,34 @@ public:
         return *this;
     }
 
+    // octets_view，编码格式与octets一致
+    FORCE_INLINE octetsstream& push(const octets_view& val)
+    {
+        push(val.size());
+        _data.append(val.data(), val.size());
+        return *this;
+    }
+
+    FORCE_INLINE octetsstream& pop(octets_view& val)
+    {
+        size_t size = 0;
+        pop(size);
+        if(_pos + size > _data.size())
+        {
+            throw exception("no enough data!!!");
+        }
+        if(_anchor)
+        {
+            val = octets_view(_data.begin() + _pos, size, _anchor);
+        }
+        else
+        {
+            val = octets_view(octets(_data.begin() + _pos, size)); // 没开启视图时拷贝一份自己持有
+        }
+        _pos += size;
+        return *this;
+    }
+
     // Transaction
     octetsstream& push(Transaction val) = delete;
 
@@ -395,6 +516,7 @@ private:
     octets _data;
     size_t _pos = 0;
     size_t _transpos = 0;
+    std::shared_ptr<octets> _anchor; // 视图的引用计数，见enable_views
 };
 
 template<std::integral T>
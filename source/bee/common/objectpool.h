@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <assert.h>
@@ -8,6 +9,7 @@
 #include <utility>
 #include <unordered_map>
 
+#include "types.h"
 #ifdef _REENTRANT
 #include "lock.h"
 #endif
@@ -314,4 +316,152 @@ private:
     size_t _cap = 0;
 };
 
+//////////////////////////////////////////////////////////////////////////
+
+/*
+ * 线程缓存内存池：按16字节分级，每个线程缓存自己分配出去的空闲块
+ * 1.本线程释放直接挂回本地链表，无锁无原子操作；
+ * 2.其他线程释放的块挂到所属线程的远端链表上，所属线程本地链表空了再一次性收回，
+ *   适合解码线程分配、工作线程释放的短生命周期对象，块不会在线程间单向流失；
+ * 3.线程退出后缓存结构本身不释放，之后归还给它的块直接还给系统。
+ */
+class thread_cached_pool
+{
+public:
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 1024; // 更大的块直接走::operator new
+    static constexpr size_t CLASS_COUNT = MAX_BLOCK_SIZE / ALIGNMENT;
+    static constexpr size_t MAX_CACHED_BLOCKS = 1024; // 每个级别本地最多缓存的块数
+
+    static void* alloc(size_t size)
+    {
+        if(size > MAX_BLOCK_SIZE || t_exited)
+        {
+            auto* header = new (::operator new(sizeof(block_header) + size)) block_header{nullptr, 0};
+            return header + 1;
+        }
+
+        size_t sizeclass = (std::max<size_t>(size, 1) - 1) / ALIGNMENT;
+        thread_cache* cache = local_cache();
+        free_block* block = cache->local[sizeclass];
+        if(!block)
+        {
+            // 收回其他线程还回来的块
+            block = cache->remote[sizeclass].exchange(nullptr, std::memory_order_acquire);
+            size_t count = 0;
+            for(free_block* iter = block; iter; iter = iter->next) ++count;
+            cache->local_count[sizeclass] = count;
+        }
+        if(block)
+        {
+            cache->local[sizeclass] = block->next;
+            --cache->local_count[sizeclass];
+            return block;
+        }
+
+        size_t block_size = (sizeclass + 1) * ALIGNMENT;
+        auto* header = new (::operator new(sizeof(block_header) + block_size)) block_header{cache, sizeclass};
+        return header + 1;
+    }
+
+    static void free(void* ptr)
+    {
+        if(!ptr) return;
+        block_header* header = static_cast<block_header*>(ptr) - 1;
+        thread_cache* owner = header->owner;
+        if(!owner)
+        {
+            ::operator delete(header);
+            return;
+        }
+
+        size_t sizeclass = header->sizeclass;
+        free_block* block = static_cast<free_block*>(ptr);
+        if(owner == t_cache)
+        {
+            if(owner->local_count[sizeclass] >= MAX_CACHED_BLOCKS)
+            {
+                ::operator delete(header);
+                return;
+            }
+            block->next = owner->local[sizeclass];
+            owner->local[sizeclass] = block;
+            ++owner->local_count[sizeclass];
+            return;
+        }
+
+        std::atomic<free_block*>& remote = owner->remote[sizeclass];
+        block->next = remote.load(std::memory_order_relaxed);
+        while(!remote.compare_exchange_weak(block->next, block));
+        if(owner->orphaned.load()) // 所属线程已经退出，没人会再收回了
+        {
+            release_chain(remote.exchange(nullptr));
+        }
+    }
+
+private:
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct thread_cache
+    {
+        free_block* local[CLASS_COUNT] = {};
+        size_t local_count[CLASS_COUNT] = {};
+        ALIGN_CACHELINE_SIZE std::atomic<free_block*> remote[CLASS_COUNT] = {};
+        std::atomic<bool> orphaned = false;
+    };
+
+    struct alignas(ALIGNMENT) block_header
+    {
+        thread_cache* owner; // nullptr表示不归任何线程缓存
+        size_t sizeclass;
+    };
+
+    struct cache_holder
+    {
+        ~cache_holder()
+        {
+            t_exited = true;
+            if(!t_cache) return;
+            // 先标记再清空远端链表，和free里的先挂链表再检查标记配对，保证不会漏掉块
+            t_cache->orphaned.store(true);
+            for(size_t i = 0; i < CLASS_COUNT; ++i)
+            {
+                release_chain(t_cache->local[i]);
+                t_cache->local[i] = nullptr;
+                t_cache->local_count[i] = 0;
+                release_chain(t_cache->remote[i].exchange(nullptr));
+            }
+            t_cache = nullptr;
+        }
+    };
+
+    static thread_cache* local_cache()
+    {
+        if(PREDICT_FALSE(!t_cache))
+        {
+            thread_local cache_holder holder;
+            t_cache = new thread_cache;
+        }
+        return t_cache;
+    }
+
+    static void release_chain(free_block* block)
+    {
+        while(block)
+        {
+            free_block* next = block->next;
+            ::operator delete(reinterpret_cast<block_header*>(block) - 1);
+            block = next;
+        }
+    }
+
+    static_assert(sizeof(block_header) == ALIGNMENT);
+
+    inline static thread_local thread_cache* t_cache = nullptr;
+    inline static thread_local bool t_exited = false;
+};
+
 } // namespace bee
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstddef>
 #include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -228,4 +229,51 @@ private:
     size_t _cap = 0;
 };
 
+// 引用一段octets内存的只读视图，_holder保证视图存活期间内存有效
+// 零拷贝解码是按字段选择的：只有xml里声明为octets_view的字段直接引用接收缓冲区，
+// 声明为octets、std::string的字段仍然在pop时拷贝一份，已有协议的行为不变
+class octets_view
+{
+public:
+    octets_view() = default;
+    octets_view(const char* data, size_t len, std::shared_ptr<const octets> holder)
+        : _data(data), _len(len), _holder(std::move(holder))
+    {
+    }
+    explicit octets_view(octets&& oct)
+        : _holder(std::make_shared<const octets>(std::move(oct)))
+    {
+        _data = _holder->data();
+        _len = _holder->size();
+    }
+
+    operator std::string_view() const
+    {
+        return std::string_view(_data, _len);
+    }
+    operator std::string() const
+    {
+        return std::string(_data, _len);
+    }
+
+    FORCE_INLINE const char* begin() const { return _data; }
+    FORCE_INLINE const char* end() const { return _data + _len; }
+    FORCE_INLINE const char* data() const { return _data; }
+    FORCE_INLINE size_t size() const { return _len; }
+    FORCE_INLINE bool empty() const { return _len == 0; }
+    FORCE_INLINE octets to_octets() const { return octets(_data, _len); }
+    FORCE_INLINE void reset() { _data = nullptr; _len = 0; _holder.reset(); }
+
+    // 只比较内容，不比较持有者
+    bool operator==(const octets_view& rhs) const
+    {
+        return _len == rhs._len && (_len == 0 || memcmp(_data, rhs._data, _len) == 0);
+    }
+
+private:
+    const char* _data = nullptr;
+    size_t _len = 0;
+    std::shared_ptr<const octets> _holder;
+};
+
 } // namespace bee
\ No newline at end of file
@@ -57,6 +57,18 @@ public:
         clock_gettime(CLOCK_MONOTONIC, &ts);
         return static_cast<TIMETYPE>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
     }
+    static TIMETYPE get_monotonic_millseconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<TIMETYPE>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+    static TIMETYPE get_monotonic_microseconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<TIMETYPE>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
     static std::pair<TIMETYPE, TIMETYPE> get_mill_nano_seconds()
     {
         struct timespec ts;
@@ -79,7 +91,8 @@ public:
         struct tm tm1;
         localtime_r(&curtime, &tm1);
 
-        struct tm tm2;
+        struct tm tm2 = {}; // 未设置的字段必须清零，否则mktime结果不确定
+        tm2.tm_isdst = -1;
         tm2.tm_year = tm1.tm_year;
         tm2.tm_mon  = tm1.tm_mon;
         tm2.tm_mday = tm1.tm_mday;
@@ -96,7 +109,8 @@ public:
         struct tm tm1;
         localtime_r(&curtime, &tm1);
 
-        struct tm tm2;
+        struct tm tm2 = {};
+        tm2.tm_isdst = -1;
         tm2.tm_year = tm1.tm_year;
         tm2.tm_mon  = tm1.tm_mon;
         tm2.tm_mday = tm1.tm_mday;
@@ -1,6 +1,7 @@
 #include "glog.h"
 #include "timewheel.h"
 #include "config.h"
+#include "cached_clock.h"
 
 namespace bee
 {
@@ -8,81 +9,123 @@ namespace bee
 void timewheel::init()
 {
     auto cfg = config::get_instance();
-    _ticktime = cfg->get<TIMETYPE>("timer", "interval");
-    _timerpool.init(cfg->get<size_t>("timer", "poolsize"));
-    _stop = false;
+    init(cfg->get<TIMETYPE>("timer", "interval"), cfg->get<size_t>("timer", "poolsize"));
     local_log("timewheel init finished...");
 }
 
+void timewheel::init(TIMETYPE ticktime, size_t poolsize)
+{
+    _ticktime = std::max<TIMETYPE>(ticktime, 1);
+    _timerpool.init(poolsize);
+    _stop = false;
+}
+
 TIMERID timewheel::add_timer(bool delay, TIMETYPE timeout, int repeats, callback handler, void* param)
 {
     if(_stop || !handler) return -1;
     auto [timerid, t] = _timerpool.alloc();
     if(!t) return -1;
+    bee::spinlock::scoped l(t->_locker); // 拿着过期id的线程可能同时在检查这个节点
     t->assign(); // 用的时候才清理上次使用时的内容
     t->_id = timerid;
+    t->_serial = (t->_serial + 1) & TIMER_SERIAL_MASK;
     t->_timeout = timeout / _ticktime;
-    t->_nexttime = delay ? _tickcount + t->_timeout : _tickcount;
-    t->_handler = handler;
+    uint64_t tickcount = _tickcount.load(std::memory_order_relaxed);
+    t->_nexttime = delay ? tickcount + t->_timeout : tickcount;
+    t->_handler = std::move(handler);
     t->_param = param;
     t->_repeats = repeats;
     t->_state = TIMER_STATE_ADD;
     add_to_changelist(t);
     //local_log("timer %d spinlock:%p.", timerid, &t->_locker);
-    return timerid;
+    return ((TIMERID)t->_serial << TIMER_INDEX_BITS) | timerid;
 }
 
+// 只改状态并放进变更链表，真正摘除由时间轮线程在下个tick开始时做
 bool timewheel::del_timer(TIMERID timerid)
 {
-    if(timer_node* t = _timerpool.find_object(timerid))
+    timer_node* t = find_timer(timerid);
+    if(!t) return false;
+    bee::spinlock::scoped l(t->_locker);
+    if(t->_serial != ((timerid >> TIMER_INDEX_BITS) & TIMER_SERIAL_MASK)) return false; // 已经被释放并重新分配
+    if(t->_state == TIMER_STATE_NONE || t->_state == TIMER_STATE_DEL) return false;
+    t->_state = TIMER_STATE_DEL;
+    if(!t->_pending) add_to_changelist(t);
+    return true;
+}
+
+bool timewheel::mod_timer(TIMERID timerid, TIMETYPE timeout)
+{
+    timer_node* t = find_timer(timerid);
+    if(!t) return false;
+    bee::spinlock::scoped l(t->_locker);
+    if(t->_serial != ((timerid >> TIMER_INDEX_BITS) & TIMER_SERIAL_MASK)) return false;
+    if(t->_state == TIMER_STATE_NONE || t->_state == TIMER_STATE_DEL) return false;
+    t->_timeout = timeout / _ticktime;
+    t->_nexttime = _tickcount.load(std::memory_order_relaxed) + t->_timeout;
+    if(t->_state != TIMER_STATE_ADD) // 还没生效的直接用新的时间加入
     {
-        bee::spinlock::scoped l(t->_locker);
-        if(t->_state != TIMER_STATE_ACTIVE) return false; // 只支持删除active状态的定时器
-        t->_state = TIMER_STATE_DEL;
-        add_to_changelist(t);
-        local_log("del_timer %lu", t->_id);
+        t->_state = TIMER_STATE_MOD;
     }
-    return false;
+    if(!t->_pending) add_to_changelist(t);
+    return true;
+}
+
+timer_node* timewheel::find_timer(TIMERID timerid)
+{
+    if(timerid < 0) return nullptr;
+    return _timerpool.find_object(timerid & TIMER_INDEX_MASK);
 }
 
 void timewheel::add_to_changelist(timer_node* t)
 {
+    t->_pending = true;
     bee::spinlock::scoped l(_changelist_locker);
     get_back_changelist().push_back(t);
 }
 
 void timewheel::readd_timer(timer_node* t)
 {
-    if(t->_nexttime - _tickcount >= NEAR_SLOTS)
+    internal_add_timer(t);
+    t->_state = TIMER_STATE_ACTIVE;
+}
+
+// 按离到期还有多少个tick选择级别，到期时间的对应位决定槽位
+void timewheel::internal_add_timer(timer_node* t)
+{
+    TIMETYPE ticks = t->_nexttime - (TIMETYPE)_tickcount;
+    if(ticks < 0) // 已经到期的放到当前槽，本次tick就执行
     {
-        _hanging_slots.push_back(t);
-        // local_log("readd_timer %lu _timeout=%ld _nexttime=%ld in _hanging_slots, _tickcount=%ld", t->_id, t->_timeout, t->_nexttime, _tickcount);
+        t->_nexttime = _tickcount;
+        ticks = 0;
     }
-    else
+    else if((uint64_t)ticks > MAX_TIMER_TICKS)
     {
-        int offset = _tickcount % NEAR_SLOTS;
-        if(t->_nexttime - _tickcount > 0)
-            offset = t->_nexttime % NEAR_SLOTS;
-        _near_slots[offset].push_back(t);
-        // local_log("readd_timer %lu  _timeout=%ld _nexttime=%ld in _near_slots %d, _tickcount=%ld", t->_id, t->_timeout, t->_nexttime, offset, _tickcount);
+        t->_nexttime = _tickcount + MAX_TIMER_TICKS;
+        ticks = MAX_TIMER_TICKS;
+    }
+
+    uint64_t expires = t->_nexttime;
+    if(ticks < TVR_SIZE)
+    {
+        _near_slots[expires & TVR_MASK].push_back(t);
+        return;
+    }
+    for(int level = 0; level < TVN_LEVELS; ++level)
+    {
+        if(level == TVN_LEVELS - 1 || (uint64_t)ticks < (1ULL << (TVR_BITS + (level + 1) * TVN_BITS)))
+        {
+            _far_slots[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK].push_back(t);
+            return;
+        }
     }
-    t->_state = TIMER_STATE_ACTIVE;
 }
 
 void timewheel::remove_timer(timer_node* t)
 {
-    if(t->_nexttime - _tickcount >= NEAR_SLOTS)
-    {
-        _hanging_slots.pop(t);
-        local_log("remove_timer %lu in _hanging_slots", t->_id);
-    }
-    else
+    if(t->_slot)
     {
-        int offset = _tickcount % NEAR_SLOTS;
-        if(t->_nexttime - _tickcount > 0)
-            offset = (t->_nexttime - _tickcount) % NEAR_SLOTS;
-        _near_slots[offset].pop(t);
-        local_log("remove_timer %lu in _near_slots %d", t->_id, offset);
+        t->_slot->pop(t);
     }
     free_timer(t);
 }
@@ -90,30 +133,32 @@ void timewheel::remove_timer(timer_node* t)
 void timewheel::free_timer(timer_node* t)
 {
     t->_state = TIMER_STATE_NONE;
+    if(t->_loaded) --_timer_count;
     _timerpool.free(t->_id);
-    local_log("free_timer %lu", t->_id);
 }
 
 void timewheel::load_timers()
 {
-    timerlist& changelist = get_front_changelist();
-    size_t i = 0, count = changelist.count;
-    for(timer_node* t = changelist.head; i < count; ++i)
+    timer_changelist& changelist = get_front_changelist();
+    for(timer_node* t = changelist.head; t; )
     {
+        timer_node* next = t->_change_next; // 删除后节点可能马上被其他线程重新分配，先取下一个
         bee::spinlock::scoped l(t->_locker);
-        timer_node* next = t->_next;
-        if(t->_state == TIMER_STATE_ADD)
+        t->_pending = false;
+        if(t->_state == TIMER_STATE_ADD || t->_state == TIMER_STATE_MOD)
         {
+            if(t->_slot) t->_slot->pop(t); // 修改的可能还在原来的槽里
+            if(!t->_loaded)
+            {
+                t->_loaded = true;
+                ++_timer_count;
+            }
             readd_timer(t);
         }
         else if(t->_state == TIMER_STATE_DEL)
         {
             remove_timer(t);
         }
-        else if(t->_state == TIMER_STATE_MOD)
-        {
-            readd_timer(t);
-        }
         t = next;
     }
     changelist.clear();
@@ -121,37 +166,38 @@ void timewheel::load_timers()
 
 void timewheel::handle_timer()
 {
-    int offset = _tickcount % NEAR_SLOTS;
-    //local_log("handle_timer offset=%d", offset);
-    timerlist active_list;
-    active_list.swap(_near_slots[offset]);
-    size_t i = 0, count = active_list.count;
-    for(timer_node* t = active_list.head; i < count; ++i)
+    timerlist& slot = _near_slots[_tickcount & TVR_MASK];
+    while(timer_node* t = slot.head)
     {
+        {
+            bee::spinlock::scoped l(t->_locker);
+            slot.pop(t); // 重复的定时器至少推迟一个tick，不会再放回这个槽
+            if(t->_state != TIMER_STATE_ACTIVE) continue; // 等待删除或修改的由load_timers处理
+            t->_state = TIMER_STATE_RUN;
+        }
+
+        // 执行时不持有节点锁，handler里可以删除或者修改自己
+        bool again = t->_handler(t->_param);
+
         bee::spinlock::scoped l(t->_locker);
-        timer_node* next = t->_next;
-        if(t->_state == TIMER_STATE_ACTIVE)
+        if(t->_state != TIMER_STATE_RUN) continue; // 执行期间被删除或修改，已经在变更链表里了
+        if(again)
         {
-            if(t->_handler(t->_param))
+            if(t->_repeats > 0){ --(t->_repeats); }
+            if(t->_repeats == 0)
             {
-                active_list.pop(t);
-                if(t->_repeats > 0){ --(t->_repeats); }
-                if(t->_repeats == 0)
-                {
-                    free_timer(t);
-                }
-                else
-                {
-                    t->_nexttime += t->_timeout;
-                    readd_timer(t);
-                }
+                free_timer(t);
             }
             else
             {
-                free_timer(t);
+                t->_nexttime = std::max<TIMETYPE>(t->_nexttime + t->_timeout, _tickcount + 1);
+                readd_timer(t);
             }
         }
-        t = next;
+        else
+        {
+            free_timer(t);
+        }
     }
 }
 
@@ -161,43 +207,72 @@ void timewheel::switch_changelist()
     _frontidx = !_frontidx;
 }
 
-void timewheel::regroup_timers()
+// 把level级第index个槽里的定时器按到期时间重新分配到低级别，返回index，为0说明上一级也转完了一圈
+size_t timewheel::cascade(int level, size_t index)
 {
-    size_t i = 0, count = _hanging_slots.count;
-    for(timer_node* t = _hanging_slots.head; i < count; ++i)
+    timerlist& slot = _far_slots[level][index];
+    while(timer_node* t = slot.head)
     {
         bee::spinlock::scoped l(t->_locker);
-        timer_node* next = t->_next;
-        if(t->_nexttime - _tickcount < NEAR_SLOTS)
-        {
-            int offset = _tickcount % NEAR_SLOTS;
-            if(t->_nexttime - _tickcount > 0)
-                offset = t->_nexttime % NEAR_SLOTS;
-            _hanging_slots.pop(t);
-            _near_slots[offset].push_back(t);
-        }
-        t = next;
+        slot.pop(t);
+        internal_add_timer(t);
     }
+    return index;
 }
 
 void timewheel::tick()
 {
     switch_changelist();
     load_timers();
+
+    // 第一级转完一圈，逐级把上一级当前槽的定时器降下来
+    if((_tickcount & TVR_MASK) == 0)
+    {
+        for(int level = 0; level < TVN_LEVELS; ++level)
+        {
+            size_t index = (_tickcount >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+            if(cascade(level, index) != 0) break;
+        }
+    }
+
     handle_timer();
     ++_tickcount;
-    if(_tickcount % NEAR_SLOTS == 0)
+}
+
+// 空闲时不推进tick，有新定时器后从当时开始重新计时，所以空闲再久也不会一次补很多tick
+TIMETYPE timewheel::update(TIMETYPE nowtime)
+{
+    if(empty())
+    {
+        _nexttick_time = 0;
+        return -1;
+    }
+    if(_nexttick_time == 0)
     {
-        regroup_timers();
+        _nexttick_time = nowtime;
     }
+    while(_nexttick_time <= nowtime)
+    {
+        tick();
+        _nexttick_time += _ticktime;
+    }
+    return _nexttick_time - nowtime;
+}
+
+bool timewheel::empty()
+{
+    if(_timer_count > 0) return false;
+    bee::spinlock::scoped l(_changelist_locker);
+    return get_back_changelist().count == 0;
 }
 
 void timewheel::run()
 {
     while(!_stop)
     {
-        tick();
-        usleep(_ticktime * 1000);
+        // 按单调时钟推进，handler耗时和usleep误差不会累积成漂移
+        TIMETYPE wait = update(cached_clock::get_monotonic_millseconds());
+        usleep((wait < 0 ? _ticktime : wait) * 1000);
     }
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 #include <assert.h>
 #include <stddef.h>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <utility>
@@ -12,7 +13,29 @@
 namespace bee
 {
 
-#define NEAR_SLOTS 4096
+/*
+ * 多级时间轮（参照Linux内核的做法）
+ * 1.第一级256个槽，每个槽一个tick；后面4级各64个槽，每个槽覆盖上一级一整圈，一共能表示2^32个tick；
+ * 2.定时器按到期时间直接放进对应级别的槽，添加和删除都是O(1)；
+ * 3.第一级转完一圈时只把上一级当前槽里的定时器重新分配下来（懒惰降级），不再扫描所有远期定时器；
+ * 4.可以是全局定时器线程的单例，也可以由每个reactor各持有一个，用update按单调时钟推进，
+ *   添加/删除可以在任意线程，tick只在持有者线程。
+ */
+#define TVR_BITS   8
+#define TVN_BITS   6
+#define TVR_SIZE   (1 << TVR_BITS)
+#define TVN_SIZE   (1 << TVN_BITS)
+#define TVR_MASK   (TVR_SIZE - 1)
+#define TVN_MASK   (TVN_SIZE - 1)
+#define TVN_LEVELS 4
+#define MAX_TIMER_TICKS ((1ULL << (TVR_BITS + TVN_BITS * TVN_LEVELS)) - 1)
+
+// 定时器id = 序号 << TIMER_INDEX_BITS | 池索引，节点重新分配后序号变化，过期的id删除/修改都会失败
+#define TIMER_INDEX_BITS  24
+#define TIMER_SERIAL_BITS 16
+#define TIMER_ID_BITS     (TIMER_INDEX_BITS + TIMER_SERIAL_BITS)
+#define TIMER_INDEX_MASK  ((1LL << TIMER_INDEX_BITS) - 1)
+#define TIMER_SERIAL_MASK ((1LL << TIMER_SERIAL_BITS) - 1)
 
 using callback = std::function<bool(void*)>;
 
@@ -23,8 +46,11 @@ enum TIMER_OBJECT_STATE
     TIMER_STATE_ADD,
     TIMER_STATE_DEL,
     TIMER_STATE_MOD,
+    TIMER_STATE_RUN, // handler正在执行，不持有节点锁
 };
 
+struct timerlist;
+
 struct timer_node : public light_object_base<bee::spinlock>
 {
     void assign()
@@ -36,20 +62,29 @@ struct timer_node : public light_object_base<bee::spinlock>
         _param = nullptr;
         _repeats = 0;
         _state = TIMER_STATE_NONE;
+        _pending = false;
+        _loaded = false;
         _prev = nullptr;
         _next = nullptr;
+        _slot = nullptr;
+        _change_next = nullptr;
     }
 
-    TIMERID  _id = 0;
+    TIMERID  _id = 0; // 池索引
+    uint16_t _serial = 0; // 每次分配加1，不在assign里清理
     TIMETYPE _timeout = 0;
     TIMETYPE _nexttime = 0;
     callback _handler = {};
     void* _param = nullptr;
     int _repeats = 0;
     uint8_t _state = TIMER_STATE_NONE;
+    bool _pending = false; // 在变更链表里，状态再变化时不用重复加入
+    bool _loaded = false;  // 已经被时间轮接收，计入_timer_count
 
     timer_node* _prev = nullptr;
     timer_node* _next = nullptr;
+    timerlist* _slot = nullptr; // 所在的槽，删除时直接从这个槽摘除
+    timer_node* _change_next = nullptr; // 变更链表单独用一个指针，不会破坏槽里的链表
 };
 
 struct timerlist
@@ -57,6 +92,7 @@ struct timerlist
     timerlist() : head(nullptr), count(0) {}
     void push_back(timer_node* t)
     {
+        t->_slot = this;
         if(head)
         {
             ASSERT(head->_prev != nullptr);
@@ -75,11 +111,14 @@ struct timerlist
     }
     void pop(timer_node* t)
     {
-        ASSERT(head);
+        ASSERT(head && t->_slot == this);
+        t->_slot = nullptr;
         if(t == head && count == 1)
         {
             head = nullptr;
             count = 0;
+            t->_prev = nullptr;
+            t->_next = nullptr;
             return;
         }
         ASSERT(t->_next);
@@ -109,19 +148,55 @@ struct timerlist
     size_t count = 0;
 };
 
+// 添加和删除请求的链表，由添加线程写入，定时器线程在tick开始时一次性处理
+struct timer_changelist
+{
+    void push_back(timer_node* t)
+    {
+        t->_change_next = nullptr;
+        if(tail)
+        {
+            tail->_change_next = t;
+        }
+        else
+        {
+            head = t;
+        }
+        tail = t;
+        ++count;
+    }
+    void clear()
+    {
+        head = nullptr;
+        tail = nullptr;
+        count = 0;
+    }
+    timer_node* head = nullptr;
+    timer_node* tail = nullptr;
+    size_t count = 0;
+};
+
 class timewheel : public singleton_support<timewheel>
 {
 public:
     void init();
+    void init(TIMETYPE ticktime/*ms*/, size_t poolsize);
     auto add_timer(bool delay, TIMETYPE timeout/*ms*/, int repeats, callback handler, void* param) -> TIMERID;
-    bool del_timer(TIMERID timerid);
+    bool del_timer(TIMERID timerid); // 任何状态都可以删除，包括还没生效的和正在执行的
+    bool mod_timer(TIMERID timerid, TIMETYPE timeout/*ms*/); // 从现在开始重新计时，重复定时器之后的间隔也改成timeout
     void run();
     void stop();
+    void tick(); // 推进一个tick
+    TIMETYPE update(TIMETYPE nowtime/*ms*/); // 按时间补齐该走的tick，返回离下一个tick的毫秒数，没有定时器时返回-1
+    bool empty(); // 时间轮和变更链表里都没有定时器
+
+    FORCE_INLINE size_t get_timer_count() const { return _timer_count; }
 
     FORCE_INLINE uint64_t get_tickcount(){ return _tickcount; }
     FORCE_INLINE TIMETYPE get_ticktime() { return _ticktime;  }
 
 private:
+    timer_node* find_timer(TIMERID timerid);
     void add_to_changelist(timer_node* t);
     void readd_timer(timer_node* t);
     void remove_timer(timer_node* t);
@@ -129,25 +204,27 @@ private:
     void load_timers();
     void handle_timer();
     void switch_changelist();
-    void regroup_timers();
-    void tick();
+    void internal_add_timer(timer_node* t);
+    size_t cascade(int level, size_t index);
 
-    FORCE_INLINE timerlist& get_front_changelist() { return _changelist[_frontidx];  }
-    FORCE_INLINE timerlist& get_back_changelist()  { return _changelist[!_frontidx]; }
+    FORCE_INLINE timer_changelist& get_front_changelist() { return _changelist[_frontidx];  }
+    FORCE_INLINE timer_changelist& get_back_changelist()  { return _changelist[!_frontidx]; }
 
 private:
     bool _stop = true;
-    timerlist _near_slots[NEAR_SLOTS];
-    timerlist _hanging_slots;
+    timerlist _near_slots[TVR_SIZE];
+    timerlist _far_slots[TVN_LEVELS][TVN_SIZE];
+    size_t _timer_count = 0; // 时间轮里的定时器数量
 
-    uint64_t _tickcount = 0;
+    std::atomic<uint64_t> _tickcount = 0; // 添加定时器的线程会读
     TIMETYPE _ticktime  = 0; // ms
+    TIMETYPE _nexttick_time = 0; // 下一个tick的单调时间，0表示空闲后还没开始计时
 
     bee::spinlock _changelist_locker;
     bool _frontidx = 0;
-    timerlist _changelist[2];
+    timer_changelist _changelist[2];
 
-    lockfree_objectpool<timer_node> _timerpool;
+    lockfree_objectpool<timer_node, EAGER> _timerpool; // 预先构造，过期的id查到的节点也可以安全加锁
 };
 
 } // namespace bee
\ No newline at end of file
@@ -1,4 +1,6 @@
 #pragma once
+#include <string_view>
+
 #include "octets.h"
 #include "stringfy.h"
 #include "formatter.h"
@@ -35,10 +37,11 @@ public:
     octets& data() { return _buf; }
     size_t size() const { return _buf.size(); }
     bool empty() const { return _buf.empty(); }
-    void truncate(size_t size) { if(size < _buf.size()) _buf.fast_resize(size); }
+    void truncate(size_t size) { if(size < _buf.size()) _buf.erase(size, _buf.size() - size); }
     void reserve(size_t cap) { _buf.reserve(cap); }
     void clear() { _buf.clear();}
     std::string str() { return std::string(_buf.data(), _buf.size()); }
+    std::string_view view() const { return std::string_view(_buf.data(), _buf.size()); }
     const char* c_str();
 
 private:
@@ -9,6 +9,7 @@ namespace bee
     // forward declaration
     std::string to_string(const char* val);
     std::string to_string(const octets& val);
+    std::string to_string(const octets_view& val);
     std::string to_string(const std::string& val);
     std::string to_string(const std::string_view& val);
 
@@ -23,6 +24,7 @@ namespace bee
 {
 inline std::string to_string(const char* val) { return val; }
 inline std::string to_string(const octets& val) { return val; }
+inline std::string to_string(const octets_view& val) { return val; }
 inline std::string to_string(const std::string& val) { return val; }
 inline std::string to_string(const std::string_view& val) { return {val.data(), val.size()}; }
 
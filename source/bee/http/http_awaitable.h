@@ -0,0 +1,75 @@
+#pragma once
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "coroutine.h"
+#include "httpclient.h"
+
+namespace bee
+{
+
+struct http_result
+{
+    FORCE_INLINE bool ok() const { return status == HTTP_STATUS_OK && response; }
+
+    int status = 0; // http状态码，请求没发出去时是HTTP_RESULT_xxx
+    std::unique_ptr<httpresponse> response;
+};
+
+/*
+ * co_await http_get(client, "/path")，收到回应或者超时后在执行回调的工作线程上恢复协程
+ * 回调结束后http任务会释放请求和回应，所以回应复制一份交给调用方
+ */
+class http_awaitable
+{
+public:
+    http_awaitable(httpclient* client, HTTP_METHOD method, std::string path, std::string body, TIMETYPE timeout, httpprotocol::MAP_TYPE headers)
+        : _client(client), _method(method), _path(std::move(path)), _body(std::move(body)), _timeout(timeout), _headers(std::move(headers)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        _handle = handle;
+        int ret = _client->send_request(_method, _path, [this](int status, httprequest* req, httpresponse* rsp)
+        {
+            _result.status = status;
+            if(rsp) _result.response.reset(rsp->dup());
+            _handle.resume();
+        }, _timeout, _headers, _body);
+
+        // 成功后回调可能已经在其他线程上恢复了协程，只有失败时才能访问成员
+        if(ret != HTTP_RESULT_OK)
+        {
+            _result.status = ret;
+            return false; // 不挂起，直接返回错误
+        }
+        return true;
+    }
+
+    http_result await_resume() { return std::move(_result); }
+
+private:
+    httpclient* _client = nullptr;
+    HTTP_METHOD _method;
+    std::string _path;
+    std::string _body;
+    TIMETYPE _timeout = 0;
+    httpprotocol::MAP_TYPE _headers;
+    std::coroutine_handle<> _handle;
+    http_result _result;
+};
+
+inline http_awaitable http_get(httpclient* client, std::string path, TIMETYPE timeout = 0, httpprotocol::MAP_TYPE headers = {})
+{
+    return http_awaitable(client, HTTP_METHOD_GET, std::move(path), {}, timeout, std::move(headers));
+}
+
+inline http_awaitable http_post(httpclient* client, std::string path, std::string body, TIMETYPE timeout = 0, httpprotocol::MAP_TYPE headers = {})
+{
+    return http_awaitable(client, HTTP_METHOD_POST, std::move(path), std::move(body), timeout, std::move(headers));
+}
+
+} // namespace bee
@@ -1,6 +1,6 @@
 #include "httpclient.h"
 #include "config.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 #include "http_callback.h"
 #include "address.h"
 #ifdef _REENTRANT
@@ -168,7 +168,7 @@ int httpclient::trace(const std::string& path, callback cbk, TIMETYPE timeout, h
 void httpclient::start_task(httprequest* req, callback cbk, TIMETYPE timeout)
 {
     HTTP_TASKID taskid = ++_next_http_taskid;
-    auto* task = new http_functional_callback(taskid, req, systemtime::get_time() + timeout, std::move(cbk));
+    auto* task = new http_functional_callback(taskid, req, cached_clock::get_time() + timeout, std::move(cbk));
     _http_tasks.emplace(taskid, task);
     _connections.pending.emplace_back(taskid);
 }
@@ -292,7 +292,7 @@ bool httpclient::refresh_dns(const std::string& uri_str)
 
 void httpclient::check_timeouts()
 {
-    TIMETYPE now = systemtime::get_time();
+    TIMETYPE now = cached_clock::get_time();
 
     for(auto iter = _http_tasks.begin(); iter != _http_tasks.end(); )
     {
@@ -239,14 +239,12 @@ httpprotocol* httpprotocol::decode(octetsstream& os, httpsession* httpses)
 
 httprequest* httpprotocol::get_request()
 {
-    auto req = get_protocol(httprequest::TYPE);
-    return (httprequest*)(req->dup());
+    return (httprequest*)get_protocol(httprequest::TYPE);
 }
 
 httpresponse* httpprotocol::get_response()
 {
-    auto rsp = get_protocol(httpresponse::TYPE);
-    return (httpresponse*)(rsp->dup());
+    return (httpresponse*)get_protocol(httpresponse::TYPE);
 }
 
 void httpprotocol::on_parse_header_finished()
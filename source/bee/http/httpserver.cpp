@@ -5,7 +5,7 @@
 #include "httpprotocol.h"
 #include "log.h"
 #include "servlet.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 #ifdef _REENTRANT
 #include "threadpool.h"
 #endif
@@ -64,7 +64,7 @@ void httpserver::start_task(httprequest* req, httpresponse* rsp)
 
     HTTP_TASKID taskid = ++_next_http_taskid;
     task->set_taskid(taskid);
-    task->set_timeout(systemtime::get_time() + _http_task_timeout);
+    task->set_timeout(cached_clock::get_time() + _http_task_timeout);
     task->set_request(req);
     task->set_response(rsp);
     _http_tasks.emplace(taskid, task);
@@ -127,7 +127,7 @@ void httpserver::handle_request(httprequest* req)
 
 void httpserver::check_timeouts()
 {
-    TIMETYPE now = systemtime::get_time();
+    TIMETYPE now = cached_clock::get_time();
 
     for(auto iter = _http_tasks.begin(); iter != _http_tasks.end();)
     {
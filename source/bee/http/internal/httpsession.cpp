@@ -28,10 +28,8 @@ httpsession* httpsession::dup()
     ses->_peer = _peer->dup();
 
     ses->_event = nullptr;
-    ses->_readbuf.clear();
-    ses->_writebuf.clear();
     ses->_reados.clear();
-    ses->_writeos.clear();
+    ses->_writeq.clear();
     ses->_requests = 0;
     ses->_unfinished_protocol = nullptr;
     return ses;
@@ -41,19 +39,14 @@ void httpsession::on_recv(size_t len)
 {
     activate();
 
-    local_log("httpsession::on_recv len=%zu, _readbuf size:%zu _reados size:%zu.", len, _readbuf.size(), _reados.size());
+    local_log("httpsession::on_recv len=%zu, _reados size:%zu pos:%zu.", len, _reados.size(), _reados.get_pos());
     set_state(SESSION_STATE_RECVING);
 
-    size_t append_length = std::min(_readbuf.size(), _reados.data().free_space());
-    _reados.data().append(_readbuf, append_length);
-    _readbuf.erase(0, append_length);
-    local_log("on_recv append size:%zu, _readbuf size:%zu _reados size:%zu.", append_length, _readbuf.size(), _reados.size());
-
     while(httpprotocol* prot = httpprotocol::decode(_reados, this))
     {
         static_cast<httpsession_manager*>(_manager)->handle_protocol(prot);
     }
-    _reados.try_shrink();
+    _reados.reclaim();
 }
 
 void httpsession::on_send(size_t len)
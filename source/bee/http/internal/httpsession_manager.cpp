@@ -31,9 +31,7 @@ void httpsession_manager::init()
 
 httpsession* httpsession_manager::find_session(SID sid)
 {
-    bee::rwlock::rdscoped l(_locker);
-    auto iter = _sessions.find(sid);
-    return iter != _sessions.end() ? static_cast<httpsession*>(iter->second) : nullptr;
+    return static_cast<httpsession*>(_sessions.get(sid, nullptr));
 }
 
 void httpsession_manager::send_request_nolock(session* ses, const httprequest& req)
@@ -44,13 +42,14 @@ void httpsession_manager::send_request_nolock(session* ses, const httprequest& r
     os.clear();
     req.encode(os);
 
-    if(os.size() > ses->_writeos.data().free_space())
+    bee::rwlock::wrscoped sesl(ses->_locker); // 写队列和reactor线程上的handle_write共用
+    if(ses->is_wqueue_full())
     {
-        local_log("httpsession_manager %s, session %lu write buffer is fulled.", identity(), ses->get_sid());
+        local_log("httpsession_manager %s, session %lu write queue is fulled.", identity(), ses->get_sid());
         return;
     }
 
-    ses->_writeos.data().append(os.data(), os.size());
+    ses->_writeq.append(std::move(os.data()));
     ses->permit_send();
 }
 
@@ -62,13 +61,14 @@ void httpsession_manager::send_response_nolock(session* ses, const httpresponse&
     os.clear();
     rsp.encode(os);
 
-    if(os.size() > ses->_writeos.data().free_space())
+    bee::rwlock::wrscoped sesl(ses->_locker); // 写队列和reactor线程上的handle_write共用
+    if(ses->is_wqueue_full())
     {
-        local_log("httpsession_manager %s, session %lu write buffer is fulled.", identity(), ses->get_sid());
+        local_log("httpsession_manager %s, session %lu write queue is fulled.", identity(), ses->get_sid());
         return;
     }
 
-    ses->_writeos.data().append(os.data(), os.size());
+    ses->_writeq.append(std::move(os.data()));
     ses->permit_send();
 }
 
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 #include "glog.h"
 #include "demultiplexer.h"
@@ -28,19 +36,33 @@ bool epoller::init()
     return true;
 }
 
+namespace
+{
+
+constexpr uint64_t EPOLL_DATA_ACCEPT = 1ULL << 32;
+
+inline uint64_t make_epoll_data(int fd, bool accept, uint32_t gen)
+{
+    return (uint64_t(gen) << 33) | (accept ? EPOLL_DATA_ACCEPT : 0) | uint32_t(fd);
+}
+
+} // namespace
+
 int epoller::add_event(event* ev, int events)
 {
     if(events == EVENT_NONE) return -1;
+    int fd = ev->get_handle();
+    if(fd < 0) return -1;
 
     struct epoll_event event = {0, {0}};
-    event.data.ptr = ev;
-    event.data.fd = ev->get_handle();
-
+    if(_edge_triggered)
+    {
+        event.events |= EPOLLET;
+    }
     if(events & EVENT_ACCEPT)
     {
         event.events |= EPOLLIN;
-        _listenfds.insert(ev->get_handle());
-        local_log("add accept event, listenfd is %d", ev->get_handle());
+        local_log("add accept event, listenfd is %d", fd);
     }
     if(events & EVENT_RECV)
     {
@@ -59,14 +81,20 @@ int epoller::add_event(event* ev, int events)
         event.events |= EPOLLIN;
     }
 
+    if((size_t)fd >= _gens.size())
+    {
+        _gens.resize(std::max<size_t>(fd + 1, _gens.size() * 2), 0);
+    }
+
     int op;
     if(ev->get_status() == EVENT_STATUS_NONE)
     {
         op = EPOLL_CTL_ADD;
         ev->set_status(EVENT_STATUS_ADD);
+        _gens[fd] = (_gens[fd] + 1) & 0x7fffffff;
         if(events & EVENT_WAKEUP)
         {
-            _wakeup_fd = ev->get_handle();
+            _wakeup_fd = fd;
             local_log("set wakeupfd:%d.", _wakeup_fd);  
         }
     }
@@ -76,16 +104,17 @@ int epoller::add_event(event* ev, int events)
     }
     else
     {
-        local_log("add_event failed %d, epfd=%d", ev->get_handle(), _epfd);
+        local_log("add_event failed %d, epfd=%d", fd, _epfd);
         return -2;
     }
+    event.data.u64 = make_epoll_data(fd, events & EVENT_ACCEPT, _gens[fd]);
 
-    if(int ret = epoll_ctl(_epfd, op, ev->get_handle(), &event))
+    if(int ret = epoll_ctl(_epfd, op, fd, &event))
     {
-        local_log("add_event failed %d, ret=%d epfd=%d", ev->get_handle(), ret, _epfd);
+        local_log("add_event failed %d, ret=%d epfd=%d", fd, ret, _epfd);
         return -3;
     }
-    //printf("epoller::add_event success handle=%d events=%d\n", ev->get_handle(), events);
+    //printf("epoller::add_event success handle=%d events=%d\n", fd, events);
     return 0;
 }
 
@@ -94,12 +123,16 @@ void epoller::del_event(event* ev)
     if(ev->get_status() != EVENT_STATUS_ADD) return;
     ev->set_status(EVENT_STATUS_NONE);
 
-    struct epoll_event event = {0, {0}};
-    event.data.ptr = ev;
+    int fd = ev->get_handle();
+    if((size_t)fd < _gens.size())
+    {
+        _gens[fd] = (_gens[fd] + 1) & 0x7fffffff;
+    }
 
-    if(epoll_ctl(_epfd, EPOLL_CTL_DEL, ev->get_handle(), &event) < 0)
+    struct epoll_event event = {0, {0}};
+    if(epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &event) < 0)
     {
-        local_log("del_event failed %d", ev->get_handle());
+        local_log("del_event failed %d", fd);
         return;
     }
 }
@@ -125,21 +158,18 @@ void epoller::dispatch(reactor* base, int timeout)
 
     for(int i = 0; i < nready; i++)
     {
-        event* ev = base->get_event(events[i].data.fd);
+        uint64_t data = events[i].data.u64;
+        int fd = (int)(uint32_t)data;
+        if(_gens[fd] != (uint32_t)(data >> 33)) continue; // 已注销或fd已被复用
+
+        event* ev = base->get_event(fd);
         if(ev == nullptr || ev->get_status() != EVENT_STATUS_ADD) continue;
 
-        //printf("epoller dispatch event fd=%d events=%d\n", events[i].data.fd, events[i].events);
+        //printf("epoller dispatch event fd=%d events=%d\n", fd, events[i].events);
         int active_events = 0;
-        if(events[i].events & EPOLLIN || events[i].events & EPOLLHUP)
+        if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
         {
-            if(_listenfds.contains(events[i].data.fd))
-            {
-                active_events |= EVENT_ACCEPT;
-            }
-            else
-            {
-                active_events |= EVENT_RECV;
-            }
+            active_events |= (data & EPOLL_DATA_ACCEPT) ? EVENT_ACCEPT : EVENT_RECV;
         }
         if(events[i].events & EPOLLOUT)
         {
@@ -167,4 +197,419 @@ void epoller::wakeup()
     // local_log("epoller::wakeup() run success");
 }
 
+#define URING_ENTRIES 4096
+#define URING_IGNORE_USERDATA (~0ULL)
+
+namespace
+{
+
+#define URING_POLLOUT_FLAG 0x80000000u
+
+// 高32位是注册代数，低32位是fd，fd的最高位标记写方向的poll
+inline uint64_t make_poll_userdata(int fd, uint32_t gen, bool out = false)
+{
+    return (uint64_t(gen) << 32) | uint32_t(fd) | (out ? URING_POLLOUT_FLAG : 0);
+}
+
+inline int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+inline int io_uring_enter(int ringfd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, ringfd, to_submit, min_complete, flags, arg, argsz);
+}
+
+inline int io_uring_register(int ringfd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ringfd, opcode, arg, nr_args);
+}
+
+} // namespace
+
+uring_poller::~uring_poller()
+{
+    if(_sqes) munmap(_sqes, _sqes_size);
+    if(_cq_ptr && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_size);
+    if(_sq_ptr) munmap(_sq_ptr, _sq_size);
+    if(_ringfd >= 0)
+    {
+        close(_ringfd);
+    }
+}
+
+bool uring_poller::init()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    _ringfd = io_uring_setup(URING_ENTRIES, &params);
+    if(_ringfd < 0)
+    {
+        local_log("io_uring_setup failed: %s.", strerror(errno));
+        return false;
+    }
+    _features = params.features;
+
+    // multishot poll需要5.13，EXT_ARG(带超时的等待)需要5.11，用同版本引入的feature位判断
+    if(!(_features & IORING_FEAT_EXT_ARG) || !(_features & IORING_FEAT_RSRC_TAGS) || !probe_features())
+    {
+        local_log("io_uring lacks multishot poll support, features=0x%x.", _features);
+        return false;
+    }
+
+    _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(_features & IORING_FEAT_SINGLE_MMAP)
+    {
+        _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+    }
+    _sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQ_RING);
+    if(_sq_ptr == MAP_FAILED)
+    {
+        _sq_ptr = nullptr;
+        perror("mmap sq ring");
+        return false;
+    }
+    if(_features & IORING_FEAT_SINGLE_MMAP)
+    {
+        _cq_ptr = _sq_ptr;
+    }
+    else
+    {
+        _cq_ptr = mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_CQ_RING);
+        if(_cq_ptr == MAP_FAILED)
+        {
+            _cq_ptr = nullptr;
+            perror("mmap cq ring");
+            return false;
+        }
+    }
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        perror("mmap sqes");
+        return false;
+    }
+    _sqes = (struct io_uring_sqe*)sqes;
+
+    char* sq = (char*)_sq_ptr;
+    _sq_head  = (unsigned*)(sq + params.sq_off.head);
+    _sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+    _sq_array = (unsigned*)(sq + params.sq_off.array);
+    _sq_mask  = *(unsigned*)(sq + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sq_local_tail = *_sq_tail;
+
+    char* cq = (char*)_cq_ptr;
+    _cq_head = (unsigned*)(cq + params.cq_off.head);
+    _cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    _cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    _cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    local_log("uring_poller init ringfd=%d sq_entries=%u cq_entries=%u features=0x%x.",
+              _ringfd, params.sq_entries, params.cq_entries, _features);
+    return true;
+}
+
+bool uring_poller::probe_features()
+{
+    constexpr size_t probe_ops = 256;
+    std::vector<char> buf(sizeof(struct io_uring_probe) + probe_ops * sizeof(struct io_uring_probe_op), 0);
+    auto* probe = (struct io_uring_probe*)buf.data();
+    if(io_uring_register(_ringfd, IORING_REGISTER_PROBE, probe, probe_ops) < 0)
+    {
+        local_log("io_uring probe failed: %s.", strerror(errno));
+        return false;
+    }
+    for(int op : { IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE })
+    {
+        if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct io_uring_sqe* uring_poller::get_sqe()
+{
+    unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if(_sq_local_tail - head >= _sq_entries)
+    {
+        flush_sqes();
+        head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if(_sq_local_tail - head >= _sq_entries)
+        {
+            local_log("uring_poller sq is full, ringfd=%d.", _ringfd);
+            return nullptr;
+        }
+    }
+    unsigned idx = _sq_local_tail & _sq_mask;
+    struct io_uring_sqe* sqe = &_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[idx] = idx;
+    ++_sq_local_tail;
+    ++_to_submit;
+    return sqe;
+}
+
+int uring_poller::flush_sqes()
+{
+    if(_to_submit == 0) return 0;
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    int ret = io_uring_enter(_ringfd, _to_submit, 0, 0, nullptr, 0);
+    if(ret < 0)
+    {
+        local_log("io_uring_enter submit failed: %s.", strerror(errno));
+        return ret;
+    }
+    _to_submit -= ret;
+    return ret;
+}
+
+void uring_poller::arm_poll(int fd, poll_slot& slot)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if(sqe == nullptr) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = slot.in_mask;
+    sqe->user_data = make_poll_userdata(fd, slot.in_gen);
+    slot.in_armed = true;
+}
+
+void uring_poller::arm_out_poll(int fd, poll_slot& slot)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if(sqe == nullptr) return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = make_poll_userdata(fd, slot.out_gen, true);
+    slot.out_armed = true;
+}
+
+void uring_poller::cancel_poll(uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if(sqe == nullptr) return;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = URING_IGNORE_USERDATA;
+}
+
+int uring_poller::add_event(event* ev, int events)
+{
+    if(events == EVENT_NONE) return -1;
+    int fd = ev->get_handle();
+    if(fd < 0) return -1;
+
+    uint32_t in_mask = 0;
+    if(events & (EVENT_ACCEPT | EVENT_RECV | EVENT_WAKEUP))
+    {
+        in_mask |= POLLIN;
+    }
+    if(events & EVENT_HUP)
+    {
+        in_mask |= POLLHUP;
+    }
+
+    if(ev->get_status() == EVENT_STATUS_NONE)
+    {
+        ev->set_status(EVENT_STATUS_ADD);
+        if(events & EVENT_WAKEUP)
+        {
+            _wakeup_fd = fd;
+            local_log("set wakeupfd:%d.", _wakeup_fd);
+        }
+    }
+    else if(ev->get_status() != EVENT_STATUS_ADD)
+    {
+        local_log("add_event failed %d, ringfd=%d", fd, _ringfd);
+        return -2;
+    }
+
+    if((size_t)fd >= _slots.size())
+    {
+        _slots.resize(fd + 1);
+    }
+    poll_slot& slot = _slots[fd];
+    slot.accept = events & EVENT_ACCEPT;
+
+    // 读方向只在关心的事件变化时撤销重提，新提交的poll会立即报告当前已就绪的事件，
+    // permit_read之前积压的数据不会被吞掉；只改写方向时读poll保持不动
+    if(!slot.in_armed || slot.in_mask != in_mask)
+    {
+        if(slot.in_armed)
+        {
+            cancel_poll(make_poll_userdata(fd, slot.in_gen));
+            slot.in_armed = false;
+        }
+        ++slot.in_gen;
+        slot.in_mask = in_mask;
+        if(in_mask != 0) arm_poll(fd, slot);
+    }
+
+    // 写方向用一次性poll，permit_write/forbid_write只翻转out_wanted：
+    // 还挂在内核里的poll不撤销，完成时如果已经不关心可写就丢弃，不需要额外的POLL_REMOVE
+    slot.out_wanted = events & EVENT_SEND;
+    if(slot.out_wanted && !slot.out_armed)
+    {
+        arm_out_poll(fd, slot);
+    }
+
+    bool in_ok = in_mask == 0 || slot.in_armed;
+    bool out_ok = !slot.out_wanted || slot.out_armed;
+    return (in_ok && out_ok) ? 0 : -3;
+}
+
+void uring_poller::del_event(event* ev)
+{
+    if(ev->get_status() != EVENT_STATUS_ADD) return;
+    ev->set_status(EVENT_STATUS_NONE);
+
+    int fd = ev->get_handle();
+    if(fd < 0 || (size_t)fd >= _slots.size()) return;
+    poll_slot& slot = _slots[fd];
+    if(slot.in_armed)
+    {
+        cancel_poll(make_poll_userdata(fd, slot.in_gen));
+        slot.in_armed = false;
+    }
+    if(slot.out_armed)
+    {
+        cancel_poll(make_poll_userdata(fd, slot.out_gen, true));
+        slot.out_armed = false;
+    }
+    ++slot.in_gen;
+    ++slot.out_gen;
+    slot.in_mask = 0;
+    slot.out_wanted = false;
+    // POLL_REMOVE按user_data匹配，和下一轮dispatch的等待一起提交即可，fd号被复用也不会误删；
+    // 在那之前poll请求持有文件引用，socket的真正释放最多推迟一轮循环
+}
+
+void uring_poller::dispatch(reactor* base, int timeout)
+{
+#ifdef _REENTRANT
+    _wakeup.store(false, std::memory_order_release);
+#else
+    _wakeup = false;
+#endif
+    struct __kernel_timespec ts = { 0, 0 };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if(timeout >= 0)
+    {
+        ts.tv_sec  = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        arg.ts = (uint64_t)&ts;
+    }
+
+    // 提交积累的sqe并等待至少一个cqe，一次系统调用
+    unsigned head = *_cq_head;
+    unsigned min_complete = (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) ? 1 : 0;
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    int ret = io_uring_enter(_ringfd, _to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if(ret < 0)
+    {
+        if(errno != ETIME && errno != EINTR && errno != EBUSY)
+        {
+            perror("io_uring_enter");
+            return;
+        }
+    }
+    else
+    {
+        _to_submit -= ret;
+    }
+
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+        struct io_uring_cqe* cqe = &_cqes[head & _cq_mask];
+        uint64_t user_data = cqe->user_data;
+        if(user_data == URING_IGNORE_USERDATA) continue;
+
+        bool out = (uint32_t)user_data & URING_POLLOUT_FLAG;
+        int fd = (int)((uint32_t)user_data & ~URING_POLLOUT_FLAG);
+        uint32_t gen = (uint32_t)(user_data >> 32);
+        if((size_t)fd >= _slots.size()) continue;
+        poll_slot& slot = _slots[fd];
+
+        if(out)
+        {
+            if(!slot.out_armed || slot.out_gen != gen) continue; // fd已经注销过
+            slot.out_armed = false;
+            if(!slot.out_wanted) continue; // 等待期间forbid_write了
+            if(cqe->res < 0)
+            {
+                if(cqe->res != -ECANCELED) arm_out_poll(fd, slot);
+                continue;
+            }
+
+            event* ev = base->get_event(fd);
+            if(ev == nullptr || ev->get_status() != EVENT_STATUS_ADD) continue;
+            ev->handle_event(EVENT_SEND);
+
+            // 一次性poll，还关心可写就再提交一个，handle_event中可能已经重新注册过
+            poll_slot& cur = _slots[fd];
+            if(cur.out_wanted && !cur.out_armed && cur.out_gen == gen && ev->get_status() == EVENT_STATUS_ADD)
+            {
+                arm_out_poll(fd, cur);
+            }
+            continue;
+        }
+
+        if(!slot.in_armed || slot.in_gen != gen) continue; // 已经取消或重新注册过的poll
+
+        bool rearm = !(cqe->flags & IORING_CQE_F_MORE);
+        if(rearm) slot.in_armed = false;
+        if(cqe->res < 0)
+        {
+            if(cqe->res != -ECANCELED && rearm) arm_poll(fd, slot);
+            continue;
+        }
+
+        event* ev = base->get_event(fd);
+        if(ev == nullptr || ev->get_status() != EVENT_STATUS_ADD) continue;
+
+        uint32_t revents = (uint32_t)cqe->res;
+        if(revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ev->handle_event(slot.accept ? EVENT_ACCEPT : EVENT_RECV);
+        }
+
+        // multishot被内核终止(如cq溢出)时重新注册，handle_event中可能已经改过注册
+        poll_slot& cur = _slots[fd];
+        if(rearm && !cur.in_armed && cur.in_gen == gen && ev->get_status() == EVENT_STATUS_ADD)
+        {
+            arm_poll(fd, cur);
+        }
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+void uring_poller::wakeup()
+{
+    if(_wakeup_fd < 0) return;
+#ifdef _REENTRANT
+    if(_wakeup.exchange(true, std::memory_order_release)) return;
+#else
+    if(_wakeup) return;
+    _wakeup = true;
+#endif
+    static constexpr eventfd_t value = 1;
+    if(write(_wakeup_fd, &value, sizeof(value)) < 0)
+    {
+        if(errno != EAGAIN) perror("wakeupfd write failed");
+    }
+}
+
 } // namespace bee
\ No newline at end of file
@@ -2,9 +2,13 @@
 #ifdef _REENTRANT
 #include <atomic>
 #endif
-#include <set>
+#include <cstdint>
+#include <vector>
 #include "event.h"
 
+struct io_uring_sqe;
+struct io_uring_cqe;
+
 namespace bee
 {
 
@@ -35,6 +39,7 @@ protected:
 class epoller : public demultiplexer
 {
 public:
+    explicit epoller(bool edge_triggered = false) : _edge_triggered(edge_triggered) {}
     virtual ~epoller() override;
     virtual bool init() override;
     virtual int  add_event(event* ev, int events) override;
@@ -44,7 +49,68 @@ public:
 
 private:
     int _epfd = -1;
-    std::set<int> _listenfds;
+    bool _edge_triggered = false;
+    // epoll_event.data: 低32位fd，第32位标记监听fd，高31位为注册代数，防止fd复用后误派发
+    std::vector<uint32_t> _gens; // 以fd为下标
+};
+
+// 基于io_uring poll的就绪通知(只做readiness，不做completion式的accept/recv/send)，
+// 读方向用multishot poll，写方向用一次性poll，fd增删改只写入sq，和等待一起在一次io_uring_enter中提交
+// 内核不支持所需特性时init返回false，由reactor回退到epoller
+class uring_poller : public demultiplexer
+{
+public:
+    virtual ~uring_poller() override;
+    virtual bool init() override;
+    virtual int  add_event(event* ev, int events) override;
+    virtual void del_event(event* ev) override;
+    virtual void dispatch(reactor* base, int timeout/*ms*/ = 1000) override;
+    virtual void wakeup() override;
+
+private:
+    struct poll_slot
+    {
+        uint32_t in_gen = 0;      // 读poll每次重新注册递增，用来丢弃已取消poll残留的cqe
+        uint32_t out_gen = 0;     // 写poll只在注销fd时递增
+        uint32_t in_mask = 0;
+        bool in_armed = false;
+        bool out_armed = false;   // 一次性POLLOUT还在内核中
+        bool out_wanted = false;  // 当前是否关心可写
+        bool accept = false;
+    };
+    bool setup_rings();
+    bool probe_features();
+    io_uring_sqe* get_sqe();
+    int  flush_sqes();
+    void arm_poll(int fd, poll_slot& slot);
+    void arm_out_poll(int fd, poll_slot& slot);
+    void cancel_poll(uint64_t user_data);
+
+private:
+    int _ringfd = -1;
+    uint32_t _features = 0;
+
+    void*  _sq_ptr = nullptr;
+    size_t _sq_size = 0;
+    void*  _cq_ptr = nullptr;
+    size_t _cq_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqes_size = 0;
+
+    unsigned* _sq_head = nullptr;
+    unsigned* _sq_tail = nullptr;
+    unsigned* _sq_array = nullptr;
+    unsigned  _sq_mask = 0;
+    unsigned  _sq_entries = 0;
+    unsigned  _sq_local_tail = 0;
+    unsigned  _to_submit = 0;
+
+    unsigned* _cq_head = nullptr;
+    unsigned* _cq_tail = nullptr;
+    unsigned  _cq_mask = 0;
+    io_uring_cqe* _cqes = nullptr;
+
+    std::vector<poll_slot> _slots; // 以fd为下标
 };
 
 
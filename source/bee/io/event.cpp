@@ -1,3 +1,4 @@
+#include <cerrno>
 #include <cstdio>
 #include <unistd.h>
 #include <sys/eventfd.h>
@@ -24,9 +25,17 @@ void event::permit_read()
 
 void event::permit_write()
 {
-    if(is_close() || (_events & EVENT_SEND)) return;
+    if(mark_write())
+    {
+        _base->add_event(this);
+    }
+}
+
+bool event::mark_write()
+{
+    if(is_close() || (_events & EVENT_SEND)) return false;
     _events |= EVENT_SEND;
-    _base->add_event(this);
+    return true;
 }
 
 void event::forbid_read()
@@ -77,22 +86,6 @@ bool control_event::handle_event(int active_events)
     return true;
 }
 
-timer_event::timer_event(bool delay, TIMETYPE timeout, int repeats, callback handler, void* param)
-    : _delay(delay), _timeout(timeout), _repeats(repeats), _handler(handler), _param(param)
-{
-    set_events(EVENT_TIMER);
-}
-
-bool timer_event::handle_event(int active_events)
-{
-    if(_handler(_param))
-    {
-        if(_repeats > 0){ --_repeats; }
-        if(_repeats != 0) return true;
-    }
-    return false;
-}
-
 int sigio_event::_signal_pipe[2] = { -1, -1 };
 
 sigio_event::sigio_event()
@@ -113,13 +106,18 @@ bool sigio_event::handle_event(int active_events)
     local_log("sigio_event handle_event run.");
     if(!_base) return false;
     int signum;
-    if(read(_signal_pipe[0], &signum, sizeof(signum)) == -1)
+    while(true) // 管道里可能积压了多个信号
     {
-        perror("read");
-        return false;
+        if(read(_signal_pipe[0], &signum, sizeof(signum)) == -1)
+        {
+            if(errno == EINTR) continue;
+            if(errno == EAGAIN) break;
+            perror("read");
+            return false;
+        }
+        if(!_base->handle_signal_event(signum)) return false;
+        local_log("sigio_event handle_event run success, signum=%d.", signum);
     }
-    if(!_base->handle_signal_event(signum)) return false;
-    local_log("sigio_event handle_event run success, signum=%d.", signum);
     return true;
 }
 
@@ -48,6 +48,7 @@ struct event
 
     void permit_read();
     void permit_write();
+    bool mark_write(); // 只设置可写关注位，不提交给reactor，返回是否需要提交
     void forbid_read();
     void forbid_write();
 
@@ -65,18 +66,6 @@ struct control_event : event
     int _efd = -1;
 };
 
-struct timer_event : event
-{
-    using callback = std::function<bool(void*)>;
-    timer_event(bool delay, TIMETYPE timeout, int repeats, callback handler, void* param);
-    virtual bool handle_event(int active_events) override;
-    bool _delay;
-    TIMETYPE _timeout;
-    int _repeats;
-    callback _handler;
-    void* _param = nullptr;
-};
-
 struct sigio_event : event
 {
     using signal_handler = void(*)(int);
@@ -6,7 +6,10 @@
 #include <stdio.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
+#include <linux/filter.h>
+#include <climits>
 #include <cstring>
+#include <sys/uio.h>
 #include <openssl/err.h>
 
 #include "ioevent.h"
@@ -212,7 +215,7 @@ void netio_event::handle_close()
 {
     if(_ses && _ses->is_close())
     {
-        if(!_ses->is_writeos_empty())
+        if(!_ses->is_wqueue_empty())
         {
             _ses->permit_send(); // 断开连接前把数据发完
         }
@@ -229,42 +232,73 @@ void netio_event::close_socket(int reason) // 强制断开
     del_event();
 }
 
-passiveio_event::passiveio_event(session_manager* manager)
-    : netio_event(manager->create_session())
+int create_listen_socket(session_manager* manager)
+{
+    int listenfd = socket(manager->family(), manager->socktype(), 0);
+    if(listenfd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    int opt = 1;
+    if(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+       setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
+    {
+        perror("setsockopt");
+        close(listenfd);
+        exit(EXIT_FAILURE);
+    }
+    set_nonblocking(listenfd);
+
+    struct sockaddr* addr = manager->get_addr()->addr();
+    if(bind(listenfd, addr, manager->get_addr()->len()) < 0)
+    {
+        perror("bind");
+        close(listenfd);
+        local_log("bind failed, addr:%s.", manager->get_addr()->to_string().data());
+        return -1;
+    }
+    if(listen(listenfd, SOMAXCONN) < 0)
+    {
+        perror("listen");
+        close(listenfd);
+        local_log("listen failed, addr:%s.", manager->get_addr()->to_string().data());
+        return -1;
+    }
+    local_log("fd %d listen addr:%s.", listenfd, manager->get_addr()->to_string().data());
+    return listenfd;
+}
+
+bool attach_reuseport_cbpf(int listenfd, uint32_t shards, uint32_t cpu_offset)
+{
+    if(shards == 0) return false;
+    // A = (cpu + shards - cpu_offset % shards) % shards
+    struct sock_filter code[] =
+    {
+        { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_ADD | BPF_K,   0, 0, shards - cpu_offset % shards },
+        { BPF_ALU | BPF_MOD | BPF_K,   0, 0, shards },
+        { BPF_RET | BPF_A,             0, 0, 0 },
+    };
+    struct sock_fprog prog = { (unsigned short)(sizeof(code) / sizeof(code[0])), code };
+    if(setsockopt(listenfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    {
+        local_log("attach reuseport cbpf failed, fd=%d shards=%u: %s.", listenfd, shards, strerror(errno));
+        return false;
+    }
+    local_log("attach reuseport cbpf, fd=%d shards=%u cpu_offset=%u.", listenfd, shards, cpu_offset);
+    return true;
+}
+
+passiveio_event::passiveio_event(session_manager* manager, bool sharded)
+    : netio_event(manager->create_session()), _sharded(sharded)
 {
     set_events(EVENT_ACCEPT);
     int socktype = _ses->get_manager()->socktype();
     
     if(socktype == SOCK_STREAM)
     {
-        int family = manager->family();
-        int listenfd = socket(family, socktype, 0);
-        int opt = 1;
-        if(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
-        {
-            perror("setsockopt");
-            close(listenfd);
-            exit(EXIT_FAILURE);
-        }    
-        set_nonblocking(listenfd);
-
-        struct sockaddr* addr = manager->get_addr()->addr();
-        if(bind(listenfd, addr, sizeof(*addr)) < 0)
-        {
-            perror("bind");
-            close(listenfd);
-            local_log("passiveio_event bind failed, addr:%s.", manager->get_addr()->to_string().data());
-            return;
-        }
-        if(listen(listenfd, 20) < 0)
-        {
-            perror("listen");
-            close(listenfd);
-            local_log("passiveio_event listen failed, addr:%s.", manager->get_addr()->to_string().data());
-            return;
-        }
-        _fd = listenfd;
-        local_log("fd %d listen addr:%s.", listenfd, manager->get_addr()->to_string().data());
+        _fd = create_listen_socket(manager);
     }
     else if(socktype == SOCK_DGRAM)
     {
@@ -277,29 +311,29 @@ bool passiveio_event::handle_event(int active_events)
     if(_base == nullptr) return false;
     if(active_events != EVENT_ACCEPT) return false;
 
-    struct sockaddr_storage sock_client;
-    socklen_t len = sizeof(sock_client);
-    int clientfd = accept(_fd, (struct sockaddr*)&sock_client, &len);
-    if(clientfd < 0)
+    // 一次把积压的连接都取出来，边缘触发下必须accept到EAGAIN为止
+    while(true)
     {
-        if(errno != EAGAIN && errno != EINTR)
+        struct sockaddr_storage sock_client;
+        socklen_t len = sizeof(sock_client);
+        int clientfd = accept4(_fd, (struct sockaddr*)&sock_client, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(clientfd < 0)
         {
-            local_log("accept: %s", strerror(errno));
-            return false;
+            if(errno == EINTR) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                local_log("accept: %s", strerror(errno));
+                return false;
+            }
+            return true;
         }
-        return true;
-    }
-    if(set_nonblocking(clientfd) < 0)
-    {
-        close(clientfd);
-        return false;
-    }
 
-    streamio_event* evt = new streamio_event(clientfd, _ses->dup());
-    evt->set_events(EVENT_RECV | EVENT_SEND);
-    _base->add_event(evt);
-    local_log("accept clientid=%d.", clientfd);
-    return true;
+        streamio_event* evt = new streamio_event(clientfd, _ses->dup());
+        evt->set_events(EVENT_RECV | EVENT_SEND);
+        reactor* base = _sharded ? _base : _base->next_sub_reactor(); // 非分片模式下主reactor只负责accept，连接的读写交给子reactor
+        base->add_event(evt);
+        local_log("accept clientid=%d reactor=%p.", clientfd, (void*)base);
+    }
 }
 
 activeio_event::activeio_event(session_manager* manager)
@@ -402,8 +436,19 @@ int streamio_event::handle_read()
         size_t free_space = rbuffer.free_space();
         if(free_space == 0)
         {
-            local_log("recv[fd=%d]: session %lu buffer is fulled on receiving", _fd, _ses->get_sid());
-            break;
+            _ses->on_recv(total_recv); // 先解码腾出空间，边缘触发下不读到EAGAIN就不会再有通知
+            free_space = rbuffer.free_space();
+        }
+        if(free_space == 0)
+        {
+            // 解码后还是满的，说明一个协议比缓冲区大；边缘触发下不读完就不会再有通知，扩容后继续读
+            if(!_ses->grow_rbuffer())
+            {
+                local_log("recv[fd=%d]: session %lu buffer is fulled on receiving, size=%zu", _fd, _ses->get_sid(), rbuffer.size());
+                close_socket(SESSION_CLOSE_REASON_ERROR);
+                break;
+            }
+            free_space = rbuffer.free_space();
         }
 
         char* recv_ptr = rbuffer.end();
@@ -440,26 +485,31 @@ int streamio_event::handle_read()
 
 int streamio_event::handle_write()
 {
-    octets* wbuffer = nullptr;
+    struct iovec iov[IOV_MAX];
+    int total_send = 0;
+    while(true)
     {
-        bee::rwlock::wrscoped sesl(_ses->_locker);
-        wbuffer = &_ses->wbuffer();
-        if(wbuffer->size() == 0)
+        int iovcnt = 0;
         {
-            _ses->forbid_send();
-            return 0;
+            bee::rwlock::wrscoped sesl(_ses->_locker);
+            iovcnt = _ses->_writeq.peek(iov, IOV_MAX);
+            if(iovcnt == 0)
+            {
+                _ses->forbid_send();
+                break;
+            }
         }
-    }
 
-    int total_send = 0;
-    while(true)
-    {
-        int len = send(_fd, wbuffer->data() + _ses->_write_offset, wbuffer->size() - _ses->_write_offset, MSG_NOSIGNAL);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t len = sendmsg(_fd, &msg, MSG_NOSIGNAL);
         if(len > 0)
         {
-            //local_log("send data:%s", std::string(wbuffer.peek(0), len).data());
             total_send += len;
-            _ses->_write_offset += len;
+            bee::rwlock::wrscoped sesl(_ses->_locker);
+            _ses->_writeq.consume(len);
         }
         else if(len == 0)
         {
@@ -471,22 +521,10 @@ int streamio_event::handle_write()
         {
             if(errno == EINTR) continue;
             if(errno == EAGAIN) break;
-            perror("send");
+            perror("sendmsg");
             close_socket(SESSION_CLOSE_REASON_ERROR);
             break;
         }
-
-        if(_ses->_write_offset == wbuffer->size())
-        {
-            _ses->clear_wbuffer();
-            bee::rwlock::wrscoped sesl(_ses->_locker);
-            wbuffer = &_ses->wbuffer();
-            if(wbuffer->size() == _ses->_write_offset)
-            {
-                _ses->forbid_send();
-                break;
-            }
-        }
     }
 
     _ses->on_send(total_send);
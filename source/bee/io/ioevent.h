@@ -60,8 +60,10 @@ struct netio_event : io_event
 
 struct passiveio_event : netio_event
 {
-    passiveio_event(session_manager* manager);
+    // sharded为true时每个reactor各自持有一个监听fd，accept到的连接留在当前reactor
+    passiveio_event(session_manager* manager, bool sharded = false);
     virtual bool handle_event(int active_events) override;
+    bool _sharded = false;
 };
 
 struct activeio_event : netio_event
@@ -77,4 +79,11 @@ struct streamio_event : netio_event
     virtual int handle_write() override;
 };
 
+// 创建非阻塞的监听socket，失败返回-1
+int create_listen_socket(session_manager* manager);
+
+// 给reuseport组挂载按cpu分流的cbpf程序，让连接落在处理SYN的cpu对应的监听fd上
+// 第i个监听fd对应的cpu为 i + cpu_offset
+bool attach_reuseport_cbpf(int listenfd, uint32_t shards, uint32_t cpu_offset);
+
 } // namespace bee
\ No newline at end of file
@@ -27,8 +27,8 @@ ostringstream& protocol::dump(ostringstream& out) const
 
 bool protocol::size_policy(PROTOCOLID type, size_t size)
 {
-    auto iter = get_map().find(type);
-    return iter != get_map().end() && size <= iter->second->maxsize();
+    protocol* stub = get_stub(type);
+    return stub && size <= stub->maxsize();
 }
 
 bool protocol::check_policy(PROTOCOLID type, size_t size, session_manager* manager)
@@ -1,8 +1,9 @@
 #pragma once
-#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "marshal.h"
+#include "objectpool.h"
 #include "runnable.h"
 #include "types.h"
 #include "format.h"
@@ -22,6 +23,11 @@ public:
     protocol(const protocol&) = default;
     virtual ~protocol() = default;
 
+    // 协议对象都是短生命周期的，内存走线程缓存池，解码线程分配、工作线程释放后会回到解码线程
+    static void* operator new(size_t size) { return thread_cached_pool::alloc(size); }
+    static void operator delete(void* ptr) { thread_cached_pool::free(ptr); }
+    FORCE_INLINE void recycle() { delete this; }
+
     void init_session(session* ses);
 
     virtual PROTOCOLID get_type() const = 0;
@@ -31,6 +37,8 @@ public:
     virtual void run() = 0;
     virtual ostringstream& dump(ostringstream& out) const;
     FORCE_INLINE virtual size_t thread_group_idx() const { return 0; }
+    // 串行执行的key，key相同的协议按收到的顺序逐个执行；默认按会话保序，返回0表示不需要保序
+    FORCE_INLINE virtual uint64_t serial_key() const { return _sid; }
     
     static bool size_policy(PROTOCOLID type, size_t size);
     static bool check_policy(PROTOCOLID type, size_t size, session_manager* manager);
@@ -39,19 +47,29 @@ public:
     static protocol* decode(octetsstream& os, session* ses);
 
 public:
-    FORCE_INLINE static auto& get_map()
+    // 协议号是连续的小整数，直接按协议号下标索引，注册只发生在静态初始化阶段
+    FORCE_INLINE static auto& get_stubs()
     {
-        static std::unordered_map<PROTOCOLID, protocol*> _stubs;
+        static std::vector<protocol*> _stubs;
         return _stubs;
     }
     FORCE_INLINE static bool register_protocol(PROTOCOLID type, protocol* prot)
     {
-        return get_map().emplace(type, prot).second;
+        auto& stubs = get_stubs();
+        if(type >= stubs.size()) stubs.resize(type + 1, nullptr);
+        if(stubs[type]) return false;
+        stubs[type] = prot;
+        return true;
+    }
+    FORCE_INLINE static protocol* get_stub(PROTOCOLID type)
+    {
+        auto& stubs = get_stubs();
+        return type < stubs.size() ? stubs[type] : nullptr;
     }
     FORCE_INLINE static protocol* get_protocol(PROTOCOLID type)
     {
-        auto iter = get_map().find(type);
-        return iter != get_map().end() ? iter->second->dup() : nullptr;
+        protocol* stub = get_stub(type);
+        return stub ? stub->dup() : nullptr;
     }
 
 public:
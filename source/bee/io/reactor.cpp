@@ -1,14 +1,17 @@
 #include "reactor.h"
 
+#include <algorithm>
 #include <map>
 #include <utility>
+#include <unistd.h>
 #include <sys/signal.h>
 
 #include "glog.h"
+#include "common.h"
 #include "event.h"
 #include "lock.h"
 #include "log.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 #include "timewheel.h"
 #include "demultiplexer.h"
 #include "threadpool.h"
@@ -18,17 +21,22 @@
 namespace bee
 {
 
+// 定时器id的高位是reactor序号，低位是时间轮里的id，删除时据此找到所属的时间轮
+static constexpr int REACTOR_TIMERID_SHIFT = TIMER_ID_BITS;
+static constexpr TIMERID REACTOR_TIMERID_MASK = (1LL << REACTOR_TIMERID_SHIFT) - 1;
+
 reactor* reactor::_instance = nullptr;
 bee::mutex reactor::_instance_mutex;
+thread_local reactor* reactor::_current = nullptr;
 
 reactor::~reactor()
 {
     stop();
 
     delete _dispatcher;
-    for(auto& [fd, evt]: _io_events)
+    for(auto* evt : _io_events)
     {
-        if(evt->is_close()) continue;
+        if(evt == nullptr || evt->is_close()) continue;
         delete evt;
     }
     for(auto& [signum, evt]: _signal_events)
@@ -36,11 +44,6 @@ reactor::~reactor()
         if(evt->is_close()) continue;
         delete evt;
     }
-    for(auto& [timeout, evt]: _timer_events)
-    {
-        if(evt->is_close()) continue;
-        delete evt;
-    }
     for(auto data : _sub_reactors)
     {
         if(data.th->joinable())
@@ -50,69 +53,125 @@ reactor::~reactor()
         delete data.th;
         delete data.impl;
     }
+    delete _balancer;
+    delete _timewheel;
 }
 
 void reactor::init()
 {
     auto cfg = config::get_instance();
-    if(cfg->get("reactor", "demultiplexer") == "epoller")
+    std::string name = cfg->get("reactor", "demultiplexer");
+    if(name == "uring")
     {
-        _dispatcher = new epoller();
+        auto* uring = new uring_poller();
+        if(uring->init())
+        {
+            _dispatcher = uring;
+        }
+        else
+        {
+            local_log("reactor io_uring is unavailable, fall back to epoller.");
+            delete uring;
+            name = "epoller";
+        }
+    }
+    if(name == "epoller")
+    {
+        _dispatcher = new epoller(cfg->get<bool>("reactor", "edge_triggered", false));
+        _dispatcher->init();
     }
     ASSERT(_dispatcher);
-    _dispatcher->init();
     _use_timer_thread = cfg->get<bool>("reactor", "use_timer_thread");
     if(!_use_timer_thread)
     {
         _timeout = cfg->get<int>("reactor", "timeout");
+        _timewheel = new timewheel;
+        _timewheel->init(cfg->get<TIMETYPE>("timer", "interval"), cfg->get<size_t>("timer", "poolsize"));
     }
 
-    set_signal(SIGPIPE, SIG_IGN);
-    add_event(new sigio_event());
     add_event(new control_event());
 
     if(is_main_reactor())
     {
-        size_t sub_reactor_count = cfg->get<size_t>("reactor", "sub_reactor_count", 0);
-        for(size_t idx = 0; idx < sub_reactor_count; ++idx)
+        // 信号管道是全局唯一的，只由主reactor处理
+        set_signal(SIGPIPE, SIG_IGN);
+        add_event(new sigio_event());
+        create_sub_reactors();
+    }
+}
+
+void reactor::create_sub_reactors()
+{
+    auto cfg = config::get_instance();
+    size_t sub_reactor_count = cfg->get<size_t>("reactor", "sub_reactor_count", 0);
+    if(sub_reactor_count == 0) return;
+
+    _sub_reactor_affinity = cfg->get<bool>("reactor", "sub_reactor_affinity", false);
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for(size_t idx = 0; idx < sub_reactor_count; ++idx)
+    {
+        sub_reactor data;
+        data.impl = new reactor;
+        data.impl->_index = idx + 1;
+        data.impl->init();
+        if(_sub_reactor_affinity && cpu_count > 0)
         {
-            sub_reactor data;
-            data.impl = new reactor;
-            data.impl->init();
-            data.th = new std::thread([impl = data.impl]()
-            {
-                impl->run();
-                impl->destroy();
-            });
+            data.cpu = (idx + 1) % cpu_count; // 0号cpu留给主reactor
         }
+        data.th = new std::thread([impl = data.impl, cpu = data.cpu]()
+        {
+            if(cpu >= 0) set_process_affinity(cpu);
+            local_log("sub reactor %p tid:%d cpu:%d.", (void*)impl, gettid(), cpu);
+            impl->run();
+            impl->destroy();
+        });
+        _sub_reactors.push_back(data);
+    }
+
+    std::string strategy = cfg->get("reactor", "load_balance", std::string("round_robin"));
+    if(strategy == "random")
+    {
+        _strategy = RANDOM;
+    }
+    else if(strategy == "least_connections")
+    {
+        _strategy = LEAST_CONNECTIONS;
+    }
+    else
+    {
+        _strategy = ROUND_ROBIN;
     }
+    create_load_balancer();
+    _balancer->add_resources(_sub_reactors);
+    local_log("reactor create %zu sub reactors, load_balance=%s.", _sub_reactors.size(), strategy.data());
 }
 
 void reactor::run()
 {
     if(_dispatcher == nullptr) return;
-    _stop = false;
+    _current = this;
 
-    while(!_stop)
+    while(!_stop.load(std::memory_order_acquire))
     {
+        cached_clock::update(); // 刚处理完一轮事件，顺便刷新缓存时钟
         load_event();
-        int timeout = _timeout;
-        if(!use_timer_thread() && _timer_events.size())
-        {
-            TIMETYPE nowtime = systemtime::get_millseconds();
-            TIMETYPE diff = _timer_events.begin()->first - nowtime;
-            if(diff > _timeout) timeout = diff;
-            //local_log("reactor::run nexttime=%ld nowtime=%ld timeout=%d", _timer_events.begin()->first, nowtime, timeout);
-        }
-        _dispatcher->dispatch(this, timeout);
-        handle_timer_event();
+        _dispatcher->dispatch(this, update_timers());
     }
+    _current = nullptr;
 }
 
 void reactor::stop()
 {
-    _stop = true;
+    if(is_main_reactor())
+    {
+        cached_clock::stop(); // 之后的读取退回到直接读系统时钟
+    }
+    _stop.store(true, std::memory_order_release);
     wakeup();
+    for(auto& data : _sub_reactors)
+    {
+        data.impl->stop();
+    }
 }
 
 void reactor::wakeup()
@@ -131,6 +190,13 @@ void reactor::add_event(event* ev, bool dispatch)
     wakeup();
 }
 
+void reactor::add_events(const std::vector<event*>& evs)
+{
+    if(evs.empty()) return;
+    _changelist.write(evs.begin(), evs.end());
+    wakeup();
+}
+
 void reactor::del_event(event* ev)
 {
     ev->set_status(EVENT_STATUS_DEL);
@@ -145,10 +211,70 @@ void reactor::add_signal(int signum, bool(*callback)(int))
     add_event(evt);
 }
 
-event* reactor::get_event(int fd)
+TIMERID reactor::add_timer(bool delay, TIMETYPE timeout, int repeats, std::function<bool(void*)> handler, void* param)
+{
+    if(_timewheel == nullptr) return -1;
+    TIMERID timerid = _timewheel->add_timer(delay, timeout, repeats, std::move(handler), param);
+    if(timerid < 0) return -1;
+    // 本线程添加的下一轮循环就会算进超时；其他线程添加时reactor可能正按空闲超时等待，要唤醒它
+    if(_current != this && _timer_idle.exchange(false))
+    {
+        wakeup();
+    }
+    return ((TIMERID)_index << REACTOR_TIMERID_SHIFT) | timerid;
+}
+
+bool reactor::del_timer(TIMERID timerid)
+{
+    if(_timewheel == nullptr || timerid < 0) return false;
+    return _timewheel->del_timer(timerid & REACTOR_TIMERID_MASK);
+}
+
+bool reactor::mod_timer(TIMERID timerid, TIMETYPE timeout)
+{
+    if(_timewheel == nullptr || timerid < 0) return false;
+    return _timewheel->mod_timer(timerid & REACTOR_TIMERID_MASK, timeout);
+}
+
+int reactor::update_timers()
+{
+    if(_timewheel == nullptr) return _timeout;
+    TIMETYPE wait = _timewheel->update(cached_clock::get_monotonic_millseconds());
+    if(wait < 0)
+    {
+        // 先标记空闲再确认一次，之后其他线程添加的定时器一定能看到标记并唤醒
+        _timer_idle.store(true);
+        if(_timewheel->empty()) return _timeout;
+        _timer_idle.store(false);
+        return 0;
+    }
+    return (_timeout >= 0 && _timeout < wait) ? _timeout : (int)wait;
+}
+
+reactor* reactor::next_sub_reactor()
 {
-    EVENTS_MAP::iterator itr = _io_events.find(fd);
-    return itr != _io_events.end() ? itr->second : nullptr;
+    if(_balancer == nullptr || _sub_reactors.empty()) return this;
+    return _balancer->get_nect().impl;
+}
+
+reactor* reactor::pick_io_reactor(size_t key)
+{
+    if(_sub_reactors.empty()) return this;
+    return _sub_reactors[key % _sub_reactors.size()].impl;
+}
+
+std::vector<reactor*> reactor::get_io_reactors()
+{
+    std::vector<reactor*> reactors;
+    for(const auto& data : _sub_reactors)
+    {
+        reactors.push_back(data.impl);
+    }
+    if(reactors.empty())
+    {
+        reactors.push_back(this);
+    }
+    return reactors;
 }
 
 auto& reactor::get_wakeup()
@@ -156,6 +282,13 @@ auto& reactor::get_wakeup()
     return _dispatcher->get_wakeup();
 }
 
+reactor* reactor::get_reactor(int index)
+{
+    if(index == 0) return this;
+    if(index < 0 || (size_t)index > _sub_reactors.size()) return nullptr;
+    return _sub_reactors[index - 1].impl;
+}
+
 reactor* reactor::get_instance()
 {
     if(_instance == nullptr)
@@ -193,12 +326,26 @@ int reactor::add_event_inner(event* ev)
     if(is_io_events(events))
     {
         int handle = ev->get_handle();
-        if(auto iter = _io_events.find(handle); iter != _io_events.end() && iter->second != ev)
+        if(handle < 0)
         {
-            delete iter->second;
-            local_log("new event %p substitute old event %p", (void*)ev, (void*)iter->second);
+            local_log("add_io_event invalid handle, event %p.", (void*)ev);
+            return -1;
         }
-        _io_events[handle] = ev;
+        if((size_t)handle >= _io_events.size())
+        {
+            _io_events.resize(std::max<size_t>(handle + 1, _io_events.size() * 2), nullptr);
+        }
+        event*& slot = _io_events[handle];
+        if(slot == nullptr)
+        {
+            _io_event_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if(slot != ev)
+        {
+            local_log("new event %p substitute old event %p", (void*)ev, (void*)slot);
+            delete slot;
+        }
+        slot = ev;
         if(int ret = _dispatcher->add_event(ev, events))
         {
             local_log("add_io_event error, ret=%d.", ret);
@@ -206,20 +353,6 @@ int reactor::add_event_inner(event* ev)
         }
         //TRACELOG("add_io_event handle=%d events=%d.", ev->get_handle(), events);
     }
-    else if(is_timer_events(events))
-    {
-        timer_event* tm = dynamic_cast<timer_event*>(ev);
-        if(tm == nullptr)
-        {
-            ERRORLOG("reactor add_event EVENT_TIMER is not timer_event.");
-            return -1;
-        }
-        TIMETYPE nowtime = systemtime::get_millseconds();
-        TIMETYPE expiretime = tm->_delay ? (nowtime + tm->_timeout) : nowtime;
-        tm->_delay = true;
-        _timer_events.insert(std::make_pair(expiretime, ev));
-        //local_log("add_timer_event nowtime=%ld delay=%d timeout=%ld expiretime=%ld.", nowtime, tm->_delay, tm->_timeout, expiretime);
-    }
     else if(is_signal_events(events))
     {
         _signal_events.emplace(ev->get_handle(), ev);
@@ -243,17 +376,14 @@ void reactor::del_event_inner(event* ev)
         _dispatcher->del_event(ev);
         
         int fd = ev->get_handle();
-        if(auto iter = _io_events.find(fd); iter != _io_events.end())
+        if((size_t)fd < _io_events.size() && _io_events[fd])
         {
-            delete iter->second;
-            _io_events.erase(iter);
+            delete _io_events[fd];
+            _io_events[fd] = nullptr;
+            _io_event_count.fetch_sub(1, std::memory_order_relaxed);
         }
         local_log("reactor del_event fd=%d.", fd);
     }
-    else if(is_timer_events(ev->get_events()))
-    {
-        local_log("reactor timer_event %p will be deleted timer when actually run instead of immediately.", ev);
-    }
     else if(is_signal_events(ev->get_events()))
     {
         _signal_events.erase(ev->get_handle());
@@ -271,55 +401,38 @@ bool reactor::handle_signal_event(int signum)
     return true;
 }
 
-void reactor::handle_timer_event()
-{
-    if(use_timer_thread()) return;
-    TIMETYPE nowtime = systemtime::get_millseconds();
-    while(_timer_events.size())
-    {
-        //local_log("handle_timer_event expiretime=%ld nowtime=%ld end", iter->first, nowtime);
-        auto [expiretime, ev] = *(_timer_events.begin());
-        _timer_events.erase(_timer_events.begin());
-        timer_event* tm = static_cast<timer_event*>(ev);
-        if(expiretime <= nowtime) break;
-
-        if(tm->get_status() == EVENT_STATUS_DEL)
-        {
-            delete tm;
-            local_log("handle_timer_event delete timer event.");
-            continue;
-        }
-        if(tm->handle_event(EVENT_TIMER))
-        {
-            add_event(tm);
-        }
-    }
-}
-
 void reactor::create_load_balancer()
 {
-    load_balance_strategy<sub_reactor>* strategy = nullptr;
+    // 模板类型的short_type_name无法和工厂id匹配，这里直接构造策略
+    std::unique_ptr<load_balance_strategy<sub_reactor>> strategy;
     switch(_strategy)
     {
         case LOAD_BALANCE_STRATEGY::ROUND_ROBIN:
         {
-            strategy = load_balance_strategy_factory<sub_reactor>::create("round_robin_strategy<sub_reactor>");
-        }
+            strategy = std::make_unique<round_robin_strategy<sub_reactor>>();
+        } break;
         case LOAD_BALANCE_STRATEGY::RANDOM:
         {
-            strategy = load_balance_strategy_factory<sub_reactor>::create("random_strategy<sub_reactor>");
+            strategy = std::make_unique<random_strategy<sub_reactor>>();
         } break;
         case LOAD_BALANCE_STRATEGY::LEAST_CONNECTIONS:
         {
-            strategy = load_balance_strategy_factory<sub_reactor>::create("least_connection_strategy<sub_reactor>");
+            strategy = std::make_unique<least_connections_strategy<sub_reactor>>([](const sub_reactor& data)
+            {
+                return data.impl->io_event_count();
+            });
+        } break;
+        default:
+        {
+            strategy = std::make_unique<round_robin_strategy<sub_reactor>>();
         } break;
-        default: { break; }
     }
-    _balancer = new load_balancer<sub_reactor>(std::unique_ptr<load_balance_strategy<sub_reactor>>(strategy));
+    _balancer = new load_balancer<sub_reactor>(std::move(strategy));
 }
 
 std::thread start_threadpool_and_timer()
 {
+    cached_clock::start(config::get_instance()->get<TIMETYPE>("clock", "resolution", 1));
     threadpool::get_instance()->start();
     if(reactor::get_instance()->use_timer_thread())
     {
@@ -344,30 +457,47 @@ TIMERID add_timer(bool delay, TIMETYPE timeout, int repeats, std::function<bool(
 }
 
 TIMERID add_timer(bool delay, TIMETYPE timeout, int repeats, std::function<bool(void*)> handler, void* param)
+{
+    return add_timer(nullptr, delay, timeout, repeats, std::move(handler), param);
+}
+
+TIMERID add_timer(reactor* base, TIMETYPE timeout, std::function<bool()> handler)
+{
+    return add_timer(base, true, timeout, -1, [handler](void*){ return handler(); }, nullptr);
+}
+
+TIMERID add_timer(reactor* base, bool delay, TIMETYPE timeout, int repeats, std::function<bool(void*)> handler, void* param)
 {
     if(reactor::get_instance()->use_timer_thread())
     {
         return timewheel::get_instance()->add_timer(delay, timeout, repeats, handler, param);
     }
-    else
-    {
-        auto* tm = new timer_event(delay, timeout, repeats, handler, param);
-        reactor::get_instance()->add_event(tm);
-        return reinterpret_cast<TIMERID>(tm);
-    }
+    // 在reactor线程上添加的定时器留在这个reactor，其他线程的交给主reactor
+    if(base == nullptr) base = reactor::current();
+    if(base == nullptr) base = reactor::get_instance();
+    return base->add_timer(delay, timeout, repeats, std::move(handler), param);
 }
 
-void del_timer(TIMERID timerid)
+bool del_timer(TIMERID timerid)
 {
     if(reactor::get_instance()->use_timer_thread())
     {
-        timewheel::get_instance()->del_timer(timerid);
+        return timewheel::get_instance()->del_timer(timerid);
     }
-    else
+    if(timerid < 0) return false;
+    reactor* base = reactor::get_instance()->get_reactor(timerid >> REACTOR_TIMERID_SHIFT);
+    return base ? base->del_timer(timerid) : false;
+}
+
+bool mod_timer(TIMERID timerid, TIMETYPE timeout)
+{
+    if(reactor::get_instance()->use_timer_thread())
     {
-        if(timerid <= 0) return;
-        reactor::get_instance()->del_event(reinterpret_cast<event*>(timerid));
+        return timewheel::get_instance()->mod_timer(timerid, timeout);
     }
+    if(timerid < 0) return false;
+    reactor* base = reactor::get_instance()->get_reactor(timerid >> REACTOR_TIMERID_SHIFT);
+    return base ? base->mod_timer(timerid, timeout) : false;
 }
 
 } // namespace bee
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
+#include <atomic>
 #include <map>
 #include <set>
 #include <functional>
 #include <thread>
+#include <vector>
 
 #include "double_buffer.h"
 #include "event.h"
@@ -15,13 +17,14 @@ namespace bee
 {
 
 class demultiplexer;
+class timewheel;
 struct event;
 
 class reactor : public static_runnable
 {
 public:
     using EVENTS_MAP = std::map<int, event*>;
-    using TIMEREVENT_MAP = std::multimap<TIMETYPE, event*>;
+    using EVENTS_TABLE = std::vector<event*>; // 以fd为下标
 
     ~reactor();
     void init();
@@ -29,26 +32,42 @@ public:
     void stop();
     void wakeup();
     void add_event(event* ev, bool dispatch = false);
+    void add_events(const std::vector<event*>& evs); // 批量提交，只唤醒一次
     void del_event(event* ev);
 
     void add_signal(int signum, bool(*callback)(int));
 
-    event* get_event(int fd);
+    // 定时器放在这个reactor自己的时间轮里，在它的线程上到期执行，任意线程都可以添加和删除
+    TIMERID add_timer(bool delay, TIMETYPE timeout/*ms*/, int repeats, std::function<bool(void*)> handler, void* param);
+    bool del_timer(TIMERID timerid);
+    bool mod_timer(TIMERID timerid, TIMETYPE timeout/*ms*/);
+
+    FORCE_INLINE event* get_event(int fd) const
+    {
+        return (size_t)fd < _io_events.size() ? _io_events[fd] : nullptr;
+    }
     auto& get_wakeup();
     static reactor* get_instance();
+    FORCE_INLINE static reactor* current() { return _current; } // 当前线程运行的reactor，不在reactor线程上时为nullptr
+    reactor* get_reactor(int index); // 0是主reactor，子reactor从1开始
     FORCE_INLINE demultiplexer* get_dispatcher() const { return _dispatcher; }
     FORCE_INLINE bool use_timer_thread() const { return _use_timer_thread; }
     FORCE_INLINE bool is_main_reactor() const { return this == get_instance(); }
+    FORCE_INLINE size_t io_event_count() const { return _io_event_count.load(std::memory_order_relaxed); }
+
+    // 主reactor接收的新连接交给子reactor处理，没有子reactor时返回自身
+    reactor* next_sub_reactor();
+    // 按key固定选一个处理连接读写的reactor，任意线程都可以调用，用来放置不想占用主reactor的定时器
+    reactor* pick_io_reactor(size_t key);
+    // 处理连接读写的reactor，有子reactor时为全部子reactor，否则为自身
+    std::vector<reactor*> get_io_reactors();
+    FORCE_INLINE bool sub_reactor_affinity() const { return _sub_reactor_affinity; }
 
     FORCE_INLINE bool is_io_events(int events)
     {
         return events & EVENT_ACCEPT || events & EVENT_RECV   || events & EVENT_SEND ||
                events & EVENT_HUP    || events & EVENT_WAKEUP;
     }
-    FORCE_INLINE bool is_timer_events(int events)
-    {
-        return events & EVENT_TIMER;
-    }
     FORCE_INLINE bool is_signal_events(int events)
     {
         return events & EVENT_SIGNAL;
@@ -61,37 +80,44 @@ private:
     void del_event_inner(event* ev);
 
     bool handle_signal_event(int signum);
-    void handle_timer_event();
+    int  update_timers(); // 执行到期的定时器，返回dispatch的超时
 
 private:
     struct sub_reactor
     {
         reactor* impl = nullptr;
         std::thread* th = nullptr;
+        int cpu = -1; // 绑定的cpu，-1表示不绑定
     };
+    void create_sub_reactors();
     void create_load_balancer();
 
 private:
     static reactor* _instance;
     static bee::mutex _instance_mutex;
+    static thread_local reactor* _current;
 
     // 主reactor才有的数据
     std::vector<sub_reactor> _sub_reactors;
     std::atomic<int> _next_index{0}; // 轮询索引;
     LOAD_BALANCE_STRATEGY _strategy = ROUND_ROBIN;
     load_balancer<sub_reactor>* _balancer = nullptr;
+    bool _sub_reactor_affinity = false;
 
-    bool _stop = true;
-    demultiplexer* _dispatcher;
+    std::atomic<size_t> _io_event_count{0}; // 供最少连接策略使用
+    std::atomic_bool _stop{false}; // 子reactor线程启动前就可能被stop，run()里不能重置
+    demultiplexer* _dispatcher = nullptr;
     bool _wakeup = true;
     bool _use_timer_thread = true;
     int  _timeout = -1; // ms
+    int  _index = 0;
+    timewheel* _timewheel = nullptr; // 不用定时器线程时才有
+    std::atomic<bool> _timer_idle{false}; // 时间轮为空，dispatch没有按tick超时
 
     bee::one_reader_double_buffer<event*, std::set> _changelist;
 
-    EVENTS_MAP _io_events;
+    EVENTS_TABLE _io_events;
     EVENTS_MAP _signal_events;
-    TIMEREVENT_MAP _timer_events;
 };
 
 std::thread start_threadpool_and_timer();
@@ -99,7 +125,11 @@ std::thread start_threadpool_and_timer();
 TIMERID add_timer(TIMETYPE timeout/*ms*/, std::function<bool()> handler);
 TIMERID add_timer(bool delay, TIMETYPE timeout/*ms*/, int repeats, std::function<bool()> handler);
 TIMERID add_timer(bool delay, TIMETYPE timeout/*ms*/, int repeats, std::function<bool(void*)> handler, void* param);
+// 指定定时器所在的reactor，base为空时同上：reactor线程上留在当前reactor，其他线程交给主reactor
+TIMERID add_timer(reactor* base, TIMETYPE timeout/*ms*/, std::function<bool()> handler);
+TIMERID add_timer(reactor* base, bool delay, TIMETYPE timeout/*ms*/, int repeats, std::function<bool(void*)> handler, void* param);
 
-void del_timer(TIMERID timerid);
+bool del_timer(TIMERID timerid);
+bool mod_timer(TIMERID timerid, TIMETYPE timeout/*ms*/); // 从现在开始重新计时，比删除后再添加便宜
 
 } // namespace bee
\ No newline at end of file
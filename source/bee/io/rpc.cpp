@@ -1,4 +1,7 @@
 #include "rpc.h"
+
+#include <atomic>
+
 #include "glog.h"
 #include "protocol.h"
 #include "reactor.h"
@@ -9,10 +12,11 @@ namespace bee
 
 bee::mutex rpc::_locker;
 std::map<TRACEID, rpc*> rpc::_rpcs;
+static std::atomic<TRACEID> _next_traceid = 0;
 
 rpc::rpc(rpc&& other)
     : protocol(std::move(other)),  _traceid(other._traceid), _proxy_traceid(other._proxy_traceid)
-    , _is_server(other._is_server)
+    , _is_server(other._is_server), _timerid(other._timerid)
 {
     _argument = other._argument;
     other._argument = nullptr;
@@ -28,6 +32,7 @@ rpc& rpc::operator=(const rpc& rhs)
         _traceid = rhs._traceid;
         _proxy_traceid = rhs._proxy_traceid;
         _is_server = rhs._is_server;
+        _timerid = rhs._timerid;
         if(_argument) delete _argument;
         if(_result) delete _result;
         _argument = rhs._argument ? rhs._argument->dup() : nullptr;
@@ -68,6 +73,7 @@ void rpc::run()
         }
         if(prpc)
         {
+            del_timer(prpc->_timerid); // 不删的话超时回调到期后还要空跑一次
             std::swap(prpc->_result, this->_result);
             if(prpc->_proxy_traceid > 0) // 是中转的rpc，开始回溯寻找调用方client
             {
@@ -81,7 +87,7 @@ void rpc::run()
             {
                 prpc->do_client();
             }
-            delete prpc;
+            prpc->recycle();
         }
     }
 }
@@ -170,17 +176,41 @@ void rpc::set_request(rpc* prpc, bool is_proxy)
         prpc->_proxy_traceid = prpc->_traceid; // 保留原来的traceid
     }
 
+    prpc->_traceid = ++_next_traceid;
+    prpc->_is_server = false; // 设置client身份
+
+    // 先设置超时定时器再登记，回应线程从_rpcs里拿到的rpc一定带着定时器id
+    TIMETYPE timeout = prpc->get_timeout();
+    prpc->_timerid = set_timeout_timer(prpc->_traceid, timeout > 0 ? timeout : 30);
+
+    bee::mutex::scoped l(_locker);
+    _rpcs.emplace(prpc->_traceid, prpc);
+}
+
+TRACEID rpc::publish(rpc* prpc)
+{
+    prpc->_traceid = ++_next_traceid;
+    prpc->_is_server = false;
+    prpc->_timerid = -1;
+
+    bee::mutex::scoped l(_locker);
+    _rpcs.emplace(prpc->_traceid, prpc);
+    return prpc->_traceid;
+}
+
+void rpc::arm_timeout(TRACEID traceid, int timeout)
+{
+    TIMERID timerid = set_timeout_timer(traceid, timeout > 0 ? timeout : 30);
     {
+        // 回应线程在锁内摘掉rpc，还在_rpcs里说明回应没到，定时器id由它负责删除
         bee::mutex::scoped l(_locker);
-        static TRACEID next_traceid = 0;
-        prpc->_traceid = ++next_traceid;
-        prpc->_is_server = false; // 设置client身份
-        _rpcs.emplace(prpc->_traceid, prpc);
+        if(auto iter = _rpcs.find(traceid); iter != _rpcs.end())
+        {
+            iter->second->_timerid = timerid;
+            return;
+        }
     }
-
-    // 设置超时定时器
-    TIMETYPE timeout = prpc->get_timeout();
-    set_timeout_timer(timeout > 0 ? timeout : 30, prpc->_traceid);
+    del_timer(timerid); // 回应已经处理完了
 }
 
 void rpc::clr_request(rpc* prpc, bool is_proxy)
@@ -194,9 +224,12 @@ void rpc::clr_request(rpc* prpc, bool is_proxy)
     }
 }
 
-void rpc::set_timeout_timer(TRACEID traceid, int timeout)
+TIMERID rpc::set_timeout_timer(TRACEID traceid, int timeout)
 {
-    add_timer(timeout * 1000, [traceid]()
+    // 工作线程上发起的rpc不在任何reactor上，按traceid分散到io reactor，不集中到主reactor
+    reactor* base = reactor::current();
+    if(base == nullptr) base = reactor::get_instance()->pick_io_reactor(traceid);
+    return add_timer(base, timeout * 1000, [traceid]()
     {
         rpc* prpc = nullptr;
         {
@@ -210,7 +243,7 @@ void rpc::set_timeout_timer(TRACEID traceid, int timeout)
         if(prpc)
         {
             prpc->do_timeout();
-            delete prpc;
+            prpc->recycle();
         }
         local_log("rpc timeout timer run.");
         return false;
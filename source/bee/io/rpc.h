@@ -27,6 +27,10 @@ public:
     static rpc* call(PROTOCOLID id, const rpcdata& argument);
     static rpc* call(rpc* prpc);
 
+    // 只登记不设置超时，调用方把请求发出去之后再调用arm_timeout，发送前prpc不会被超时回调释放
+    static TRACEID publish(rpc* prpc);
+    static void arm_timeout(TRACEID traceid, int timeout/*s*/);
+
     virtual bool server(rpcdata* argument, rpcdata* result) = 0; // 返回true表示继续投递
     virtual void client(rpcdata* argument, rpcdata* result) {}
     virtual void timeout(rpcdata* argument);
@@ -34,7 +38,7 @@ public:
 protected:
     static void set_request(rpc* prpc, bool is_proxy = false);
     static void clr_request(rpc* prpc, bool is_proxy = false);
-    static void set_timeout_timer(TRACEID traceid, int timeout);
+    static TIMERID set_timeout_timer(TRACEID traceid, int timeout/*s*/);
     bool do_server();
     void do_client();
     void do_timeout();
@@ -43,6 +47,7 @@ public:
     TRACEID _traceid = 0;
     TRACEID _proxy_traceid = 0; // 保留原来的traceid，方便回溯
     bool _is_server = false;
+    TIMERID _timerid = -1; // 超时定时器，回应到达时删除
     rpcdata* _argument = nullptr;
     rpcdata* _result = nullptr;
 
@@ -0,0 +1,108 @@
+#pragma once
+#include <concepts>
+#include <coroutine>
+#include <memory>
+#include <utility>
+
+#include "coroutine.h"
+#include "rpc.h"
+#include "session_manager.h"
+
+namespace bee
+{
+
+template<std::derived_from<rpc> RPC>
+struct rpc_result
+{
+    using result_type = typename RPC::result_type;
+
+    FORCE_INLINE explicit operator bool() const { return !timeout && result; }
+    FORCE_INLINE result_type* operator->() const { return result.get(); }
+
+    bool timeout = false;
+    std::unique_ptr<result_type> result;
+};
+
+/*
+ * co_await rpc_call<RPC>(argument, sender)，rpc回应或者超时后恢复协程，返回rpc_result
+ * 1.回应在哪个工作线程上处理，协程就在哪个线程上继续，不经过client_handler回调；
+ * 2.result的所有权直接从rpc对象转给调用方，不复制；
+ * 3.sender负责把请求发出去，比如[mgr](const protocol& prot){ mgr->send(prot); }。
+ */
+template<std::derived_from<rpc> RPC, typename SENDER>
+class rpc_awaitable
+{
+public:
+    using argument_type = typename RPC::argument_type;
+    using result_type = typename RPC::result_type;
+
+    rpc_awaitable(argument_type argument, SENDER sender)
+        : _argument(std::move(argument)), _sender(std::move(sender)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        _handle = handle;
+        auto* prpc = new resumer(this);
+        delete prpc->_argument;
+        prpc->_argument = _argument.dup();
+        delete prpc->_result;
+        prpc->_result = nullptr;
+
+        // 先发送再设置超时：回应只能在请求发出去之后到达，发送期间prpc不会被释放；
+        // 发出去之后协程可能已经在其他线程上恢复，之后只能用局部变量
+        SENDER sender = _sender;
+        int timeout = prpc->get_timeout();
+        TRACEID traceid = rpc::publish(prpc);
+        sender(static_cast<const protocol&>(*prpc));
+        rpc::arm_timeout(traceid, timeout);
+    }
+
+    rpc_result<RPC> await_resume() { return std::move(_result); }
+
+private:
+    class resumer : public RPC
+    {
+    public:
+        explicit resumer(rpc_awaitable* awaiter) : _awaiter(awaiter) {}
+
+        virtual void client(rpcdata* argument, rpcdata* result) override
+        {
+            _awaiter->_result.result.reset(static_cast<result_type*>(result));
+            this->_result = nullptr; // 已经转给调用方
+            _awaiter->_handle.resume();
+        }
+
+        virtual void timeout(rpcdata* argument) override
+        {
+            RPC::timeout(argument);
+            _awaiter->_result.timeout = true;
+            _awaiter->_handle.resume();
+        }
+
+    private:
+        rpc_awaitable* _awaiter = nullptr;
+    };
+
+    argument_type _argument;
+    SENDER _sender;
+    std::coroutine_handle<> _handle;
+    rpc_result<RPC> _result;
+};
+
+template<std::derived_from<rpc> RPC, typename SENDER>
+    requires std::invocable<SENDER&, const protocol&>
+FORCE_INLINE auto rpc_call(typename RPC::argument_type argument, SENDER sender)
+{
+    return rpc_awaitable<RPC, SENDER>(std::move(argument), std::move(sender));
+}
+
+// 通过session_manager发给指定会话
+template<std::derived_from<rpc> RPC>
+FORCE_INLINE auto rpc_call(typename RPC::argument_type argument, session_manager* manager, SID sid)
+{
+    return rpc_call<RPC>(std::move(argument), [manager, sid](const protocol& prot) { manager->send_protocol(sid, prot); });
+}
+
+} // namespace bee
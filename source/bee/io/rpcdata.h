@@ -1,6 +1,7 @@
 #pragma once
 #include "format.h"
 #include "marshal.h"
+#include "objectpool.h"
 
 namespace bee
 {
@@ -14,6 +15,10 @@ public:
     bool operator==(const rpcdata& rhs) { return true; }
     virtual ~rpcdata() = default;
 
+    // rpc解码时会dup参数和结果，和协议一样走线程缓存池
+    static void* operator new(size_t size) { return thread_cached_pool::alloc(size); }
+    static void operator delete(void* ptr) { thread_cached_pool::free(ptr); }
+
     virtual rpcdata* dup() const = 0;
     virtual ostringstream& dump(ostringstream& out) const;
 };
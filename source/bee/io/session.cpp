@@ -1,10 +1,13 @@
 #include "session.h"
 
+#include <algorithm>
+#include <atomic>
+
 #include "address.h"
 #include "ioevent.h"
 #include "protocol.h"
 #include "reactor.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 #include "session_manager.h"
 #ifdef _REENTRANT   
 #include "threadpool.h"
@@ -21,11 +24,6 @@ session::session(session_manager* manager)
     _peer = _manager->get_addr()->dup();
 
     _reados.reserve(_manager->_read_buffer_size);
-    _readbuf.reserve(_manager->_read_buffer_size);
-
-    _write_offset = 0;
-    _writeos.reserve(_manager->_write_buffer_size);
-    _writebuf.reserve(_manager->_write_buffer_size);
 
     activate();
 }
@@ -48,12 +46,9 @@ void session::clear()
 
     _event = nullptr;
 
-    _readbuf.clear();
     _reados.clear();
 
-    _write_offset = 0;
-    _writeos.clear();
-    _writebuf.clear();
+    _writeq.clear();
 }
 
 session* session::dup()
@@ -69,6 +64,7 @@ session* session::dup()
 void session::set_open()
 {
     set_state(SESSION_STATE_ACTIVE);
+    activate(); // dup出来的会话活跃时间被clear清零了，加入空闲时间轮前要重新计时
     _manager->add_session(_sid, this);
 }
 
@@ -87,28 +83,27 @@ void session::close()
 void session::on_recv(size_t len)
 {
     activate();
-    // local_log("session::on_recv len=%zu, _readbuf size:%zu _reados size:%zu.", len, _readbuf.size(), _reados.size());
+    // local_log("session::on_recv len=%zu, _reados size:%zu pos:%zu.", len, _reados.size(), _reados.get_pos());
     set_state(SESSION_STATE_RECVING);
 
-    size_t append_length = std::min(_readbuf.size(), _reados.data().free_space());
-    _reados.data().append(_readbuf, append_length);
-    _readbuf.erase(0, append_length);
-    // local_log("on_recv append size:%zu, _readbuf size:%zu _reados size:%zu.", append_length, _readbuf.size(), _reados.size());
-
+    _reados.enable_views(); // 协议的octets_view字段直接引用接收缓冲区
     while(protocol* prot = protocol::decode(_reados, this))
     {
     #ifdef _REENTRANT
-        threadpool::get_instance()->add_task(prot->thread_group_idx(), [prot]()
+        if(uint64_t key = prot->serial_key())
         {
-            prot->run();
-            delete prot;
-        });
+            threadpool::get_instance()->add_serial_task(prot->thread_group_idx(), key, prot); // 执行完由destroy()回收
+        }
+        else
+        {
+            threadpool::get_instance()->add_task(prot->thread_group_idx(), prot);
+        }
     #else
         prot->run();
-        delete prot;
+        prot->recycle();
     #endif
     }
-    _reados.try_shrink();
+    _reados.reclaim();
 }
 
 void session::on_send(size_t len)
@@ -166,38 +161,45 @@ size_t session::max_wbuf_size() const
 
 octets& session::rbuffer()
 {
-    return _readbuf;
+    return _reados.data();
 }
 
-octets& session::wbuffer()
+bool session::grow_rbuffer()
 {
-    if(_writebuf.empty())
-    {
-        _writebuf.swap(_writeos.data());
-        _writeos.clear();
-    }
-    return _writebuf;
+    // 每次翻倍，最多到read_buffer_size的16倍，协议处理完之后容量保留
+    static constexpr size_t RBUF_GROW_LIMIT = 16;
+    size_t capacity = _reados.data().capacity();
+    size_t limit = max_rbuf_size() * RBUF_GROW_LIMIT;
+    if(capacity >= limit) return false;
+    _reados.reserve(std::min(std::max(capacity * 2, max_rbuf_size()), limit));
+    return true;
 }
 
-void session::clear_wbuffer()
+bool session::is_wqueue_empty()
 {
-    _writebuf.clear();
-    _write_offset = 0;
+    bee::rwlock::rdscoped l(_locker);
+    return _writeq.empty();
 }
 
-bool session::is_writeos_empty()
+bool session::is_wqueue_full() const
 {
-    return _write_offset == _writeos.size();
+    // 允许最后一个包超出上限，大包不会因为放不下而被丢弃
+    return _writeq.size() >= max_wbuf_size();
 }
 
 void session::activate()
 {
-    _last_active = systemtime::get_time();
+    std::atomic_ref<TIMETYPE>(_last_active).store(cached_clock::get_monotonic_seconds(), std::memory_order_relaxed);
 }
 
 bool session::is_timeout(TIMETYPE timeout) const
 {
-    return (systemtime::get_time() - _last_active) > timeout;
+    return (cached_clock::get_monotonic_seconds() - get_last_active()) > timeout;
+}
+
+TIMETYPE session::get_last_active() const
+{
+    return std::atomic_ref<TIMETYPE>(const_cast<TIMETYPE&>(_last_active)).load(std::memory_order_relaxed);
 }
 
 } // namespace bee
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "octets.h"
 #include "marshal.h"
 #include "types.h"
+#include "write_queue.h"
 
 namespace bee
 {
@@ -57,9 +58,9 @@ public:
     FORCE_INLINE size_t max_rbuf_size() const;
     FORCE_INLINE size_t max_wbuf_size() const;
     octets& rbuffer();
-    octets& wbuffer();
-    void clear_wbuffer();
-    bool is_writeos_empty();
+    bool grow_rbuffer(); // 接收缓冲区被一个不完整的协议占满时扩容，超过上限返回false
+    bool is_wqueue_empty();
+    bool is_wqueue_full() const; // 需要持有_locker，积压超过max_wbuf_size时不再接收新数据
 
     FORCE_INLINE void set_sid(SID sid) { _sid = sid; }
     FORCE_INLINE SID  get_sid() const { return _sid;}
@@ -74,8 +75,9 @@ public:
 
     FORCE_INLINE void set_event(event* ev) { _event = ev; }
 
-    void activate(); // 更新会话的最后活跃时间
+    void activate(); // 更新会话的最后活跃时间，不需要持有_locker
     bool is_timeout(TIMETYPE timeout) const; // 检查会话是否超时
+    TIMETYPE get_last_active() const;
 
 protected:
     virtual void close();
@@ -91,7 +93,7 @@ protected:
     int _sockfd = 0;
     SESSION_STATE _state = SESSION_STATE_NONE;
     SESSION_CLOSE_REASON _close_reason = SESSION_CLOSE_REASON_NONE;
-    TIMETYPE _last_active = 0; // 最后活跃时间
+    TIMETYPE _last_active = 0; // 最后活跃时间，缓存单调时钟的秒，用atomic_ref读写
 
     address* _peer = nullptr;
     session_manager* _manager;
@@ -99,12 +101,9 @@ protected:
     bee::rwlock _locker;
     event* _event = nullptr;
 
-    octetsstream _reados;
-    octets _readbuf;
+    octetsstream _reados; // 接收缓冲区，recv直接写到尾部，协议原地解码
 
-    size_t _write_offset = 0;
-    octetsstream _writeos;
-    octets _writebuf;
+    write_queue _writeq;
 };
 
 } // namespace bee
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include <openssl/ssl.h>
+#include <unistd.h>
+#include <atomic>
+#include <bit>
 #include "session_manager.h"
 #include "address.h"
 #include "glog.h"
@@ -11,6 +14,7 @@
 #include "config.h"
 #include "protocol.h"
 #include "session.h"
+#include "cached_clock.h"
 
 namespace bee
 {
@@ -22,10 +26,10 @@ session_manager::session_manager()
 session_manager::~session_manager()
 {
     delete _addr;
-    for(auto [sid, ses] : _sessions)
+    _sessions.for_each([](SID sid, session* ses)
     {
         delete ses;
-    }
+    });
     _sessions.clear();
 
     if(_ssl_ctx)
@@ -39,6 +43,8 @@ void session_manager::init()
 {
     auto cfg = config::get_instance();
     _config.max_connections = cfg->get<size_t>(identity(), "max_connections");
+    _config.sharded_listen = cfg->get<bool>(identity(), "sharded_listen", false);
+    _config.reuseport_cbpf = cfg->get<bool>(identity(), "reuseport_cbpf", false);
 
     std::string socktype = cfg->get(identity(), "socktype");
     if(socktype == "tcp")
@@ -77,7 +83,10 @@ void session_manager::init()
     _keepalive_timeout = cfg->get<short>(identity(), "keepalive_timeout");
     if(_keepalive_timeout > 0)
     {
-        add_timer(1000, [this](){ this->check_timeouts(); return true; });
+        _idle_buckets.resize(std::bit_ceil((size_t)_keepalive_timeout + 2));
+        _idle_cursor = cached_clock::get_monotonic_seconds();
+        // 放到io reactor上，不占用主reactor的accept循环
+        add_timer(reactor::get_instance()->pick_io_reactor((uintptr_t)this / sizeof(void*)), 1000, [this](){ this->check_timeouts(); return true; });
     }
 
     // ssl
@@ -100,18 +109,45 @@ void session_manager::set_addr(address* addr)
 
 void session_manager::check_timeouts()
 {
-    bee::rwlock::rdscoped l(_locker);
-    for(const auto& [sid, ses] : _sessions)
+    if(_idle_buckets.empty()) return;
+    TIMETYPE now = cached_clock::get_monotonic_seconds();
+    size_t mask = _idle_buckets.size() - 1;
+    std::vector<SID> sids;
+    for(; _idle_cursor <= now; ++_idle_cursor) // 定时器延迟时补上漏掉的秒
     {
-        bee::rwlock::wrscoped sesl(ses->_locker);
-        if(ses->is_timeout(_keepalive_timeout))
         {
-            ses->set_close(SESSION_CLOSE_REASON_TIMEOUT);
-            local_log("%s session %lu keepalive timeout, close connection.", identity(), sid);
+            bee::spinlock::scoped l(_idle_locker);
+            sids.swap(_idle_buckets[_idle_cursor & mask]);
+        }
+        for(SID sid : sids)
+        {
+            // 已经删除的会话找不到，直接丢掉
+            _sessions.apply(sid, [&](session* ses)
+            {
+                TIMETYPE deadline = ses->get_last_active() + _keepalive_timeout + 1;
+                if(deadline > now) // 期间活跃过，按新的时间放回去
+                {
+                    add_idle_session(sid, deadline);
+                    return;
+                }
+                bee::rwlock::wrscoped sesl(ses->_locker);
+                if(!ses->is_close())
+                {
+                    ses->set_close(SESSION_CLOSE_REASON_TIMEOUT);
+                    local_log("%s session %lu keepalive timeout, close connection.", identity(), sid);
+                }
+            });
         }
+        sids.clear();
     }
 }
 
+void session_manager::add_idle_session(SID sid, TIMETYPE deadline)
+{
+    bee::spinlock::scoped l(_idle_locker);
+    _idle_buckets[deadline & (_idle_buckets.size() - 1)].push_back(sid);
+}
+
 void session_manager::connect()
 {
     if(ssl_enabled())
@@ -126,13 +162,51 @@ void session_manager::connect()
 
 void session_manager::listen()
 {
-    if(ssl_enabled())
+    if(!_config.sharded_listen)
     {
-        reactor::get_instance()->add_event(new ssl_passiveio_event(this));
+        if(ssl_enabled())
+        {
+            reactor::get_instance()->add_event(new ssl_passiveio_event(this));
+        }
+        else
+        {
+            reactor::get_instance()->add_event(new passiveio_event(this));
+        }
+        return;
     }
-    else
+
+    // 按绑定顺序排列的监听fd就是reuseport组内的下标
+    auto reactors = reactor::get_instance()->get_io_reactors();
+    int firstfd = -1;
+    for(reactor* base : reactors)
+    {
+        netio_event* evt = nullptr;
+        if(ssl_enabled())
+        {
+            evt = new ssl_passiveio_event(this, true);
+        }
+        else
+        {
+            evt = new passiveio_event(this, true);
+        }
+        if(firstfd < 0) firstfd = evt->get_handle();
+        base->add_event(evt);
+    }
+    local_log("session_manager %s sharded listen on %zu reactors.", identity(), reactors.size());
+
+    // 子reactor i绑定在cpu i+1上，cpu不够时绑定会回绕，cpu和监听fd就对不上了，这时交给内核按哈希分发
+    if(_config.reuseport_cbpf && reactors.size() > 1)
     {
-        reactor::get_instance()->add_event(new passiveio_event(this));
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        if(reactor::get_instance()->sub_reactor_affinity() && cpu_count > 0 && reactors.size() <= (size_t)cpu_count - 1)
+        {
+            attach_reuseport_cbpf(firstfd, reactors.size(), 1);
+        }
+        else
+        {
+            local_log("session_manager %s skip reuseport cbpf, sub reactors are not pinned one per cpu, shards=%zu cpus=%ld.",
+                identity(), reactors.size(), cpu_count);
+        }
     }
 }
 
@@ -148,7 +222,7 @@ void session_manager::on_del_session(SID sid)
 
 void session_manager::reconnect()
 {
-    add_timer(5000, [this]()
+    add_timer(reactor::get_instance()->pick_io_reactor((uintptr_t)this / sizeof(void*)), 5000, [this]()
     {
         connect();
         local_log("session_manager %s, try reconnect.", identity());
@@ -165,35 +239,33 @@ session* session_manager::create_session()
 
 SID session_manager::get_next_sessionid()
 {
-    bee::rwlock::wrscoped l(_locker);
-    return ++_next_sessionid;
+    return _next_sessionid.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
 void session_manager::add_session(SID sid, session* ses)
 {
-    bee::rwlock::wrscoped l(_locker);
     add_session_nolock(sid, ses);
 }
 
 void session_manager::del_session(SID sid)
 {
-    bee::rwlock::wrscoped l(_locker);
     del_session_nolock(sid);
 }
 
 session* session_manager::find_session(SID sid)
 {
-    bee::rwlock::rdscoped l(_locker);
     return find_session_nolock(sid);
 }
 
 void session_manager::add_session_nolock(SID sid, session* ses)
 {
     if(!ses) return;
-    // assert(_sessions.bucket_count() > 0 && "sessions map is not initialized");
-    local_log("Bucket count before add: %zu", _sessions.bucket_count());
-    if(_sessions.emplace(sid, ses).second)
+    if(_sessions.emplace(sid, ses))
     {
+        if(!_idle_buckets.empty())
+        {
+            add_idle_session(sid, ses->get_last_active() + _keepalive_timeout + 1);
+        }
         on_add_session(sid);
         local_log("session_manager add_session %lu.", sid);
     }
@@ -206,9 +278,8 @@ void session_manager::add_session_nolock(SID sid, session* ses)
 
 void session_manager::del_session_nolock(SID sid)
 {
-    if(auto iter = _sessions.find(sid); iter != _sessions.end())
+    if(_sessions.erase(sid))
     {
-        _sessions.erase(iter);
         local_log("session_manager del_session %lu.", sid);
     }
     on_del_session(sid); // 无论连接有没有建立成功，都调一下吧
@@ -216,14 +287,13 @@ void session_manager::del_session_nolock(SID sid)
 
 session* session_manager::find_session_nolock(SID sid)
 {
-    auto iter = _sessions.find(sid);
-    return iter != _sessions.end() ? iter->second : nullptr;
+    return _sessions.get(sid, nullptr);
 }
     
 void session_manager::send_protocol(SID sid, const protocol& prot)
 {
-    bee::rwlock::rdscoped l(_locker);
-    if(session* ses = find_session_nolock(sid))
+    // 持有分片读锁期间会话不会被删除
+    bool found = _sessions.apply(sid, [&](session* ses)
     {
         if(ses->is_close())
         {
@@ -236,16 +306,16 @@ void session_manager::send_protocol(SID sid, const protocol& prot)
         prot.encode(os);
 
         bee::rwlock::wrscoped sesl(ses->_locker);
-        if(os.size() > ses->_writeos.data().free_space())
+        if(ses->is_wqueue_full())
         {
-            local_log("session_manager %s, session %lu write buffer is fulled.", identity(), sid);
+            local_log("session_manager %s, session %lu write queue is fulled.", identity(), sid);
             return;
         }
 
-        ses->_writeos.data().append(os.data(), os.size());
+        ses->_writeq.append(std::move(os.data())); // 大包和池里的缓冲区交换，编码缓冲区不会每次重新分配
         ses->permit_send();
-    }
-    else
+    });
+    if(!found)
     {
         local_log("session_manager %s cant find session %lu on sending protocol", identity(), sid);
     }
@@ -253,8 +323,7 @@ void session_manager::send_protocol(SID sid, const protocol& prot)
 
 void session_manager::send_octets(SID sid, const octets& oct)
 {
-    bee::rwlock::rdscoped l(_locker);
-    if(session* ses = find_session_nolock(sid))
+    bool found = _sessions.apply(sid, [&](session* ses)
     {
         if(ses->is_close())
         {
@@ -263,21 +332,102 @@ void session_manager::send_octets(SID sid, const octets& oct)
         }
 
         bee::rwlock::wrscoped sesl(ses->_locker);
-        if(oct.size() > ses->_writeos.data().free_space())
+        if(ses->is_wqueue_full())
         {
-            local_log("session_manager %s, session %lu write buffer is fulled.", identity(), sid);
+            local_log("session_manager %s, session %lu write queue is fulled.", identity(), sid);
             return;
         }
 
-        ses->_writeos.data().append(oct.data(), oct.size());
+        ses->_writeq.append(oct.data(), oct.size());
         ses->permit_send();
-    }
-    else
+    });
+    if(!found)
     {
         local_log("session_manager %s cant find session %lu on sending protocol", identity(), sid);
     }
 }
 
+shared_octets session_manager::encode_shared(const protocol& prot)
+{
+    octetsstream os;
+    prot.encode(os);
+    return std::make_shared<const octets>(std::move(os.data()));
+}
+
+void session_manager::broadcast(const protocol& prot)
+{
+    shared_octets data = encode_shared(prot);
+    BROADCAST_GROUPS groups;
+    _sessions.for_each([&](SID sid, session* ses)
+    {
+        broadcast_session_nolock(ses, data, groups);
+    });
+    commit_broadcast(groups);
+}
+
+void session_manager::broadcast(const protocol& prot, const std::vector<SID>& sids)
+{
+    shared_octets data = encode_shared(prot);
+    BROADCAST_GROUPS groups;
+    for(SID sid : sids)
+    {
+        _sessions.apply(sid, [&](session* ses)
+        {
+            broadcast_session_nolock(ses, data, groups);
+        });
+    }
+    commit_broadcast(groups);
+}
+
+void session_manager::broadcast(const protocol& prot, const std::function<bool(session*)>& filter)
+{
+    shared_octets data = encode_shared(prot);
+    BROADCAST_GROUPS groups;
+    _sessions.for_each([&](SID sid, session* ses)
+    {
+        if(filter(ses))
+        {
+            broadcast_session_nolock(ses, data, groups);
+        }
+    });
+    commit_broadcast(groups);
+}
+
+void session_manager::broadcast_session_nolock(session* ses, const shared_octets& data, BROADCAST_GROUPS& groups)
+{
+    if(ses->is_close()) return;
+
+    bee::rwlock::wrscoped sesl(ses->_locker);
+    if(ses->is_wqueue_full())
+    {
+        local_log("session_manager %s, session %lu write queue is fulled on broadcasting.", identity(), ses->get_sid());
+        return;
+    }
+    ses->_writeq.append(data);
+
+    // 事件还没被reactor接管时，注册时会带上可写关注
+    event* ev = ses->_event;
+    if(ev == nullptr || !ev->mark_write() || ev->_base == nullptr) return;
+
+    for(auto& [base, evs] : groups)
+    {
+        if(base == ev->_base)
+        {
+            evs.push_back(ev);
+            return;
+        }
+    }
+    groups.emplace_back(ev->_base, std::vector<event*>{ev});
+}
+
+void session_manager::commit_broadcast(BROADCAST_GROUPS& groups)
+{
+    for(auto& [base, evs] : groups)
+    {
+        base->add_events(evs);
+    }
+}
+
 bool session_manager::init_ssl(bool is_server)
 {
     auto cfg = config::get_instance();
@@ -1,12 +1,17 @@
 #pragma once
 #include <stddef.h>
+#include <atomic>
 #include <bitset>
+#include <functional>
 #include <unordered_map>
+#include <vector>
 #include <openssl/types.h>
 
 #include "lock.h"
+#include "sharded_unordered_map.h"
 #include "types.h"
 #include "prot_define.h"
+#include "write_queue.h"
 
 namespace bee
 {
@@ -15,6 +20,8 @@ class session;
 class address;
 class protocol;
 class octets;
+class reactor;
+struct event;
 
 enum SESSION_TYPE
 {
@@ -39,7 +46,7 @@ public:
 
     FORCE_INLINE bool check_connection_count() { return _config.max_connections ? _sessions.size() < _config.max_connections : true; }
     FORCE_INLINE bool check_protocol(PROTOCOLID type) { return !_config.forbidden_protocols.test(type); }
-    void check_timeouts();
+    void check_timeouts(); // 每秒由定时器调用，只检查本秒到期的桶
 
     virtual void connect(); // as client
     virtual void listen();  // as server
@@ -53,6 +60,7 @@ public:
     void del_session(SID sid);
     virtual session* find_session(SID sid);
 
+    // 会话表自身分片加锁，_nolock版本只是不再要求调用者持有_locker
     void add_session_nolock(SID sid, session* ses);
     void del_session_nolock(SID sid);
     session* find_session_nolock(SID sid);
@@ -60,17 +68,32 @@ public:
     void send_protocol(SID sid, const protocol& prot);
     void send_octets(SID sid, const octets& oct);
 
+    // 广播：协议只编码一次，各会话的发送队列共享同一份数据，同一个reactor上的会话只唤醒一次
+    void broadcast(const protocol& prot);
+    void broadcast(const protocol& prot, const std::vector<SID>& sids);
+    void broadcast(const protocol& prot, const std::function<bool(session*)>& filter);
+    static shared_octets encode_shared(const protocol& prot);
+
     // ssl
     bool init_ssl(bool is_server);
     FORCE_INLINE bool ssl_enabled() const { return _ssl_ctx != nullptr; }
     FORCE_INLINE SSL_CTX* get_ssl_ctx() const { return _ssl_ctx; }
 
+protected:
+    using BROADCAST_GROUPS = std::vector<std::pair<reactor*, std::vector<event*>>>;
+    void broadcast_session_nolock(session* ses, const shared_octets& data, BROADCAST_GROUPS& groups);
+    static void commit_broadcast(BROADCAST_GROUPS& groups);
+
+    void add_idle_session(SID sid, TIMETYPE deadline);
+
 protected:
     friend class session;
     struct
     {
         size_t max_connections = 0;
         std::bitset<MAXPROTOCOLID + 1> forbidden_protocols;
+        bool sharded_listen = false; // 每个io reactor各自监听，由内核在监听fd之间分发连接
+        bool reuseport_cbpf = false; // 分片监听时按cpu分流
     } _config;
 
     char _session_type = SESSION_TYPE_NONE;
@@ -82,9 +105,15 @@ protected:
     size_t _write_buffer_size = 0;
     short  _keepalive_timeout = 0; // 会话保活超时时间
 
-    bee::rwlock _locker;
-    SID _next_sessionid = 0;
-    std::unordered_map<SID, session*> _sessions;
+    // 空闲超时时间轮：会话按预计超时的秒放进对应的桶，activate只更新时间戳不挪桶，
+    // 检查到还没超时的会话再按新的最后活跃时间放回去，每个会话一个超时周期最多被检查一次
+    bee::spinlock _idle_locker;
+    std::vector<std::vector<SID>> _idle_buckets; // 大小是2的幂，大于_keepalive_timeout+1
+    TIMETYPE _idle_cursor = 0; // 下一个要检查的秒，只有定时器线程访问
+
+    bee::rwlock _locker; // 派生类自身数据的锁，会话表不再使用
+    std::atomic<SID> _next_sessionid{0};
+    sharded_unordered_map<SID, session*> _sessions;
 
     // ssl
     bool _ssl_server = false;
@@ -1,4 +1,5 @@
 #include "sslio_event.h"
+#include <sys/uio.h>
 #include "address.h"
 #include "glog.h"
 #include "ioevent.h"
@@ -10,40 +11,15 @@
 namespace bee
 {
 
-ssl_passiveio_event::ssl_passiveio_event(session_manager* manager)
-    : netio_event(manager->create_session())
+ssl_passiveio_event::ssl_passiveio_event(session_manager* manager, bool sharded)
+    : netio_event(manager->create_session()), _sharded(sharded)
 {
     set_events(EVENT_ACCEPT);
     int socktype = _ses->get_manager()->socktype();
     
     if(socktype == SOCK_STREAM)
     {
-        int family = manager->family();
-        int listenfd = socket(family, socktype, 0);
-        int opt = 1;
-        if(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
-        {
-            perror("setsockopt");
-            close(listenfd);
-            exit(EXIT_FAILURE);
-        }    
-        set_nonblocking(listenfd);
-
-        struct sockaddr* addr = manager->get_addr()->addr();
-        if(bind(listenfd, addr, sizeof(*addr)) < 0)
-        {
-            perror("bind");
-            close(listenfd);
-            return;
-        }
-        if(listen(listenfd, 20) < 0)
-        {
-            perror("listen");
-            close(listenfd);
-            return;
-        }
-        _fd = listenfd;
-        local_log("fd %d listen addr:%s.", listenfd, manager->get_addr()->to_string().data());
+        _fd = create_listen_socket(manager);
     }
 }
 
@@ -52,29 +28,29 @@ bool ssl_passiveio_event::handle_event(int active_events)
     if(_base == nullptr) return false;
     if(active_events != EVENT_ACCEPT) return false;
 
-    struct sockaddr_storage sock_client;
-    socklen_t len = sizeof(sock_client);
-    int clientfd = accept(_fd, (struct sockaddr*)&sock_client, &len);
-    if(clientfd < 0)
+    // 同passiveio_event::handle_event
+    while(true)
     {
-        if(errno != EAGAIN && errno != EINTR)
+        struct sockaddr_storage sock_client;
+        socklen_t len = sizeof(sock_client);
+        int clientfd = accept4(_fd, (struct sockaddr*)&sock_client, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(clientfd < 0)
         {
-            local_log("accept: %s", strerror(errno));
-            return false;
+            if(errno == EINTR) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                local_log("accept: %s", strerror(errno));
+                return false;
+            }
+            return true;
         }
-        return true;
-    }
-    if(set_nonblocking(clientfd) < 0)
-    {
-        close(clientfd);
-        return false;
-    }
 
-    sslio_event* evt = new sslio_event(clientfd, _ses->get_manager()->get_ssl_ctx(), true/*server*/, _ses->dup());
-    evt->set_events(EVENT_RECV | EVENT_SEND);
-    _base->add_event(evt);
-    local_log("accept ssl clientid=%d.", clientfd);
-    return true;
+        sslio_event* evt = new sslio_event(clientfd, _ses->get_manager()->get_ssl_ctx(), true/*server*/, _ses->dup());
+        evt->set_events(EVENT_RECV | EVENT_SEND);
+        reactor* base = _sharded ? _base : _base->next_sub_reactor(); // 非分片模式下主reactor只负责accept，连接的读写交给子reactor
+        base->add_event(evt);
+        local_log("accept ssl clientid=%d reactor=%p.", clientfd, (void*)base);
+    }
 }
 
 ssl_activeio_event::ssl_activeio_event(session_manager* manager)
@@ -189,8 +165,19 @@ int sslio_event::handle_read()
         size_t free_space = rbuffer.free_space();
         if(free_space == 0)
         {
-            local_log("recv[fd=%d]: session %lu buffer is fulled on receiving", _fd, _ses->get_sid());
-            break;
+            _ses->on_recv(total_recv); // 先解码腾出空间，边缘触发下不读到EAGAIN就不会再有通知
+            free_space = rbuffer.free_space();
+        }
+        if(free_space == 0)
+        {
+            // 解码后还是满的，说明一个协议比缓冲区大；边缘触发下不读完就不会再有通知，扩容后继续读
+            if(!_ses->grow_rbuffer())
+            {
+                local_log("recv[fd=%d]: session %lu buffer is fulled on receiving, size=%zu", _fd, _ses->get_sid(), rbuffer.size());
+                close_socket(SESSION_CLOSE_REASON_ERROR);
+                break;
+            }
+            free_space = rbuffer.free_space();
         }
 
         char* recv_ptr = rbuffer.end();
@@ -227,48 +214,58 @@ int sslio_event::handle_read()
 
 int sslio_event::handle_write()
 {
-    octets* wbuffer = nullptr;
-    {
-        bee::rwlock::wrscoped sesl(_ses->_locker);
-        wbuffer = &_ses->wbuffer();
-        if(wbuffer->size() == 0)
-        {
-            _ses->forbid_send();
-            return 0;
-        }
-    }
-
+    // SSL_write没有聚合写，逐块写出，数据块本身不再拷贝
+    constexpr int SSL_WRITE_IOV_MAX = 64;
+    struct iovec iov[SSL_WRITE_IOV_MAX];
     int total_send = 0;
     while(true)
     {
-        int len = SSL_write(_ssl, wbuffer->data() + _ses->_write_offset, wbuffer->size() - _ses->_write_offset);
-        if(len > 0)
+        int iovcnt = 0;
         {
-            //local_log("SSL_write data:%s", std::string(wbuffer.peek(0), len).data());
-            total_send += len;
-            _ses->_write_offset += len;
+            bee::rwlock::wrscoped sesl(_ses->_locker);
+            iovcnt = _ses->_writeq.peek(iov, SSL_WRITE_IOV_MAX);
+            if(iovcnt == 0)
+            {
+                _ses->forbid_send();
+                break;
+            }
         }
-        else // len <= 0
+
+        size_t sent = 0;
+        bool again = false;
+        for(int i = 0; i < iovcnt; ++i)
         {
+            int len = SSL_write(_ssl, iov[i].iov_base, iov[i].iov_len);
+            if(len > 0)
+            {
+                //local_log("SSL_write data:%s", std::string((char*)iov[i].iov_base, len).data());
+                sent += len;
+                if((size_t)len < iov[i].iov_len)
+                {
+                    again = true;
+                    break;
+                }
+                continue;
+            }
             int err = SSL_get_error(_ssl, len);
-            if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) continue;
+            if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+            {
+                again = true; // 等下一次可写通知
+                break;
+            }
             cleanup_ssl();
             close_socket(SESSION_CLOSE_REASON_ERROR);
             local_log("sslio_event handle_send error fd=%d err=%d", _fd, err);
-            break;
+            _ses->on_send(total_send + sent);
+            return total_send + sent;
         }
-
-        if(_ses->_write_offset == wbuffer->size())
+        if(sent > 0)
         {
-            _ses->clear_wbuffer();
+            total_send += sent;
             bee::rwlock::wrscoped sesl(_ses->_locker);
-            wbuffer = &_ses->wbuffer();
-            if(wbuffer->size() == _ses->_write_offset)
-            {
-                _ses->forbid_send();
-                break;
-            }
+            _ses->_writeq.consume(sent);
         }
+        if(again) break;
     }
 
     _ses->on_send(total_send);
@@ -7,8 +7,9 @@ namespace bee
 
 struct ssl_passiveio_event : netio_event
 {
-    ssl_passiveio_event(session_manager* manager);
+    ssl_passiveio_event(session_manager* manager, bool sharded = false);
     virtual bool handle_event(int active_events) override;
+    bool _sharded = false;
 };
 
 struct ssl_activeio_event : netio_event
@@ -1,6 +1,6 @@
 #pragma once
 #include "lock.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 
 namespace bee
 {
@@ -9,12 +9,12 @@ class traffic_shaper
 {
 public:
     traffic_shaper(size_t rate_bps) 
-        : _capacity(rate_bps), _tokens(rate_bps), _last_fill(systemtime::get_millseconds()) {}
+        : _capacity(rate_bps), _tokens(rate_bps), _last_fill(cached_clock::get_monotonic_millseconds()) {}
     
     bool acquire(size_t bytes)
     {
         bee::spinlock::scoped l(_lock);
-        auto now = systemtime::get_millseconds();
+        auto now = cached_clock::get_monotonic_millseconds();
         auto elapsed = now - _last_fill;
         
         // 计算新增令牌
@@ -0,0 +1,143 @@
+#include "write_queue.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "lock.h"
+
+namespace bee
+{
+
+/*
+ * 大块数据的缓冲区池
+ * 发送完的缓冲区回到池里，下次挂大块数据时和调用方的编码缓冲区交换，
+ * 调用方的thread_local缓冲区拿回一个有容量的空缓冲区，稳态下不再分配
+ */
+static constexpr size_t POOL_MAX_COUNT    = 256;
+static constexpr size_t POOL_MAX_CAPACITY = 4 * 1024 * 1024; // 更大的缓冲区直接释放，不长期占用内存
+
+static bee::spinlock s_pool_locker;
+static std::vector<octets*> s_pool;
+
+static octets* acquire_buffer()
+{
+    {
+        std::unique_lock<bee::spinlock> lock(s_pool_locker);
+        if(!s_pool.empty())
+        {
+            octets* buf = s_pool.back();
+            s_pool.pop_back();
+            return buf;
+        }
+    }
+    return new octets;
+}
+
+static void release_buffer(const octets* data)
+{
+    octets* buf = const_cast<octets*>(data);
+    if(buf->capacity() <= POOL_MAX_CAPACITY)
+    {
+        buf->clear();
+        std::unique_lock<bee::spinlock> lock(s_pool_locker);
+        if(s_pool.size() < POOL_MAX_COUNT)
+        {
+            s_pool.push_back(buf);
+            return;
+        }
+    }
+    delete buf;
+}
+
+void write_queue::append(const char* data, size_t len)
+{
+    if(len == 0) return;
+    if(len >= COALESCE_SIZE)
+    {
+        append(octets(data, len));
+        return;
+    }
+    if(_tail == nullptr || _tail->free_space() < len)
+    {
+        auto chunk = std::make_shared<octets>();
+        chunk->reserve(std::max(CHUNK_SIZE, len));
+        _tail = chunk.get();
+        _slices.push_back({std::move(chunk), 0});
+    }
+    _tail->append(data, len);
+    _size += len;
+}
+
+void write_queue::append(octets&& data)
+{
+    if(data.size() < COALESCE_SIZE)
+    {
+        append(data.data(), data.size());
+        return;
+    }
+    size_t len = data.size();
+    octets* buf = acquire_buffer();
+    buf->swap(data); // data换成池里的空缓冲区，保留容量
+    _slices.push_back({shared_octets(buf, release_buffer), 0});
+    _tail = nullptr;
+    _size += len;
+}
+
+void write_queue::append(const shared_octets& data)
+{
+    if(!data || data->empty()) return;
+    if(data->size() < COALESCE_SIZE)
+    {
+        append(data->data(), data->size());
+        return;
+    }
+    _slices.push_back({data, 0});
+    _tail = nullptr;
+    _size += data->size();
+}
+
+int write_queue::peek(struct iovec* iov, int maxcnt) const
+{
+    int cnt = 0;
+    for(auto iter = _slices.begin(); iter != _slices.end() && cnt < maxcnt; ++iter)
+    {
+        size_t len = iter->data->size() - iter->offset;
+        if(len == 0) continue;
+        iov[cnt].iov_base = iter->data->begin() + iter->offset;
+        iov[cnt].iov_len  = len;
+        ++cnt;
+    }
+    return cnt;
+}
+
+void write_queue::consume(size_t len)
+{
+    len = std::min(len, _size);
+    _size -= len;
+    while(len > 0 && !_slices.empty())
+    {
+        slice& front = _slices.front();
+        size_t remain = front.data->size() - front.offset;
+        if(len < remain)
+        {
+            front.offset += len;
+            return;
+        }
+        len -= remain;
+        if(front.data.get() == _tail)
+        {
+            _tail = nullptr;
+        }
+        _slices.pop_front();
+    }
+}
+
+void write_queue::clear()
+{
+    _slices.clear();
+    _tail = nullptr;
+    _size = 0;
+}
+
+} // namespace bee
@@ -0,0 +1,48 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <sys/uio.h>
+
+#include "octets.h"
+#include "types.h"
+
+namespace bee
+{
+
+// 只读的引用计数数据块，可以同时挂在多个会话的发送队列上
+using shared_octets = std::shared_ptr<const octets>;
+
+// 会话的链式发送队列，发送时把多个数据块填进iovec一次发出
+// 小块数据合并拷贝到队尾的私有块，大块数据直接挂到队列上，不再拷贝进会话缓冲区
+class write_queue
+{
+public:
+    static constexpr size_t COALESCE_SIZE = 4096;  // 小于该长度的数据合并拷贝
+    static constexpr size_t CHUNK_SIZE    = 16384; // 合并块的容量
+
+    void append(const char* data, size_t len);
+    void append(octets&& data); // 短数据会被拷贝，data保持不变；大块数据和池里的空缓冲区交换
+    void append(const shared_octets& data); // 短数据同样合并拷贝
+
+    // 把待发送的数据块填进iov，返回填入的个数
+    int  peek(struct iovec* iov, int maxcnt) const;
+    // 丢弃已发送的len字节
+    void consume(size_t len);
+    void clear();
+
+    FORCE_INLINE size_t size() const { return _size; }
+    FORCE_INLINE bool empty() const { return _size == 0; }
+    FORCE_INLINE size_t slice_count() const { return _slices.size(); }
+
+private:
+    struct slice
+    {
+        shared_octets data;
+        size_t offset = 0; // 已发送的字节数
+    };
+    std::deque<slice> _slices;
+    octets* _tail = nullptr; // 队尾可以继续追加的合并块，容量足够时追加不会搬移已有数据
+    size_t  _size = 0;
+};
+
+} // namespace bee
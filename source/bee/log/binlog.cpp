@@ -0,0 +1,256 @@
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <mutex>
+
+#include "binlog.h"
+
+namespace bee
+{
+
+uint32_t binlog_registry::add(const char* fmt, const char* filename, int line)
+{
+    std::unique_lock<bee::spinlock> lock(_locker);
+    binlog_format& format = _formats.emplace_back();
+    format.formatid = _formats.size();
+    format.line = line;
+    format.filename = filename;
+    format.fmt = fmt;
+    return format.formatid;
+}
+
+bool binlog_registry::get(uint32_t formatid, binlog_format& format)
+{
+    std::unique_lock<bee::spinlock> lock(_locker);
+    if(formatid == 0 || formatid > _formats.size()) return false;
+    format = _formats[formatid - 1];
+    return true;
+}
+
+uint32_t binlog_registry::size()
+{
+    std::unique_lock<bee::spinlock> lock(_locker);
+    return _formats.size();
+}
+
+namespace binlog
+{
+
+struct decoded_arg
+{
+    BINLOG_ARG_TYPE type;
+    union
+    {
+        bool b;
+        char c;
+        int64_t i;
+        uint64_t u;
+        float f;
+        double d;
+        const void* p;
+    };
+    std::string_view s;
+};
+
+static bool decode_args(const char* data, size_t len, std::vector<decoded_arg>& args)
+{
+    const char* end = data + len;
+    while(data < end)
+    {
+        decoded_arg& arg = args.emplace_back();
+        arg.type = (BINLOG_ARG_TYPE)*data++;
+        uint64_t value = 0;
+        switch(arg.type)
+        {
+            case BINLOG_ARG_BOOL:
+            case BINLOG_ARG_CHAR:
+            {
+                if(data >= end) return false;
+                if(arg.type == BINLOG_ARG_BOOL) arg.b = *data != 0; else arg.c = *data;
+                ++data;
+            } break;
+            case BINLOG_ARG_INT:
+            case BINLOG_ARG_UINT:
+            case BINLOG_ARG_POINTER:
+            {
+                if(!(data = read_varint(data, end, value))) return false;
+                if(arg.type == BINLOG_ARG_INT)       arg.i = decode_zigzag64(value);
+                else if(arg.type == BINLOG_ARG_UINT) arg.u = value;
+                else                                 arg.p = reinterpret_cast<const void*>(value);
+            } break;
+            case BINLOG_ARG_FLOAT:
+            {
+                if(end - data < (ptrdiff_t)sizeof(float)) return false;
+                memcpy(&arg.f, data, sizeof(float));
+                data += sizeof(float);
+            } break;
+            case BINLOG_ARG_DOUBLE:
+            {
+                if(end - data < (ptrdiff_t)sizeof(double)) return false;
+                memcpy(&arg.d, data, sizeof(double));
+                data += sizeof(double);
+            } break;
+            case BINLOG_ARG_STRING:
+            {
+                if(!(data = read_varint(data, end, value)) || value > (uint64_t)(end - data)) return false;
+                arg.s = std::string_view(data, value);
+                data += value;
+            } break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+static void format_arg(std::string& out, const std::string& spec, const decoded_arg& arg)
+{
+    auto it = std::back_inserter(out);
+    switch(arg.type)
+    {
+        case BINLOG_ARG_BOOL:    { std::vformat_to(it, spec, std::make_format_args(arg.b)); } break;
+        case BINLOG_ARG_CHAR:    { std::vformat_to(it, spec, std::make_format_args(arg.c)); } break;
+        case BINLOG_ARG_INT:     { std::vformat_to(it, spec, std::make_format_args(arg.i)); } break;
+        case BINLOG_ARG_UINT:    { std::vformat_to(it, spec, std::make_format_args(arg.u)); } break;
+        case BINLOG_ARG_FLOAT:   { std::vformat_to(it, spec, std::make_format_args(arg.f)); } break;
+        case BINLOG_ARG_DOUBLE:  { std::vformat_to(it, spec, std::make_format_args(arg.d)); } break;
+        case BINLOG_ARG_STRING:  { std::vformat_to(it, spec, std::make_format_args(arg.s)); } break;
+        case BINLOG_ARG_POINTER: { std::vformat_to(it, spec, std::make_format_args(arg.p)); } break;
+    }
+}
+
+static bool parse_arg_id(std::string_view id, size_t& next_arg, size_t& index)
+{
+    if(id.empty())
+    {
+        index = next_arg++;
+        return true;
+    }
+    if(id.find_first_not_of("0123456789") != std::string_view::npos) return false;
+    index = 0;
+    for(char c : id) index = index * 10 + (c - '0');
+    return true;
+}
+
+// 把spec里嵌套的{}或{n}换成对应整数参数的值，如:>{}、:.{}f
+static bool resolve_spec(std::string& spec, std::string_view field, const std::vector<decoded_arg>& args, size_t& next_arg)
+{
+    size_t i = 0;
+    while(i < field.size())
+    {
+        size_t open = field.find('{', i);
+        if(open == std::string_view::npos)
+        {
+            spec.append(field.substr(i));
+            break;
+        }
+        spec.append(field.substr(i, open - i));
+        size_t close = field.find('}', open + 1);
+        if(close == std::string_view::npos) return false;
+
+        size_t index = 0;
+        if(!parse_arg_id(field.substr(open + 1, close - open - 1), next_arg, index) || index >= args.size()) return false;
+        const decoded_arg& arg = args[index];
+        if(arg.type == BINLOG_ARG_INT && arg.i >= 0)
+        {
+            spec.append(std::to_string(arg.i));
+        }
+        else if(arg.type == BINLOG_ARG_UINT)
+        {
+            spec.append(std::to_string(arg.u));
+        }
+        else
+        {
+            return false; // 宽度和精度只能是非负整数
+        }
+        i = close + 1;
+    }
+    return true;
+}
+
+/*
+ * 逐个替换字段格式化：{}、{n}、{:spec}、{n:spec}，以及转义的{{和}}
+ * spec里可以嵌套{}或{n}指定宽度和精度，先换成参数的值
+ * 每个字段单独交给std::vformat_to，参数的具体类型由解码结果决定
+ */
+void format(std::string& out, std::string_view fmt, const char* args, size_t len)
+{
+    thread_local std::vector<decoded_arg> decoded;
+    thread_local std::string spec;
+    decoded.clear();
+    if(!decode_args(args, len, decoded))
+    {
+        out.append("<<binlog decode error>> ").append(fmt);
+        return;
+    }
+
+    size_t next_arg = 0;
+    size_t i = 0;
+    while(i < fmt.size())
+    {
+        char ch = fmt[i];
+        if(ch == '}' || ch == '{')
+        {
+            if(i + 1 < fmt.size() && fmt[i + 1] == ch) // {{ 或 }}
+            {
+                out.push_back(ch);
+                i += 2;
+                continue;
+            }
+            if(ch == '}')
+            {
+                out.push_back(ch);
+                ++i;
+                continue;
+            }
+
+            // 找配对的}，跳过spec里嵌套的{}
+            size_t close = i + 1;
+            for(int depth = 1; close < fmt.size(); ++close)
+            {
+                if(fmt[close] == '{') ++depth;
+                else if(fmt[close] == '}' && --depth == 0) break;
+            }
+            if(close >= fmt.size())
+            {
+                out.append("<<binlog format error>>");
+                return;
+            }
+            std::string_view field = fmt.substr(i + 1, close - i - 1);
+            size_t colon = field.find(':');
+            size_t index = 0;
+            spec.assign("{");
+            if(!parse_arg_id(field.substr(0, colon), next_arg, index)
+                || (colon != std::string_view::npos && !resolve_spec(spec, field.substr(colon), decoded, next_arg)))
+            {
+                out.append("<<binlog format error>>");
+            }
+            else if(index >= decoded.size())
+            {
+                out.append("<<binlog missing argument>>");
+            }
+            else
+            {
+                spec.push_back('}');
+                try
+                {
+                    format_arg(out, spec, decoded[index]);
+                }
+                catch(const std::format_error&)
+                {
+                    out.append("<<binlog format error>>");
+                }
+            }
+            i = close + 1;
+            continue;
+        }
+
+        size_t next = fmt.find_first_of("{}", i);
+        if(next == std::string_view::npos) next = fmt.size();
+        out.append(fmt.data() + i, next - i);
+        i = next;
+    }
+}
+
+} // namespace binlog
+
+} // namespace bee
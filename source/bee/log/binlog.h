@@ -0,0 +1,142 @@
+#pragma once
+#include <stdint.h>
+#include <concepts>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "lock.h"
+#include "octets.h"
+#include "types.h"
+#include "varint.h"
+
+namespace bee
+{
+
+/*
+ * 二进制日志
+ * FILE_GLOGF在调用点注册一次格式串拿到编号，之后每条日志只记录编号和参数的原始值，
+ * 文本化放到logserver上做，调用方不再执行std::format，发给logserver的数据也小很多。
+ * 参数里有不支持的类型时整条日志退回文本模式。
+ */
+enum BINLOG_ARG_TYPE : uint8_t
+{
+    BINLOG_ARG_BOOL,
+    BINLOG_ARG_CHAR,
+    BINLOG_ARG_INT,     // zigzag varint
+    BINLOG_ARG_UINT,    // varint
+    BINLOG_ARG_DOUBLE,
+    BINLOG_ARG_STRING,  // varint长度 + 内容
+    BINLOG_ARG_POINTER,
+    BINLOG_ARG_FLOAT,   // 4字节，按float文本化，和调用方的std::format输出一致
+};
+
+struct binlog_format
+{
+    uint32_t formatid = 0;
+    uint16_t line = 0;
+    std::string filename;
+    std::string fmt;
+};
+
+// 调用点注册表，编号从1开始连续分配
+class binlog_registry : public singleton_support<binlog_registry>
+{
+public:
+    uint32_t add(const char* fmt, const char* filename, int line);
+    bool get(uint32_t formatid, binlog_format& format);
+    uint32_t size();
+
+private:
+    bee::spinlock _locker;
+    std::vector<binlog_format> _formats;
+};
+
+template<typename T>
+concept binlog_arg = std::same_as<std::remove_cvref_t<T>, bool>
+                  || std::same_as<std::remove_cvref_t<T>, char>
+                  || std::integral<std::remove_cvref_t<T>>
+                  || std::floating_point<std::remove_cvref_t<T>>
+                  || std::convertible_to<const T&, std::string_view>
+                  || std::same_as<std::decay_t<T>, void*>
+                  || std::same_as<std::decay_t<T>, const void*>;
+
+namespace binlog
+{
+
+inline void put_varint(octets& buf, uint64_t value)
+{
+    char tmp[10];
+    size_t len = 0;
+    while(value >= 0x80)
+    {
+        tmp[len++] = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    tmp[len++] = static_cast<char>(value);
+    buf.append(tmp, len);
+}
+
+template<binlog_arg T>
+FORCE_INLINE void encode_arg(octets& buf, const T& arg)
+{
+    using type = std::remove_cvref_t<T>;
+    if constexpr(std::same_as<type, bool>)
+    {
+        buf.append((char)BINLOG_ARG_BOOL);
+        buf.append((char)arg);
+    }
+    else if constexpr(std::same_as<type, char>)
+    {
+        buf.append((char)BINLOG_ARG_CHAR);
+        buf.append(arg);
+    }
+    else if constexpr(std::signed_integral<type>)
+    {
+        buf.append((char)BINLOG_ARG_INT);
+        put_varint(buf, encode_zigzag64(arg));
+    }
+    else if constexpr(std::unsigned_integral<type>)
+    {
+        buf.append((char)BINLOG_ARG_UINT);
+        put_varint(buf, arg);
+    }
+    else if constexpr(std::same_as<type, float>)
+    {
+        buf.append((char)BINLOG_ARG_FLOAT);
+        buf.append((const char*)&arg, sizeof(arg));
+    }
+    else if constexpr(std::floating_point<type>)
+    {
+        double value = arg;
+        buf.append((char)BINLOG_ARG_DOUBLE);
+        buf.append((const char*)&value, sizeof(value));
+    }
+    else if constexpr(std::convertible_to<const T&, std::string_view>)
+    {
+        std::string_view str = arg;
+        buf.append((char)BINLOG_ARG_STRING);
+        put_varint(buf, str.size());
+        buf.append(str.data(), str.size());
+    }
+    else
+    {
+        uint64_t value = reinterpret_cast<uintptr_t>(arg);
+        buf.append((char)BINLOG_ARG_POINTER);
+        put_varint(buf, value);
+    }
+}
+
+template<binlog_arg... Args>
+FORCE_INLINE void encode(octets& buf, const Args&... args)
+{
+    (encode_arg(buf, args), ...);
+}
+
+// 按格式串把参数文本化后追加到out，格式串或参数不合法时追加错误提示
+void format(std::string& out, std::string_view fmt, const char* args, size_t len);
+
+} // namespace binlog
+
+} // namespace bee
@@ -1,5 +1,6 @@
 #include "glog.h"
 
+#include <charconv>
 #include <cstdio>
 #include "glog.h"
 #include "log_appender.h"
@@ -7,7 +8,7 @@
 #include "config.h"
 #include "log_event.h"
 #include "influxlog_event.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 
 namespace bee
 {
@@ -15,41 +16,65 @@ thread_local bee::log_event g_logevent;
 thread_local bee::influxlog_event g_influxlogevent;
 thread_local bee::ostringstream g_logstream;
 
+// 复用线程本地log_event里字符串的容量，稳定后不再分配内存
+static void fill_logevent(const std::string& process_name, const char* filename, int line, std::string_view content)
+{
+    char elapse[24];
+    auto [end, ec] = std::to_chars(elapse, elapse + sizeof(elapse), get_process_elapse());
+
+    g_logevent.set_process_name();
+    g_logevent.process_name.assign(process_name);
+    g_logevent.set_filename();
+    g_logevent.filename.assign(filename);
+    g_logevent.set_line(line);
+    g_logevent.set_timestamp(cached_clock::get_time());
+    g_logevent.set_threadid(gettid());
+    g_logevent.set_elapse();
+    g_logevent.elapse.assign(elapse, end - elapse);
+    g_logevent.set_content();
+    g_logevent.content.assign(content);
+}
+
 void logclient::init()
 {
     auto cfg = config::get_instance();
     _loglevel = cfg->get<LOG_LEVEL>("log", "loglevel", LOG_LEVEL::TRACE);
+    _binlog = cfg->get<bool>("log", "binlog", false);
     _console_logger = new logger(_loglevel, new console_appender());
     g_logstream.reserve(LOG_BUFFER_SIZE);
 }
 
-void logclient::glog(LOG_LEVEL level, const char* filename, int line, std::string content)
+void logclient::glog(LOG_LEVEL level, const char* filename, int line, std::string_view content)
 {
-    g_logevent.set_process_name(_process_name);
-    g_logevent.set_filename(filename);
-    g_logevent.set_line(line);
-    g_logevent.set_timestamp(systemtime::get_time());
-    g_logevent.set_threadid(gettid());
-    g_logevent.set_elapse(std::to_string(get_process_elapse()));
-    g_logevent.set_content(std::move(content));
+    fill_logevent(_process_name, filename, line, content);
 
     commit_log(level, g_logevent);
 }
 
-void logclient::console_log(LOG_LEVEL level, const char* filename, int line, std::string content)
+void logclient::console_log(LOG_LEVEL level, const char* filename, int line, std::string_view content)
 {
     if(!_console_logger) return;
-    g_logevent.set_process_name(_process_name);
-    g_logevent.set_filename(filename);
-    g_logevent.set_line(line);
-    g_logevent.set_timestamp(systemtime::get_time());
-    g_logevent.set_threadid(gettid());
-    g_logevent.set_elapse(std::to_string(get_process_elapse()));
-    g_logevent.set_content(std::move(content));
+    fill_logevent(_process_name, filename, line, content);
 
     _console_logger->log(level, g_logevent);
 }
 
+void logclient::decode_binlog(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, const octets& args)
+{
+    thread_local binlog_format format;
+    thread_local std::string content;
+    content.clear();
+    if(binlog_registry::get_instance()->get(formatid, format))
+    {
+        binlog::format(content, format.fmt, args.data(), args.size());
+    }
+    else
+    {
+        content.assign("<<binlog unknown format>>");
+    }
+    glog(level, filename, line, content);
+}
+
 void logclient::influx_log(const std::string& measurement, const std::map<std::string, std::string> tags, const std::map<std::string, std::string>& fields, TIMETYPE timestamp)
 {
     g_influxlogevent.measurement = measurement;
@@ -80,6 +105,16 @@ ATTR_WEAK void logclient::commit_log(LOG_LEVEL level, const log_event& event)
     _console_logger->log(level, event);
 }
 
+ATTR_WEAK void logclient::commit_binlog(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, const octets& args)
+{
+    decode_binlog(level, formatid, filename, line, args);
+}
+
+ATTR_WEAK bool logclient::is_binlog_enabled() const
+{
+    return false;
+}
+
 ATTR_WEAK void commit_influxlog(const influxlog_event& event)
 {
 }
@@ -1,9 +1,13 @@
 #pragma once
 #include "types.h"
+#include "binlog.h"
 #include "format.h"
 #include "log.h"
 #include "logger.h"
+#include <algorithm>
 #include <cstdarg>
+#include <iterator>
+#include <string_view>
 
 namespace bee
 {
@@ -20,18 +24,25 @@ public:
     template<LOG_OUTPUT output> struct impl;
 
     void init();
-    void glog(LOG_LEVEL level, const char* filename, int line, std::string content);
-    void console_log(LOG_LEVEL level, const char* filename, int line, std::string content);
+    void glog(LOG_LEVEL level, const char* filename, int line, std::string_view content);
+    void console_log(LOG_LEVEL level, const char* filename, int line, std::string_view content);
+    template<typename... Args>
+    void glogf(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, std::format_string<const Args&...> fmt, const Args&... args);
     void influx_log(const std::string& measurement, const std::map<std::string, std::string> tags, const std::map<std::string, std::string>& fields, TIMETYPE timestamp/*ns*/);
 
     FORCE_INLINE logger* get_console_logger() { return _console_logger; }
     void set_process_name(const std::string& process_name);
     void set_logserver(logserver_manager* logserver);
     void commit_log(LOG_LEVEL level, const log_event& event);
+    void commit_binlog(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, const octets& args);
+    void decode_binlog(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, const octets& args); // 在本地还原成文本后走glog
+    bool is_binlog_enabled() const; // 开启了log.binlog并且连上了logserver
+    FORCE_INLINE const std::string& get_process_name() const { return _process_name; }
     void commit_influxlog(const influxlog_event& event);
 
 private:
     bool _is_logserver = false;
+    bool _binlog = false;
     LOG_LEVEL _loglevel;
     std::string _process_name;
     logserver_manager* _logserver;
@@ -50,20 +61,21 @@ struct logclient::impl
         if(!g_logstream.empty())
         {
             g_logstream.truncate(LOG_BUFFER_SIZE);
-            log(g_logstream.str());
+            log(g_logstream.view());
             g_logstream.clear();
         }
     }
 
-    void log(std::string&& content)
+    // 内容直接复制进线程本地的log_event，不构造临时字符串
+    void log(std::string_view content)
     {
         if constexpr(output == LOG_OUTPUT::CONSOLE)
         {
-            logclient::get_instance()->console_log(_loglevel, _filename, _line, std::move(content));
+            logclient::get_instance()->console_log(_loglevel, _filename, _line, content);
         }
         else if constexpr(output == LOG_OUTPUT::LOGFILE)
         {
-            logclient::get_instance()->glog(_loglevel, _filename, _line,  std::move(content));
+            logclient::get_instance()->glog(_loglevel, _filename, _line, content);
         }
     }
 
@@ -72,14 +84,15 @@ struct logclient::impl
         thread_local char content[LOG_BUFFER_SIZE];
         va_list args;
         va_start(args, fmt);
-        vsnprintf(content, sizeof(content), fmt, args);
+        int len = vsnprintf(content, sizeof(content), fmt, args);
         va_end(args);
-        log(std::string(content));
+        if(len < 0) return;
+        log(std::string_view(content, std::min<size_t>(len, sizeof(content) - 1)));
     }
 
-    void operator()(std::string content)
+    void operator()(std::string_view content)
     {
-        log(std::move(content));
+        log(content);
     }
 
     template<typename T> impl& operator<<(T&& arg)
@@ -106,12 +119,36 @@ struct logclient::impl<INFLUX>
     }
 };
 
+// 参数都能按原始值编码时只记录格式串编号和参数，否则在调用线程上格式化
+template<typename... Args>
+void logclient::glogf(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, std::format_string<const Args&...> fmt, const Args&... args)
+{
+    if constexpr((binlog_arg<Args> && ...))
+    {
+        if(is_binlog_enabled())
+        {
+            thread_local octets buf;
+            buf.clear();
+            binlog::encode(buf, args...);
+            commit_binlog(level, formatid, filename, line, buf);
+            return;
+        }
+    }
+    thread_local std::string content;
+    content.clear();
+    std::format_to(std::back_inserter(content), fmt, args...);
+    glog(level, filename, line, content);
+}
+
 using FILE_GLOG    = logclient::impl<LOGFILE>;
 using CONSOLE_GLOG = logclient::impl<CONSOLE>;
 using INFLUX_GLOG  = logclient::impl<INFLUX>;
 
 #define FILE_GLOGF(loglevel, fmt, ...) \
-    FILE_GLOG(loglevel, __FILENAME__, __LINE__)(std::format(fmt, ##__VA_ARGS__))
+    do { \
+        static const uint32_t _binlog_formatid = bee::binlog_registry::get_instance()->add(fmt, __FILENAME__, __LINE__); \
+        bee::logclient::get_instance()->glogf(loglevel, _binlog_formatid, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__); \
+    } while(0)
 
 #define CONSOLE_GLOGF(loglevel, fmt, ...) \
     CONSOLE_GLOG(loglevel, __FILENAME__, __LINE__)(std::format(fmt, ##__VA_ARGS__))
@@ -1,13 +1,22 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <filesystem>
 #include <stdint.h>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <system_error>
 
 #include "log_appender.h"
 #include "config.h"
 #include "log.h"
-#include "log_formatter.h"
+#include "log_archiver.h"
+#include "log_event.h"
 #include "log_rotator.h"
 #include "common.h"
 
@@ -20,6 +29,15 @@ log_appender::log_appender()
     _formatter = new log_formatter(format_pattern);
 }
 
+void log_appender::log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(levels[i] < minlevel) continue;
+        log(levels[i], events[i]);
+    }
+}
+
 void console_appender::log(const std::string& content)
 {
     std::fwrite(content.data(), 1, content.size(), stdout);
@@ -28,10 +46,12 @@ void console_appender::log(const std::string& content)
 
 void console_appender::log(LOG_LEVEL level, const log_event& event)
 {
-    std::string msg = _formatter->format(level, event);
+    thread_local octets buf; // 复用容量，稳定后不再分配
+    buf.clear();
+    _formatter->format(buf, level, log_record(event));
 
     std::unique_lock<bee::mutex> lock(_locker);
-    std::fwrite(msg.data(), 1, msg.size(), stdout);
+    std::fwrite(buf.data(), 1, buf.size(), stdout);
     std::fflush(stdout);
 }
 
@@ -59,8 +79,14 @@ std::string rotatable_log_appender::get_suffix()
     return _rotator ? _rotator->get_suffix() : "";
 }
 
-file_appender::file_appender(std::string filedir, std::string filename)
-    : rotatable_log_appender(new time_log_rotator(this, time_log_rotator::ROTATE_TYPE_DAY))
+void rotatable_log_appender::set_rotator(log_rotator* rotator)
+{
+    delete _rotator;
+    _rotator = rotator;
+}
+
+file_appender::file_appender(std::string filedir, std::string filename, const std::string& section)
+    : rotatable_log_appender(nullptr)
     , _filedir(filedir)
     , _filename(filename)
 {
@@ -75,11 +101,21 @@ file_appender::file_appender(std::string filedir, std::string filename)
         return;
     }
 
+    // rotator要根据目录里已有的文件决定文件名，目录确定后再创建
+    set_rotator(log_rotator::create(this, section));
     reopen();
+    _archiver = new log_archiver(_filedir, _filename, section);
+    _archiver->start(_filepath);
 }
 
 file_appender::~file_appender()
 {
+    set_rotator(nullptr); // 先停掉检查流转的定时器
+    if(_archiver)
+    {
+        delete _archiver;
+        _archiver = nullptr;
+    }
     if(_filestream.is_open())
     {
         _filestream.close();
@@ -101,27 +137,64 @@ void file_appender::log(const std::string& content)
 
 void file_appender::log(LOG_LEVEL level, const log_event& event)
 {
-    std::string msg = _formatter->format(level, event);
+    thread_local octets buf;
+    buf.clear();
+    _formatter->format(buf, level, log_record(event));
 
     std::unique_lock<bee::mutex> lock(_locker);
-    _filestream << msg;
+    _filestream.write(buf.data(), buf.size());
     _filestream.flush();
 }
 
+void file_appender::log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel)
+{
+    thread_local octets buf;
+    buf.clear();
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(levels[i] < minlevel) continue;
+        _formatter->format(buf, levels[i], log_record(events[i]));
+    }
+    if(buf.size() == 0) return;
+
+    std::unique_lock<bee::mutex> lock(_locker);
+    _filestream.write(buf.data(), buf.size());
+    _filestream.flush();
+}
+
+std::string file_appender::make_filepath(const std::string& suffix) const
+{
+    return _filedir + format_string("/%s.%s.log", _filename.data(), suffix.data());
+}
+
+size_t file_appender::get_filesize()
+{
+    std::unique_lock<bee::mutex> lock(_locker);
+    std::error_code ec;
+    size_t size = std::filesystem::file_size(_filepath, ec);
+    return ec ? 0 : size;
+}
+
 bool file_appender::reopen() // no lock
 {
-    _filepath = _filedir + format_string("/%s.%s.log", _filename.data(), get_suffix().data());
+    std::string closed_path;
     if(_filestream.is_open())
     {
         _filestream.close();
+        closed_path = std::move(_filepath);
     }
+    _filepath = make_filepath(get_suffix());
     _filestream.open(_filepath, std::fstream::out | std::fstream::app);
     printf("open filestream %s\n", _filepath.data());
+    if(_archiver && closed_path.size())
+    {
+        _archiver->add(closed_path, _filepath); // 压缩和清理都在归档线程里做
+    }
     return true;
 }
 
 influxlog_appender::influxlog_appender(std::string logdir, std::string filename)
-    : file_appender(logdir, filename) {}
+    : file_appender(logdir, filename, "influxlog") {}
 
 bool influxlog_appender::reopen()
 {
@@ -146,12 +219,412 @@ bool influxlog_appender::reopen()
     return true;
 }
 
+mmap_appender::mmap_appender(std::string logdir, std::string filename)
+    : file_appender(logdir, filename)
+{
+    auto cfg = config::get_instance();
+    _chunk_size = (size_t)std::clamp(cfg->get<int>("log", "mmap_chunk_size", 64), 1, 1024) * 1024 * 1024; // MB
+    std::string policy = cfg->get("log", "mmap_sync", std::string("none"));
+    if(policy == "periodic")
+    {
+        _sync_policy = SYNC_PERIODIC;
+    }
+    else if(policy == "batch")
+    {
+        _sync_policy = SYNC_BATCH;
+    }
+    else
+    {
+        _sync_policy = SYNC_NONE;
+    }
+
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        if(!_filestream.is_open()) return; // 目录创建失败
+        reopen(); // 基类构造时打开的是fstream，换成映射文件
+    }
+
+    if(_sync_policy == SYNC_PERIODIC)
+    {
+        start_sync_thread(std::max(cfg->get<int>("log", "mmap_sync_interval", 1000), 10));
+    }
+}
+
+mmap_appender::~mmap_appender()
+{
+    stop_sync_thread();
+    set_rotator(nullptr);
+    std::unique_lock<bee::mutex> lock(_locker);
+    close_file();
+}
+
+void mmap_appender::log(const std::string& content)
+{
+    std::unique_lock<bee::mutex> lock(_locker);
+    write(content.data(), content.size());
+}
+
+void mmap_appender::log(LOG_LEVEL level, const log_event& event)
+{
+    thread_local octets buf;
+    buf.clear();
+    _formatter->format(buf, level, log_record(event));
+
+    std::unique_lock<bee::mutex> lock(_locker);
+    write(buf.data(), buf.size());
+}
+
+void mmap_appender::log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel)
+{
+    thread_local octets buf;
+    buf.clear();
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(levels[i] < minlevel) continue;
+        _formatter->format(buf, levels[i], log_record(events[i]));
+    }
+    if(buf.size() == 0) return;
+
+    std::unique_lock<bee::mutex> lock(_locker);
+    write(buf.data(), buf.size());
+}
+
+size_t mmap_appender::get_filesize()
+{
+    std::unique_lock<bee::mutex> lock(_locker);
+    return _offset;
+}
+
+void mmap_appender::sync()
+{
+    int fd = -1;
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        if(_fd < 0) return;
+        fd = dup(_fd); // 落盘时不持有锁，也不怕文件被切换
+    }
+    if(fd < 0) return;
+    fdatasync(fd);
+    close(fd);
+}
+
+void mmap_appender::start_sync_thread(TIMETYPE interval)
+{
+    _sync_running.store(true, std::memory_order_release);
+    _sync_thread = new std::thread([this, interval]()
+    {
+        std::unique_lock<bee::mutex> lock(_sync_locker);
+        while(_sync_running.load(std::memory_order_acquire))
+        {
+            if(_sync_cond.wait_for(lock, std::chrono::milliseconds(interval),
+                [this](){ return !_sync_running.load(std::memory_order_acquire); })) break;
+            lock.unlock();
+            sync();
+            lock.lock();
+        }
+    });
+}
+
+void mmap_appender::stop_sync_thread()
+{
+    if(!_sync_running.exchange(false, std::memory_order_release)) return;
+    {
+        std::unique_lock<bee::mutex> lock(_sync_locker);
+        _sync_cond.notify_one();
+    }
+    if(_sync_thread->joinable())
+    {
+        _sync_thread->join();
+    }
+    delete _sync_thread;
+    _sync_thread = nullptr;
+}
+
+void mmap_appender::write(const char* data, size_t len)
+{
+    if(_fd < 0) return;
+    size_t total = len;
+    while(len > 0)
+    {
+        if(!_map || _offset >= _map_offset + _chunk_size)
+        {
+            if(!map_chunk(_offset))
+            {
+                // 预分配或映射失败时退回普通写，处理部分写入和信号中断
+                ssize_t n = pwrite(_fd, data, len, _offset);
+                if(n > 0)
+                {
+                    _offset += n;
+                    _filesize = std::max(_filesize, _offset);
+                    data += n;
+                    len -= n;
+                    continue;
+                }
+                if(n < 0 && errno == EINTR) continue;
+
+                // 剩下的内容丢弃，只在连续失败的第一次打印，避免刷屏
+                if(_write_failures.fetch_add(1, std::memory_order_relaxed) == _reported_failures)
+                {
+                    fprintf(stderr, "mmap_appender write %s failed, %zu of %zu bytes dropped: %s\n",
+                        _filepath.data(), len, total, n < 0 ? strerror(errno) : "no space");
+                }
+                break;
+            }
+        }
+        size_t n = std::min(len, _map_offset + _chunk_size - _offset);
+        memcpy(_map + (_offset - _map_offset), data, n);
+        _offset += n;
+        data += n;
+        len -= n;
+    }
+
+    if(len == 0)
+    {
+        _reported_failures = _write_failures.load(std::memory_order_relaxed); // 恢复之后再失败时重新打印
+    }
+    if(_sync_policy == SYNC_BATCH && total > 0)
+    {
+        fdatasync(_fd);
+    }
+}
+
+bool mmap_appender::map_chunk(size_t offset) // no lock
+{
+    if(_map)
+    {
+        munmap(_map, _chunk_size);
+        _map = nullptr;
+    }
+
+    size_t map_offset = offset / _chunk_size * _chunk_size;
+    size_t end = map_offset + _chunk_size;
+    if(_filesize < end)
+    {
+        int ret = fallocate(_fd, 0, _filesize, end - _filesize);
+        if(ret != 0 && (errno == EOPNOTSUPP || errno == ENOSYS)) // 文件系统不支持时只扩展长度
+        {
+            ret = ftruncate(_fd, end);
+        }
+        if(ret != 0)
+        {
+            printf("mmap_appender preallocate failed, file:%s err:%s\n", _filepath.data(), strerror(errno));
+            return false;
+        }
+        _filesize = end;
+    }
+
+    void* addr = mmap(nullptr, _chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, map_offset);
+    if(addr == MAP_FAILED)
+    {
+        printf("mmap_appender mmap failed, file:%s err:%s\n", _filepath.data(), strerror(errno));
+        return false;
+    }
+    _map = (char*)addr;
+    _map_offset = map_offset;
+    return true;
+}
+
+void mmap_appender::close_file() // no lock
+{
+    if(_map)
+    {
+        munmap(_map, _chunk_size);
+        _map = nullptr;
+    }
+    if(_fd >= 0)
+    {
+        if(ftruncate(_fd, _offset) != 0) // 去掉预分配的部分
+        {
+            printf("mmap_appender truncate failed, file:%s err:%s\n", _filepath.data(), strerror(errno));
+        }
+        if(_sync_policy != SYNC_NONE)
+        {
+            fdatasync(_fd);
+        }
+        close(_fd);
+        _fd = -1;
+    }
+    _map_offset = 0;
+    _offset = 0;
+    _filesize = 0;
+}
+
+bool mmap_appender::reopen() // no lock
+{
+    std::string closed_path;
+    if(_fd >= 0)
+    {
+        close_file();
+        closed_path = std::move(_filepath);
+    }
+    if(_filestream.is_open())
+    {
+        _filestream.close();
+    }
+
+    _filepath = make_filepath(get_suffix());
+    _fd = open(_filepath.data(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(_fd < 0)
+    {
+        printf("mmap_appender open failed, file:%s err:%s\n", _filepath.data(), strerror(errno));
+        return false;
+    }
+
+    // 上次没有正常关闭时文件末尾是预分配的0，从最后一块里找到实际内容的结尾
+    struct stat st;
+    _filesize = fstat(_fd, &st) == 0 ? st.st_size : 0;
+    _offset = _filesize;
+    char buf[4096];
+    size_t limit = _filesize > _chunk_size ? _filesize - _chunk_size : 0;
+    while(_offset > limit)
+    {
+        size_t len = std::min(sizeof(buf), _offset - limit);
+        if(pread(_fd, buf, len, _offset - len) != (ssize_t)len) break;
+        size_t pos = len;
+        while(pos > 0 && buf[pos - 1] == 0) --pos;
+        _offset -= len - pos;
+        if(pos > 0) break;
+    }
+    printf("open mmap file %s, size:%zu\n", _filepath.data(), _offset);
+
+    if(_archiver && closed_path.size())
+    {
+        _archiver->add(closed_path, _filepath);
+    }
+    return true;
+}
+
+// 环形缓冲区里一条记录的头部，后面紧跟进程名、文件名、运行时间和内容
+struct async_record_header
+{
+    uint32_t size; // 整条记录的长度，按8字节对齐
+    uint8_t  level;
+    uint8_t  raw;  // 1表示不经过formatter直接输出
+    uint16_t line;
+    uint32_t threadid;
+    uint32_t fiberid;
+    uint64_t timestamp;
+    uint16_t procname_len;
+    uint16_t filename_len;
+    uint16_t elapse_len;
+    uint16_t padding;
+    uint32_t content_len;
+};
+
+/*
+ * 单生产者环形缓冲区，_head和_tail都是单调递增的字节偏移
+ * 1.只有所属线程写数据和移动_tail；
+ * 2.后台线程整段复制出来后CAS推进_head，丢弃最旧日志时生产者也会CAS推进_head，
+ *   后台线程CAS失败说明复制的内容可能已经被覆盖，重新复制。
+ */
+class async_appender::producer
+{
+public:
+    explicit producer(size_t capacity)
+        : _capacity(std::bit_ceil(capacity)), _mask(_capacity - 1), _data(new char[_capacity]) {}
+    ~producer() { delete[] _data; }
+
+    FORCE_INLINE size_t capacity() const { return _capacity; }
+    FORCE_INLINE size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+    FORCE_INLINE size_t space() const { return _capacity - size(); }
+
+    // 生产者调用
+    void write(const async_record_header& header, const log_record& record)
+    {
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        uint64_t pos = tail;
+        copy_in(pos, &header, sizeof(header));
+        copy_in(pos, record.process_name.data(), header.procname_len);
+        copy_in(pos, record.filename.data(), header.filename_len);
+        copy_in(pos, record.elapse.data(), header.elapse_len);
+        copy_in(pos, record.content.data(), header.content_len);
+        _tail.store(tail + header.size, std::memory_order_release);
+    }
+
+    // 生产者调用，丢掉最旧的一条，缓冲区为空返回false
+    bool drop_oldest()
+    {
+        uint64_t head = _head.load(std::memory_order_acquire);
+        while(head != _tail.load(std::memory_order_relaxed))
+        {
+            uint32_t size = 0;
+            copy_out(head, &size, sizeof(size)); // 只有生产者写数据，这里读到的一定是完整的
+            if(_head.compare_exchange_weak(head, head + size, std::memory_order_acq_rel)) return true;
+        }
+        return false;
+    }
+
+    // 后台线程调用，把当前所有记录复制到buf，返回复制的字节数
+    size_t read(octets& buf)
+    {
+        while(true)
+        {
+            uint64_t head = _head.load(std::memory_order_acquire);
+            uint64_t tail = _tail.load(std::memory_order_acquire);
+            if(head == tail) return 0;
+            size_t len = tail - head;
+            buf.reserve(len);
+            copy_out(head, buf.data(), len);
+            if(_head.compare_exchange_strong(head, tail, std::memory_order_acq_rel))
+            {
+                buf.fast_resize(len);
+                return len;
+            }
+        }
+    }
+
+    std::atomic_bool _closed = false; // 所属线程已经退出
+
+private:
+    void copy_in(uint64_t& pos, const void* data, size_t len)
+    {
+        size_t offset = pos & _mask;
+        size_t first = std::min(len, _capacity - offset);
+        memcpy(_data + offset, data, first);
+        memcpy(_data, (const char*)data + first, len - first);
+        pos += len;
+    }
+
+    void copy_out(uint64_t pos, void* data, size_t len) const
+    {
+        size_t offset = pos & _mask;
+        size_t first = std::min(len, _capacity - offset);
+        memcpy(data, _data + offset, first);
+        memcpy((char*)data + first, _data, len - first);
+    }
+
+private:
+    const size_t _capacity;
+    const size_t _mask;
+    char* const _data;
+    ALIGN_CACHELINE_SIZE std::atomic<uint64_t> _head = 0;
+    ALIGN_CACHELINE_SIZE std::atomic<uint64_t> _tail = 0;
+};
+
 async_appender::async_appender(std::string logdir, std::string filename)
     : file_appender(logdir, filename)
 {
+    static std::atomic<uint64_t> next_id = 1;
+    _id = next_id.fetch_add(1, std::memory_order_relaxed);
+
     auto cfg = config::get_instance();
-    _timeout   = cfg->get<int>("log", "interval");
-    _threshold = cfg->get<int>("log", "threshold");
+    _timeout     = cfg->get<int>("log", "interval", 1000);
+    _threshold   = cfg->get<int>("log", "threshold", 4096);
+    _buffer_size = cfg->get<int>("log", "buffer_size", 4096*128);
+    _buffer_size = std::max<size_t>(_buffer_size, 4096);
+    std::string policy = cfg->get("log", "backpressure", std::string("drop_newest"));
+    if(policy == "block")
+    {
+        _policy = BACKPRESSURE_BLOCK;
+    }
+    else if(policy == "drop_oldest")
+    {
+        _policy = BACKPRESSURE_DROP_OLDEST;
+    }
+    else
+    {
+        _policy = BACKPRESSURE_DROP_NEWEST;
+    }
     start();
 }
 
@@ -162,84 +635,210 @@ async_appender::~async_appender()
 
 void async_appender::log(const std::string& content)
 {
-    std::unique_lock<bee::mutex> lock(_locker);
-    size_t write_len = _buf.write(content.data(), content.size());
-    if(PREDICT_FALSE(write_len != content.size()))
+    if(_running.load(std::memory_order_acquire) == false) return;
+    log_record record;
+    record.content = content;
+    push(true, LOG_LEVEL::INFO, record);
+}
+
+void async_appender::log(LOG_LEVEL level, const log_event& event)
+{
+    if(_running.load(std::memory_order_acquire) == false) return;
+    push(false, level, log_record(event));
+}
+
+async_appender::producer* async_appender::get_producer()
+{
+    // 线程退出时标记自己的缓冲区，后台线程写完剩余日志后移除
+    struct holder
+    {
+        ~holder()
+        {
+            for(auto& [id, prod] : producers)
+            {
+                prod->_closed.store(true, std::memory_order_release);
+            }
+        }
+        std::vector<std::pair<uint64_t, std::shared_ptr<producer>>> producers;
+    };
+    thread_local holder local;
+
+    for(auto& [id, prod] : local.producers)
     {
-        printf("log lost!!! content size:%zu real write size:%zu.\n", content.size(), write_len);
+        if(id == _id) return prod.get();
     }
 
-    size_t buf_len = _buf.size();
-    if(buf_len - write_len < _threshold && buf_len >= _threshold)
+    auto prod = std::make_shared<producer>(_buffer_size);
     {
-        _cond.notify_one();
+        std::unique_lock<bee::mutex> lock(_producers_locker);
+        _producers.push_back(prod);
     }
+    local.producers.emplace_back(_id, prod);
+    return prod.get();
 }
 
-void async_appender::log(LOG_LEVEL level, const log_event& event)
+void async_appender::push(bool raw, LOG_LEVEL level, const log_record& record)
 {
-#ifdef _REENTRANT
-    if(_running.load(std::memory_order_acquire) == false) return;
-#else
-    if(!_running) return;
-#endif
-    std::string msg = _formatter->format(level, event);
+    producer* prod = get_producer();
+
+    async_record_header header;
+    header.level        = (uint8_t)level;
+    header.raw          = raw;
+    header.line         = record.line;
+    header.threadid     = record.threadid;
+    header.fiberid      = record.fiberid;
+    header.timestamp    = record.timestamp;
+    header.procname_len = std::min<size_t>(record.process_name.size(), UINT16_MAX);
+    header.filename_len = std::min<size_t>(record.filename.size(), UINT16_MAX);
+    header.elapse_len   = std::min<size_t>(record.elapse.size(), UINT16_MAX);
+    header.padding      = 0;
+    header.content_len  = std::min<size_t>(record.content.size(), UINT32_MAX);
+    size_t size = sizeof(header) + header.procname_len + header.filename_len + header.elapse_len + header.content_len;
+    size = (size + 7) & ~(size_t)7;
+    if(PREDICT_FALSE(size > prod->capacity()))
+    {
+        _dropped_newest.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    header.size = size;
 
-    std::unique_lock<bee::mutex> lock(_locker);
-    size_t write_len = _buf.write(msg.data(), msg.size());
-    if(PREDICT_FALSE(write_len != msg.size()))
+    if(prod->space() < size)
     {
-        printf("log lost!!! message size:%zu real write size:%zu.\n", msg.size(), write_len);
+        switch(_policy)
+        {
+            case BACKPRESSURE_BLOCK:
+            {
+                _blocked.fetch_add(1, std::memory_order_relaxed);
+                while(prod->space() < size)
+                {
+                    if(!_running.load(std::memory_order_acquire))
+                    {
+                        _dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    _notified.store(true, std::memory_order_release);
+                    _cond.notify_one();
+                    std::this_thread::yield();
+                }
+            } break;
+            case BACKPRESSURE_DROP_OLDEST:
+            {
+                while(prod->space() < size && prod->drop_oldest())
+                {
+                    _dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+                }
+            } break;
+            default:
+            {
+                _dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
     }
 
-    size_t buf_len = _buf.size();
-    if(buf_len - write_len < _threshold && buf_len >= _threshold)
+    prod->write(header, record);
+
+    // 不加锁通知，错过的唤醒最多等一个interval
+    if(prod->size() >= _threshold && !_notified.exchange(true, std::memory_order_acq_rel))
     {
         _cond.notify_one();
     }
 }
 
+void async_appender::flush()
+{
+    {
+        std::unique_lock<bee::mutex> lock(_producers_locker);
+        _snapshot.assign(_producers.begin(), _producers.end());
+    }
+
+    bool has_closed = false;
+    _wbuf.clear();
+    for(auto& prod : _snapshot)
+    {
+        bool closed = prod->_closed.load(std::memory_order_acquire); // 先读标记，之后读到的就是全部日志
+        _rbuf.clear();
+        if(prod->read(_rbuf) == 0)
+        {
+            has_closed |= closed;
+            continue;
+        }
+
+        const char* data = _rbuf.data();
+        const char* end = data + _rbuf.size();
+        while(data + sizeof(async_record_header) <= end)
+        {
+            async_record_header header;
+            memcpy(&header, data, sizeof(header));
+            if(PREDICT_FALSE(header.size < sizeof(header) || header.size > (size_t)(end - data))) break;
+
+            const char* str = data + sizeof(header);
+            log_record record;
+            record.process_name = std::string_view(str, header.procname_len); str += header.procname_len;
+            record.filename     = std::string_view(str, header.filename_len); str += header.filename_len;
+            record.elapse       = std::string_view(str, header.elapse_len);   str += header.elapse_len;
+            record.content      = std::string_view(str, header.content_len);
+            record.line         = header.line;
+            record.threadid     = header.threadid;
+            record.fiberid      = header.fiberid;
+            record.timestamp    = header.timestamp;
+            if(header.raw)
+            {
+                _wbuf.append(record.content.data(), record.content.size());
+            }
+            else
+            {
+                _formatter->format(_wbuf, (LOG_LEVEL)header.level, record);
+            }
+            _written.fetch_add(1, std::memory_order_relaxed);
+            data += header.size;
+        }
+    }
+
+    if(_wbuf.size() > 0)
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        _filestream.write(_wbuf.data(), _wbuf.size());
+        _filestream.flush();
+    }
+
+    if(has_closed)
+    {
+        std::unique_lock<bee::mutex> lock(_producers_locker);
+        std::erase_if(_producers, [](const std::shared_ptr<producer>& prod)
+        {
+            return prod->_closed.load(std::memory_order_acquire) && prod->size() == 0;
+        });
+    }
+    _snapshot.clear();
+}
+
 void async_appender::start()
 {
-#ifdef _REENTRANT
     _running.store(true);
-#else
-    _running = true;
-#endif
     _thread = new std::thread([this]()
     {
-        while(true)
+        while(_running.load(std::memory_order_acquire))
         {
-        #ifdef _REENTRANT
-            if(!_running.load(std::memory_order_acquire)) break;
-        #else
-            if(!_running) break;
-        #endif
-            std::unique_lock<bee::mutex> lock(_locker);
-            while(_buf.empty())
             {
+                std::unique_lock<bee::mutex> lock(_wait_locker);
                 _cond.wait_for(lock, std::chrono::milliseconds(_timeout),
-                    [this](){ return _buf.size() >= _threshold || !_running; });
-            }
-
-            if(size_t length = _buf.read(_filestream, _buf.size()); length > 0)
-            {
-                _filestream.flush();
-                //printf("async_appender write log %zu...\n", length);
+                    [this](){ return _notified.load(std::memory_order_acquire) || !_running.load(std::memory_order_acquire); });
             }
+            _notified.store(false, std::memory_order_release);
+            flush();
         }
+        flush(); // 退出前写完剩余的日志
     });
 }
 
 void async_appender::stop()
 {
-#ifdef _REENTRANT
     if(!_running.exchange(false, std::memory_order_release)) return;
-#else
-    if(!_running) return;
-    _running = false;
-#endif
-    _cond.notify_one();
+    {
+        std::unique_lock<bee::mutex> lock(_wait_locker);
+        _cond.notify_one();
+    }
     if(_thread->joinable())
     {
         _thread->join();
@@ -248,4 +847,14 @@ void async_appender::stop()
     _thread = nullptr;
 }
 
-}
\ No newline at end of file
+async_appender::stats async_appender::get_stats() const
+{
+    stats st;
+    st.written        = _written.load(std::memory_order_relaxed);
+    st.dropped_oldest = _dropped_oldest.load(std::memory_order_relaxed);
+    st.dropped_newest = _dropped_newest.load(std::memory_order_relaxed);
+    st.blocked        = _blocked.load(std::memory_order_relaxed);
+    return st;
+}
+
+}
@@ -1,23 +1,24 @@
 #pragma once
 #include <stddef.h>
+#include <atomic>
 #include <condition_variable>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <thread>
-#ifdef _REENTRANT
-#include <atomic>
-#endif
+#include <vector>
 
 #include "glog.h"
-#include "ring_buffer.h"
+#include "log_formatter.h"
+#include "octets.h"
 #include "types.h"
 #include "lock.h"
 
 
 namespace bee
 {
+class log_archiver;
 class log_event;
-class log_formatter;
 class log_rotator;
 
 // 日志输出器
@@ -28,6 +29,8 @@ public:
     virtual ~log_appender() = default;
     virtual void log(const std::string& content) = 0; // 忽略formatter直接输出
     virtual void log(LOG_LEVEL level, const log_event& event) = 0;
+    // 一批日志，低于minlevel的跳过；默认逐条输出，file_appender合成一次写
+    virtual void log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel);
 
 protected:
     bee::mutex _locker;
@@ -52,6 +55,9 @@ public:
     std::string get_pre_suffix();
     std::string get_suffix();
 
+protected:
+    void set_rotator(log_rotator* rotator);
+
 private:
     log_rotator* _rotator; 
 };
@@ -60,13 +66,17 @@ private:
 class file_appender : public rotatable_log_appender
 {
 public:
-    file_appender(std::string logdir, std::string filename);
+    // section是读取rotate、compress、retention等配置的段
+    file_appender(std::string logdir, std::string filename, const std::string& section = "log");
     ~file_appender();
     virtual bool rotate() override;
     virtual void log(const std::string& content) override;
     virtual void log(LOG_LEVEL level, const log_event& event) override;
+    virtual void log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel) override;
 
     FORCE_INLINE std::string get_filepath() const { return _filepath; }
+    std::string make_filepath(const std::string& suffix) const;
+    virtual size_t get_filesize(); // 当前文件的大小
 
 protected:
     virtual bool reopen();
@@ -76,6 +86,59 @@ protected:
     std::string  _filename;
     std::string  _filepath;
     std::fstream _filestream;
+    log_archiver* _archiver = nullptr;
+};
+
+/*
+ * 内存映射日志输出器
+ * 1.文件按mmap_chunk_size用fallocate预分配，每次映射一整块，写一条日志只是一次memcpy，回写交给内核；
+ * 2.切换文件和退出时把文件截断到实际写入的长度，进程崩溃后重新打开时跳过末尾预分配的0；
+ * 3.mmap_sync控制落盘：none只依赖内核回写，periodic每mmap_sync_interval毫秒fdatasync一次，batch每次写完都fdatasync。
+ */
+class mmap_appender : public file_appender
+{
+public:
+    enum SYNC_POLICY
+    {
+        SYNC_NONE,
+        SYNC_PERIODIC,
+        SYNC_BATCH,
+    };
+
+    mmap_appender(std::string logdir, std::string filename);
+    ~mmap_appender();
+    virtual void log(const std::string& content) override;
+    virtual void log(LOG_LEVEL level, const log_event& event) override;
+    virtual void log(const LOG_LEVEL* levels, const log_event* events, size_t count, LOG_LEVEL minlevel) override;
+    virtual size_t get_filesize() override;
+    void sync(); // 把已经写入的内容落盘
+    FORCE_INLINE uint64_t get_write_failures() const { return _write_failures.load(std::memory_order_relaxed); }
+
+protected:
+    virtual bool reopen() override;
+
+private:
+    void write(const char* data, size_t len); // 调用方持有_locker
+    bool map_chunk(size_t offset); // 映射offset所在的块，文件不够长时先预分配
+    void close_file();
+    void start_sync_thread(TIMETYPE interval/*ms*/);
+    void stop_sync_thread();
+
+private:
+    size_t _chunk_size = 0;
+    SYNC_POLICY _sync_policy = SYNC_NONE;
+    // periodic的fdatasync放在自己的线程里，不占用reactor的定时器
+    std::thread* _sync_thread = nullptr;
+    std::atomic_bool _sync_running = false;
+    bee::mutex _sync_locker;
+    std::condition_variable_any _sync_cond;
+    int    _fd = -1;
+    char*  _map = nullptr;
+    size_t _map_offset = 0; // 当前映射块在文件中的偏移
+    size_t _offset = 0;     // 实际写入的长度
+    size_t _filesize = 0;   // 预分配后的文件长度
+    std::atomic<uint64_t> _write_failures = 0; // 映射和普通写都失败、丢弃内容的次数
+    uint64_t _reported_failures = 0; // 持有_locker访问
 };
 
 class influxlog_appender : public file_appender
@@ -87,10 +150,31 @@ protected:
     virtual bool reopen() override;
 };
 
-// 异步日志输出器
+/*
+ * 异步日志输出器
+ * 1.每个写日志的线程有自己的单生产者环形缓冲区，只复制原始字段，格式化和写文件都放到后台线程；
+ * 2.生产者不碰_locker，后台线程格式化完一批之后才加锁写文件，只和rotate竞争；
+ * 3.缓冲区满时按backpressure配置阻塞等待、丢弃最旧的日志或者丢弃当前日志，分别计数；
+ * 4.不同线程的日志按批次交错输出，同一线程内保持顺序。
+ */
 class async_appender : public file_appender
 {
 public:
+    enum BACKPRESSURE_POLICY
+    {
+        BACKPRESSURE_BLOCK,       // 等待后台线程腾出空间
+        BACKPRESSURE_DROP_OLDEST, // 丢弃缓冲区里最旧的日志
+        BACKPRESSURE_DROP_NEWEST, // 丢弃当前这条日志
+    };
+
+    struct stats
+    {
+        uint64_t written = 0;
+        uint64_t dropped_oldest = 0;
+        uint64_t dropped_newest = 0;
+        uint64_t blocked = 0;
+    };
+
     async_appender(std::string logdir, std::string filename);
     ~async_appender();
     virtual void log(const std::string& content) override;
@@ -98,19 +182,36 @@ public:
 
     void start();
     void stop();
+    stats get_stats() const;
+
+private:
+    class producer;
+    producer* get_producer();
+    void push(bool raw, LOG_LEVEL level, const log_record& record);
+    void flush(); // 后台线程调用
 
 private:
-    using buffer_type = bee::ring_buffer<4096*128>;
     TIMETYPE _timeout = 0; // ms
     size_t   _threshold = 0;
-#ifdef _REENTRANT
+    size_t   _buffer_size = 0; // 每个线程的缓冲区大小
+    BACKPRESSURE_POLICY _policy = BACKPRESSURE_DROP_NEWEST;
+    uint64_t _id = 0; // 线程本地缓存里区分不同的appender
     std::atomic_bool _running = false;
-#else
-    bool _running = false;
-#endif
+    std::atomic_bool _notified = false;
+    bee::mutex _wait_locker; // 只给后台线程等待用
     std::condition_variable_any _cond;
     std::thread* _thread = nullptr;
-    buffer_type _buf;
+
+    bee::mutex _producers_locker; // 只在线程第一次写日志和后台线程取快照时使用
+    std::vector<std::shared_ptr<producer>> _producers;
+    std::vector<std::shared_ptr<producer>> _snapshot;
+    octets _rbuf; // 从生产者缓冲区取出的原始记录
+    octets _wbuf; // 格式化后待写文件的内容
+
+    std::atomic<uint64_t> _written = 0;
+    std::atomic<uint64_t> _dropped_oldest = 0;
+    std::atomic<uint64_t> _dropped_newest = 0;
+    std::atomic<uint64_t> _blocked = 0;
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,248 @@
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#include "log_archiver.h"
+#include "config.h"
+#include "glog.h"
+#include "log.h"
+#include "macros.h"
+
+namespace bee
+{
+
+log_archiver::log_archiver(std::string filedir, std::string filename, const std::string& section)
+    : _filedir(std::move(filedir))
+    , _filename(std::move(filename))
+{
+    auto cfg = config::get_instance();
+    std::string compress = cfg->get(section, "compress", std::string("none"));
+    if(compress == "gzip" || compress == "zstd")
+    {
+        // 没有链接zstd，统一用gzip
+        _compress = COMPRESS_GZIP;
+    }
+    else if(compress != "none")
+    {
+        printf("unknown compress type:%s, logs will not be compressed\n", compress.data());
+    }
+    _level             = std::clamp(cfg->get<int>(section, "compress_level", 6), 1, 9);
+    _retention_bytes   = (size_t)std::max(cfg->get<int>(section, "retention_mb", 0), 0) * 1024 * 1024;
+    _retention_seconds = (TIMETYPE)std::max(cfg->get<int>(section, "retention_days", 0), 0) * ONEDAY;
+}
+
+log_archiver::~log_archiver()
+{
+    stop();
+}
+
+void log_archiver::start(const std::string& curpath)
+{
+    if(!is_enabled() || _running.exchange(true)) return;
+
+    // 上次运行留下的未压缩文件和没写完的临时文件
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> files;
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(_filedir, ec))
+    {
+        std::string name = entry.path().filename().string();
+        if(name.ends_with(".gz.tmp"))
+        {
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        bool compressed = false;
+        if(_compress == COMPRESS_NONE || !is_logfile(name, compressed) || compressed) continue;
+        if(entry.path().string() == curpath) continue;
+        files.emplace_back(entry.last_write_time(ec), entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        for(auto& [_, path] : files)
+        {
+            _files.push_back(std::move(path));
+        }
+        _curpath = curpath;
+        _clean = true;
+    }
+
+    _thread = new std::thread([this]()
+    {
+        while(_running.load(std::memory_order_acquire))
+        {
+            run();
+        }
+    });
+}
+
+void log_archiver::stop()
+{
+    if(!_running.exchange(false, std::memory_order_release)) return;
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        _cond.notify_one();
+    }
+    if(_thread->joinable())
+    {
+        _thread->join();
+    }
+    delete _thread;
+    _thread = nullptr;
+}
+
+void log_archiver::add(const std::string& closed_path, const std::string& curpath)
+{
+    if(!_running.load(std::memory_order_acquire)) return;
+    std::unique_lock<bee::mutex> lock(_locker);
+    if(_compress != COMPRESS_NONE && closed_path != curpath)
+    {
+        _files.push_back(closed_path);
+    }
+    _curpath = curpath;
+    _clean = true;
+    _cond.notify_one();
+}
+
+void log_archiver::run()
+{
+    std::string filepath;
+    bool clean = false;
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        // 没有新文件时每分钟检查一次保留天数
+        _clean |= !_cond.wait_for(lock, std::chrono::seconds(60),
+            [this](){ return !_files.empty() || _clean || !_running.load(std::memory_order_acquire); });
+        if(!_running.load(std::memory_order_acquire)) return;
+        if(!_files.empty())
+        {
+            filepath = std::move(_files.front());
+            _files.pop_front();
+        }
+        else
+        {
+            clean = _clean;
+            _clean = false;
+        }
+    }
+
+    if(filepath.size())
+    {
+        compress(filepath); // 压缩完再清理，压缩后的文件按压缩后的大小计算
+    }
+    else if(clean)
+    {
+        this->clean();
+    }
+}
+
+bool log_archiver::is_logfile(const std::string& name, bool& compressed) const
+{
+    // filename.后缀.log 或 filename.后缀.log.gz
+    if(name.size() <= _filename.size() + 1 || name.compare(0, _filename.size(), _filename) != 0 || name[_filename.size()] != '.') return false;
+    compressed = name.ends_with(".log.gz");
+    size_t extension = compressed ? 7 : 4;
+    return (compressed || name.ends_with(".log")) && name.size() > _filename.size() + 1 + extension;
+}
+
+bool log_archiver::compress(const std::string& filepath)
+{
+    std::string gzpath  = filepath + ".gz";
+    std::string tmppath = gzpath + ".tmp";
+    FILE* in = fopen(filepath.data(), "rb");
+    if(!in) return false; // 可能已经被清理
+
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", _level);
+    gzFile out = gzopen(tmppath.data(), mode);
+    if(!out)
+    {
+        fclose(in);
+        local_log_f("log_archiver open {} failed.", tmppath);
+        return false;
+    }
+
+    thread_local std::vector<char> buf(1024 * 1024);
+    bool ok = true;
+    while(size_t len = fread(buf.data(), 1, buf.size(), in))
+    {
+        if(!_running.load(std::memory_order_acquire) || gzwrite(out, buf.data(), (unsigned)len) != (int)len)
+        {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && !ferror(in);
+    fclose(in);
+    ok = gzclose(out) == Z_OK && ok;
+
+    std::error_code ec;
+    if(ok)
+    {
+        std::filesystem::rename(tmppath, gzpath, ec);
+        ok = !ec;
+    }
+    if(!ok)
+    {
+        std::filesystem::remove(tmppath, ec);
+        if(_running.load(std::memory_order_acquire))
+        {
+            local_log_f("log_archiver compress {} failed.", filepath);
+        }
+        return false;
+    }
+    std::filesystem::remove(filepath, ec);
+    return true;
+}
+
+void log_archiver::clean()
+{
+    if(_retention_bytes == 0 && _retention_seconds == 0) return;
+
+    std::string curpath;
+    {
+        std::unique_lock<bee::mutex> lock(_locker);
+        curpath = _curpath;
+    }
+
+    struct logfile
+    {
+        std::filesystem::file_time_type mtime;
+        std::string path;
+        size_t size;
+    };
+    std::vector<logfile> files;
+    size_t total = 0;
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(_filedir, ec))
+    {
+        bool compressed = false;
+        if(!entry.is_regular_file(ec) || !is_logfile(entry.path().filename().string(), compressed)) continue;
+        size_t size = entry.file_size(ec);
+        if(ec) continue;
+        total += size;
+        if(entry.path().string() == curpath) continue; // 正在写的文件只计入总大小
+        files.push_back({entry.last_write_time(ec), entry.path().string(), size});
+    }
+    std::sort(files.begin(), files.end(), [](const logfile& a, const logfile& b) { return a.mtime < b.mtime; });
+
+    auto expire = std::filesystem::file_time_type::clock::now() - std::chrono::seconds(_retention_seconds);
+    for(const auto& file : files)
+    {
+        bool expired = _retention_seconds > 0 && file.mtime < expire;
+        bool oversize = _retention_bytes > 0 && total > _retention_bytes;
+        if(!expired && !oversize) break; // 按时间排序，后面的更新
+        if(std::filesystem::remove(file.path, ec))
+        {
+            total -= file.size;
+            local_log_f("log_archiver remove {}, size:{}.", file.path, file.size);
+        }
+    }
+}
+
+} // namespace bee
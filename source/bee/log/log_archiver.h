@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+
+#include "lock.h"
+#include "types.h"
+
+namespace bee
+{
+
+/*
+ * 日志归档
+ * 1.file_appender切换文件后把关闭的旧文件交给归档线程，按配置压缩成.gz，写日志的线程不等待；
+ * 2.每处理完一个文件按保留天数和总大小清理最旧的归档，当前正在写的文件不会删除；
+ * 3.启动时把上次运行留下的未压缩文件重新加入队列，退出时队列里没处理完的留到下次。
+ */
+class log_archiver
+{
+public:
+    enum COMPRESS_TYPE
+    {
+        COMPRESS_NONE,
+        COMPRESS_GZIP,
+    };
+
+    // 读取section下的compress、compress_level、retention_mb、retention_days
+    log_archiver(std::string filedir, std::string filename, const std::string& section);
+    ~log_archiver();
+
+    FORCE_INLINE bool is_enabled() const { return _compress != COMPRESS_NONE || _retention_bytes > 0 || _retention_seconds > 0; }
+
+    void start(const std::string& curpath);
+    void stop();
+    void add(const std::string& closed_path, const std::string& curpath); // 切换文件后调用
+
+private:
+    void run();
+    bool is_logfile(const std::string& name, bool& compressed) const;
+    bool compress(const std::string& filepath);
+    void clean();
+
+private:
+    std::string _filedir;
+    std::string _filename;
+    COMPRESS_TYPE _compress = COMPRESS_NONE;
+    int _level = 6;
+    size_t _retention_bytes = 0;     // 0表示不限制
+    TIMETYPE _retention_seconds = 0; // 0表示不限制
+
+    std::atomic_bool _running = false;
+    bee::mutex _locker;
+    std::condition_variable_any _cond;
+    std::thread* _thread = nullptr;
+    std::deque<std::string> _files; // 等待压缩的文件
+    std::string _curpath;           // 正在写的文件
+    bool _clean = false;            // 有文件关闭，需要检查保留策略
+};
+
+} // namespace bee
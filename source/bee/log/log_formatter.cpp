@@ -1,154 +1,74 @@
 #include <cctype>
+#include <charconv>
 #include <cstdio>
-#include <functional>
+#include <ctime>
 #include <map>
-#include <sstream>
 #include <utility>
 
 #include "log_formatter.h"
-#include "systemtime.h"
 #include "macros.h"
+#include "octets.h"
 #include "log_event.h"
 
 namespace bee
 {
 
-class message_format_item : public log_formatter::format_item
+log_record::log_record(const log_event& event)
+    : process_name(event.process_name), filename(event.filename), line(event.line)
+    , timestamp(event.timestamp), threadid(event.threadid), fiberid(event.fiberid)
+    , elapse(event.elapse), content(event.content)
 {
-public:
-    message_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.content;
-    }
-};
-
-class loglevel_format_item : public log_formatter::format_item
-{
-public:
-    loglevel_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        switch(level)
-        {
-            case LOG_LEVEL::TRACE: { os << "TRACE"; } break;
-            case LOG_LEVEL::DEBUG: { os << "DEBUG"; } break;
-            case LOG_LEVEL::INFO:  { os << "INFO";  } break;
-            case LOG_LEVEL::WARN:  { os << "WARN";  } break;
-            case LOG_LEVEL::ERROR: { os << "ERROR"; } break;
-            case LOG_LEVEL::FATAL: { os << "FATAL"; } break;
-            default:{ os << "UNKNOWN"; } break;
-        }
-    }
-};
-
-class elapse_format_item : public log_formatter::format_item
-{
-public:
-    elapse_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.elapse;
-    }
-};
-
-class procname_format_item : public log_formatter::format_item
-{
-public:
-    procname_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.process_name;
-    }
-};
-
-class threadid_format_item : public log_formatter::format_item
-{
-public:
-    threadid_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.threadid;
-    }
-};
-
-class fiberid_format_item : public log_formatter::format_item
-{
-public:
-    fiberid_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.fiberid;
-    }
-};
-
-class datetime_format_item : public log_formatter::format_item
-{
-public:
-    datetime_format_item(const std::string& fmt = "%Y-%m-%d %H:%M:%S") : _fmt(fmt) {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << systemtime::format_time(event.timestamp, _fmt.data());
-    }
-private:
-    std::string _fmt;
-};
+}
 
-class filename_format_item : public log_formatter::format_item
+static FORCE_INLINE void append_view(octets& buf, std::string_view view)
 {
-public:
-    filename_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.filename;
-    }
-};
+    buf.append(view.data(), view.size());
+}
 
-class line_format_item : public log_formatter::format_item
+template<typename T>
+static FORCE_INLINE void append_integer(octets& buf, T value)
 {
-public:
-    line_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
-    {
-        os << event.line;
-    }
-};
+    char tmp[24];
+    auto [end, ec] = std::to_chars(tmp, tmp + sizeof(tmp), value);
+    buf.append(tmp, end - tmp);
+}
 
-class newline_format_item : public log_formatter::format_item
+static FORCE_INLINE std::string_view loglevel_name(LOG_LEVEL level)
 {
-public:
-    newline_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
+    switch(level)
     {
-        os << std::endl;
+        case LOG_LEVEL::TRACE: return "TRACE";
+        case LOG_LEVEL::DEBUG: return "DEBUG";
+        case LOG_LEVEL::INFO:  return "INFO";
+        case LOG_LEVEL::WARN:  return "WARN";
+        case LOG_LEVEL::ERROR: return "ERROR";
+        case LOG_LEVEL::FATAL: return "FATAL";
+        default: return "UNKNOWN";
     }
-};
+}
 
-class string_format_item : public log_formatter::format_item
+// 每个线程缓存上一次格式化的秒，日志的时间戳是秒级的，同一秒内直接复制
+static void append_datetime(octets& buf, const std::string& fmt, uint64_t timestamp)
 {
-public:
-    string_format_item(const std::string& str) : _str(str) {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
+    thread_local struct
     {
-        os << _str;
-    }
-private:
-    std::string _str;
-};
+        std::string fmt;
+        uint64_t timestamp = 0;
+        size_t len = 0;
+        char str[64];
+    } cache;
 
-class tab_format_item : public log_formatter::format_item
-{
-public:
-    tab_format_item(const std::string& str = "") {}
-    void format(std::ostream& os, LOG_LEVEL level, const log_event& event) override
+    if(cache.timestamp != timestamp || cache.fmt != fmt)
     {
-        os << "\t";
+        time_t t = timestamp;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        cache.len = ::strftime(cache.str, sizeof(cache.str), fmt.data(), &tm);
+        cache.fmt.assign(fmt);
+        cache.timestamp = timestamp;
     }
-private:
-    std::string m_string;
-};
-
-
+    buf.append(cache.str, cache.len);
+}
 
 /**
  * @description: 
@@ -259,59 +179,85 @@ log_formatter::log_formatter(const std::string pattern)
     {
         vec.emplace_back(nstr, "", true);
     }
-    static std::map<std::string, std::function<format_item*(const std::string&)>> format_items_creators =
+    static const std::map<std::string, OP_TYPE> op_types =
     {
-    #define creator(str, C) \
-        { #str, [](const std::string& fmt) { return (format_item*)(new C(fmt)); } }
-    
-        creator(m, message_format_item),
-        creator(p, loglevel_format_item),
-        creator(r, elapse_format_item),
-        creator(c, procname_format_item),
-        creator(t, threadid_format_item),
-        creator(n, newline_format_item),
-        creator(d, datetime_format_item),
-        creator(f, filename_format_item),
-        creator(l, line_format_item),
-        creator(T, tab_format_item),
-        creator(F, fiberid_format_item)
-    #undef creator
+        { "m", OP_MESSAGE },
+        { "p", OP_LEVEL },
+        { "r", OP_ELAPSE },
+        { "c", OP_PROCNAME },
+        { "t", OP_THREADID },
+        { "d", OP_DATETIME },
+        { "f", OP_FILENAME },
+        { "l", OP_LINE },
+        { "F", OP_FIBERID },
     };
 
     for(auto& [key, fmt, isstr] : vec)
     {
         if(isstr)
         {
-            _items.push_back(new string_format_item(key));
+            add_op(OP_TEXT, key);
+        }
+        else if(key == "n")
+        {
+            add_op(OP_TEXT, "\n");
+        }
+        else if(key == "T")
+        {
+            add_op(OP_TEXT, "\t");
+        }
+        else if(auto iter = op_types.find(key); iter == op_types.end())
+        {
+            add_op(OP_TEXT, "<<error_format %" + key + ">>");
+            _error = true;
+        }
+        else if(iter->second == OP_DATETIME)
+        {
+            add_op(OP_DATETIME, fmt.empty() ? "%Y-%m-%d %H:%M:%S" : fmt);
         }
         else
         {
-            if(auto iter = format_items_creators.find(key); iter == format_items_creators.end())
-            {
-                _items.push_back(new string_format_item("<<error_format %" + key + ">>"));
-                _error = true;
-            }
-            else
-            {
-                _items.push_back(iter->second(fmt));
-            }
+            add_op(iter->second);
         }
+    }
+}
 
-        printf("(%s-%s-%s)\n", key.data(), fmt.data(), expr2boolstr(isstr));
+void log_formatter::add_op(OP_TYPE type, const std::string& arg)
+{
+    if(type == OP_TEXT && !_ops.empty() && _ops.back().type == OP_TEXT)
+    {
+        _ops.back().arg.append(arg); // 相邻的常量文本合并成一次追加
+        return;
     }
-    printf("format_items size:%zu\n", _items.size());
+    _ops.push_back({type, arg});
 }
 
-std::string log_formatter::format(LOG_LEVEL level, const log_event& event)
+void log_formatter::format(octets& buf, LOG_LEVEL level, const log_record& record) const
 {
-    thread_local std::stringstream os;
-    os.str("");
-    os.clear();
-    for(format_item* item : _items)
+    for(const format_op& op : _ops)
     {
-        item->format(os, level, event);
+        switch(op.type)
+        {
+            case OP_TEXT:     { buf.append(op.arg.data(), op.arg.size());          } break;
+            case OP_MESSAGE:  { append_view(buf, record.content);                  } break;
+            case OP_LEVEL:    { append_view(buf, loglevel_name(level));            } break;
+            case OP_ELAPSE:   { append_view(buf, record.elapse);                   } break;
+            case OP_PROCNAME: { append_view(buf, record.process_name);             } break;
+            case OP_THREADID: { append_integer(buf, record.threadid);              } break;
+            case OP_DATETIME: { append_datetime(buf, op.arg, record.timestamp);    } break;
+            case OP_FILENAME: { append_view(buf, record.filename);                 } break;
+            case OP_LINE:     { append_integer(buf, record.line);                  } break;
+            case OP_FIBERID:  { append_integer(buf, record.fiberid);               } break;
+        }
     }
-    return os.str();
 }
 
-}
\ No newline at end of file
+std::string log_formatter::format(LOG_LEVEL level, const log_event& event) const
+{
+    thread_local octets buf;
+    buf.clear();
+    format(buf, level, log_record(event));
+    return std::string(buf.data(), buf.size());
+}
+
+}
@@ -1,30 +1,70 @@
 #pragma once
+#include <stdint.h>
 #include <vector>
-#include <iosfwd>
 #include <string>
+#include <string_view>
 
 #include "glog.h"
 
 namespace bee
 {
 class log_event;
+class octets;
 
-// 日志格式化器
+// 格式化用的日志记录，字段都指向调用方的内存，不复制
+struct log_record
+{
+    log_record() = default;
+    log_record(const log_event& event);
+
+    std::string_view process_name;
+    std::string_view filename;
+    uint16_t line = 0;
+    uint64_t timestamp = 0;
+    uint32_t threadid = 0;
+    uint32_t fiberid = 0;
+    std::string_view elapse;
+    std::string_view content;
+};
+
+/*
+ * 日志格式化器
+ * pattern在构造时编译成一串扁平的操作，相邻的常量文本合并成一段；
+ * 格式化时按顺序直接追加到调用方提供的缓冲区，不经过iostream，也不产生临时字符串，
+ * 同一秒内的日期只用strftime格式化一次。
+ */
 class log_formatter
 {
 public:
     log_formatter(const std::string pattern);
-    std::string format(LOG_LEVEL level, const log_event& event);
-    class format_item
+    void format(octets& buf, LOG_LEVEL level, const log_record& record) const;
+    std::string format(LOG_LEVEL level, const log_event& event) const; // 返回字符串，每次都会分配
+
+private:
+    enum OP_TYPE : uint8_t
+    {
+        OP_TEXT,     // 常量文本，包括%n和%T
+        OP_MESSAGE,  // %m
+        OP_LEVEL,    // %p
+        OP_ELAPSE,   // %r
+        OP_PROCNAME, // %c
+        OP_THREADID, // %t
+        OP_DATETIME, // %d{fmt}
+        OP_FILENAME, // %f
+        OP_LINE,     // %l
+        OP_FIBERID,  // %F
+    };
+    struct format_op
     {
-    public:
-        virtual void format(std::ostream& os, LOG_LEVEL level, const log_event& event) = 0;
+        OP_TYPE type;
+        std::string arg; // 常量文本或者日期格式
     };
+    void add_op(OP_TYPE type, const std::string& arg = "");
 
 private:
     bool _error = false;
     std::string _pattern;
-    std::vector<format_item*> _items;
+    std::vector<format_op> _ops;
 };
 
-}
\ No newline at end of file
+}
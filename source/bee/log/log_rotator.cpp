@@ -1,16 +1,24 @@
 #include "log_rotator.h"
 #include "log_appender.h"
+#include "config.h"
 #include "reactor.h"
 #include <filesystem>
 
 namespace bee
 {
 
-time_log_rotator::time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type)
-    : log_rotator(appender), _rotate_type(rotate_type)
+log_rotator::~log_rotator()
 {
-    check_rotate();
-    _check_rotate_timerid = add_timer(10*1000, [this]()
+    if(_check_rotate_timerid >= 0)
+    {
+        del_timer(_check_rotate_timerid);
+        _check_rotate_timerid = -1;
+    }
+}
+
+void log_rotator::start_timer(TIMETYPE interval)
+{
+    _check_rotate_timerid = add_timer(interval, [this]()
     {
         if(check_rotate())
         {
@@ -20,12 +28,39 @@ time_log_rotator::time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE
     });
 }
 
-time_log_rotator::~time_log_rotator()
+log_rotator* log_rotator::create(rotatable_log_appender* appender, const std::string& section)
 {
-    if(_check_rotate_timerid >= 0)
+    auto cfg = config::get_instance();
+    std::string rotate = cfg->get(section, "rotate", std::string("day"));
+    size_t threshold = (size_t)cfg->get<int>(section, "rotate_size", 0) * 1024 * 1024;
+    if(rotate == "size")
     {
-        del_timer(_check_rotate_timerid);
-        _check_rotate_timerid = -1;
+        return new size_log_rotator(appender, threshold > 0 ? threshold : (size_t)1024 * 1024 * 1024);
+    }
+
+    auto rotate_type = time_log_rotator::ROTATE_TYPE_DAY;
+    if(rotate == "hour")
+    {
+        rotate_type = time_log_rotator::ROTATE_TYPE_HOUR;
+    }
+    else if(rotate != "day")
+    {
+        printf("unknown rotate type:%s, rotate by day\n", rotate.data());
+    }
+    if(threshold > 0)
+    {
+        return new size_time_log_rotator(appender, rotate_type, threshold);
+    }
+    return new time_log_rotator(appender, rotate_type);
+}
+
+time_log_rotator::time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type, TIMETYPE check_interval)
+    : log_rotator(appender), _rotate_type(rotate_type)
+{
+    check_rotate();
+    if(check_interval > 0)
+    {
+        start_timer(check_interval);
     }
 }
 
@@ -78,42 +113,96 @@ bool time_log_rotator::check_rotate()
 size_log_rotator::size_log_rotator(rotatable_log_appender* appender, size_t threshold)
     : log_rotator(appender), _threshold(threshold)
 {
-    check_rotate();
+    // 按yyyymmddhhmmss命名，每秒检查一次大小
+    _suffix = systemtime::format_time(systemtime::get_time(), "%Y%m%d%H%M%S");
+    start_timer(1000);
 }
 
-size_log_rotator::~size_log_rotator()
+bool size_log_rotator::check_rotate()
 {
-    if(_check_rotate_timerid >= 0)
+    auto* appender = dynamic_cast<file_appender*>(_appender);
+    if(!appender || appender->get_filesize() < _threshold) return false;
+
+    std::string suffix = systemtime::format_time(systemtime::get_time(), "%Y%m%d%H%M%S");
+    if(suffix == _suffix) return false; // 同一秒内不重复分割
+    _pre_suffix = _suffix;
+    _suffix = suffix;
+    return true;
+}
+
+size_time_log_rotator::size_time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type, size_t threshold)
+    : time_log_rotator(appender, rotate_type, 0), _threshold(threshold)
+{
+    _period = _suffix;
+    update_suffix(true);
+    start_timer(1000); // 构造完成后再启动，定时器里会调用派生类的check_rotate
+}
+
+bool size_time_log_rotator::check_rotate()
+{
+    std::string pre_suffix = _suffix;
+    if(time_log_rotator::check_rotate()) // 进入新的时段
     {
-        del_timer(_check_rotate_timerid);
-        _check_rotate_timerid = -1;
+        _period = _suffix;
+        update_suffix(true);
+    }
+    else
+    {
+        auto* appender = dynamic_cast<file_appender*>(_appender);
+        if(!appender || appender->get_filesize() < _threshold) return false;
+        update_suffix(false);
     }
+    _pre_suffix = pre_suffix;
+    return true;
 }
 
-bool size_log_rotator::check_rotate()
+void size_time_log_rotator::update_suffix(bool reuse)
 {
+    // 在目录里找当前时段已有的最大序号：name.period.log为0，name.period.N.log为N，可能已经压缩成.gz
+    size_t last = 0;
+    bool found = false;
+    bool plain = false; // 最大序号的文件还没有压缩
     if(auto* appender = dynamic_cast<file_appender*>(_appender))
     {
-        std::string filepath = appender->get_filepath();
-        if(std::filesystem::exists(filepath) && std::filesystem::is_regular_file(filepath))
+        std::filesystem::path base = appender->make_filepath(_period);
+        std::string dir = base.parent_path().string();
+        std::string prefix = base.filename().string();
+        prefix.resize(prefix.size() - base.extension().string().size()); // name.period
+
+        std::error_code ec;
+        for(const auto& entry : std::filesystem::directory_iterator(dir.empty() ? "." : dir, ec))
         {
-            if(std::filesystem::file_size(filepath) >= _threshold)
+            std::string name = entry.path().filename().string();
+            if(name.compare(0, prefix.size(), prefix) != 0) continue;
+            std::string_view rest = std::string_view(name).substr(prefix.size());
+            bool gz = rest.ends_with(".gz");
+            if(gz) rest.remove_suffix(3);
+            if(!rest.ends_with(".log")) continue;
+            rest.remove_suffix(4);
+
+            size_t index = 0;
+            if(!rest.empty())
+            {
+                if(rest[0] != '.' || rest.size() == 1) continue;
+                rest.remove_prefix(1);
+                if(rest.find_first_not_of("0123456789") != std::string_view::npos) continue;
+                for(char c : rest) index = index * 10 + (c - '0');
+            }
+            if(!found || index > last)
             {
-                TIMETYPE curtime = systemtime::get_time();
-                if(_suffix.size())
-                {
-                    _pre_suffix = _suffix;
-                }
-                else
-                {
-                    _pre_suffix = systemtime::format_time(curtime - ONEHOUR, "%Y%m%d%H%M%S");
-                }
-                _suffix = systemtime::format_time(curtime, "%Y%m%d%H%M%S");
-                return true;
+                last = index;
+                found = true;
+                plain = !gz;
+            }
+            else if(index == last && !gz)
+            {
+                plain = true;
             }
         }
     }
-    return false;
+
+    _index = !found ? 0 : (reuse && plain ? last : last + 1);
+    _suffix = _index > 0 ? _period + "." + std::to_string(_index) : _period;
 }
 
-} // namespace bee
\ No newline at end of file
+} // namespace bee
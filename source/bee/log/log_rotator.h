@@ -13,11 +13,21 @@ class log_rotator
 public:
     log_rotator(rotatable_log_appender* appender)
         : _appender(appender) {}
-    virtual ~log_rotator() = default;
+    virtual ~log_rotator();
     virtual bool check_rotate() = 0;
     virtual std::string get_pre_suffix() const { return _pre_suffix; }
     virtual std::string get_suffix() const { return _suffix; }
 
+    /*
+     * 按配置创建rotator
+     * rotate = hour | day | size，rotate_size单位MB
+     * hour/day时rotate_size大于0则同一时段内超过大小也分割
+     */
+    static log_rotator* create(rotatable_log_appender* appender, const std::string& section);
+
+protected:
+    void start_timer(TIMETYPE interval/*ms*/); // 定时检查，需要时调用appender的rotate
+
 protected:
     rotatable_log_appender* _appender = nullptr;
     TIMERID _check_rotate_timerid = -1;
@@ -35,11 +45,10 @@ public:
         ROTATE_TYPE_DAY,  // 按自然日分割日志
     };
 
-    time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type);
-    virtual ~time_log_rotator() override;
+    time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type, TIMETYPE check_interval = 10*1000); // 0表示由派生类启动定时器
     virtual bool check_rotate() override;
 
-private:
+protected:
     ROTATE_TYPE _rotate_type;
     TIMETYPE    _next_rotate_time = 0; // 下一次分割日志的时间
 };
@@ -49,11 +58,30 @@ class size_log_rotator : public log_rotator
 {
 public:
     size_log_rotator(rotatable_log_appender* appender, size_t threshold);
-    virtual ~size_log_rotator() override;
     virtual bool check_rotate() override;
 
 private:
     size_t _threshold = 0;
 };
 
-} // namespace bee
\ No newline at end of file
+/*
+ * 按时间分割的同时限制单个文件大小
+ * 文件名后缀是 时段 或 时段.序号，如yyyymmdd、yyyymmdd.1、yyyymmdd.2，
+ * 重启后接着写当前时段最后一个没有压缩的文件
+ */
+class size_time_log_rotator : public time_log_rotator
+{
+public:
+    size_time_log_rotator(rotatable_log_appender* appender, ROTATE_TYPE rotate_type, size_t threshold);
+    virtual bool check_rotate() override;
+
+private:
+    void update_suffix(bool reuse); // reuse为true时可以继续写已有的未压缩文件
+
+private:
+    size_t _threshold = 0;
+    std::string _period; // 当前时段
+    size_t _index = 0;    // 当前时段内的文件序号
+};
+
+} // namespace bee
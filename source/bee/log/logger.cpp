@@ -27,6 +27,15 @@ void logger::log(LOG_LEVEL level, const log_event& event)
     }
 }
 
+void logger::log(const LOG_LEVEL* levels, const log_event* events, size_t count)
+{
+    _root_appender->log(levels, events, count, _loglevel);
+    for(const auto& [_, appender] : _appenders)
+    {
+        appender->log(levels, events, count, _loglevel);
+    }
+}
+
 log_appender* logger::get_appender(const std::string& name)
 {
     auto iter = _appenders.find(name);
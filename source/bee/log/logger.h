@@ -15,6 +15,7 @@ public:
     logger(LOG_LEVEL level, log_appender* appender);
     ~logger();
     void log(LOG_LEVEL level, const log_event& event);
+    void log(const LOG_LEVEL* levels, const log_event* events, size_t count);
 
     log_appender* get_appender(const std::string& name);
     bool add_appender(const std::string& name, log_appender* appender);
@@ -0,0 +1,42 @@
+#pragma once
+#include "metric_collector.h"
+#include "threadpool.h"
+#include <string>
+
+namespace bee
+{
+
+// 线程池高优先级通道的排队深度和等待时间，global是全局通道，groupN是各组的通道
+class threadpool_collector : public metric_collector
+{
+public:
+    threadpool_collector() : metric_collector("threadpool")
+    {
+        set_interval(1000); // 1秒采集一次
+    }
+
+protected:
+    virtual void collect_impl(influx_metric& metric) override
+    {
+        auto pool = threadpool::get_instance();
+        metric.add_tag("lane", "essential");
+        add_lane(metric, "global", pool->get_essential_stats(-1));
+        for(size_t i = 0; i < pool->group_count(); ++i)
+        {
+            add_lane(metric, "group" + std::to_string(i), pool->get_essential_stats((int)i));
+        }
+    }
+
+private:
+    void add_lane(influx_metric& metric, const std::string& prefix, const essential_lane::stats& stats)
+    {
+        metric.add_field(prefix + "_depth", (uint64_t)stats.depth);
+        metric.add_field(prefix + "_pushed", stats.pushed);
+        metric.add_field(prefix + "_executed", stats.executed);
+        metric.add_field(prefix + "_dropped", stats.dropped);
+        metric.add_field(prefix + "_wait_avg_us", (int64_t)stats.wait_avg_us);
+        metric.add_field(prefix + "_wait_max_us", (int64_t)stats.wait_max_us);
+    }
+};
+
+} // namespace bee
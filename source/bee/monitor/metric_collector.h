@@ -1,7 +1,7 @@
 #pragma once
 #include <functional>
 #include "monitor.h"
-#include "systemtime.h"
+#include "cached_clock.h"
 #include "types.h"
 #include "metric.h"
 
@@ -27,12 +27,12 @@ public:
     // 收集数据到指标
     void collect(metric& metric)
     {
-        auto [millseconds, nanoseconds] = systemtime::get_mill_nano_seconds();
+        TIMETYPE millseconds = cached_clock::get_monotonic_millseconds();
         if(millseconds < _last_collect_time + _interval) return;
 
         if(auto* influx_metric = dynamic_cast<bee::influx_metric*>(&metric))
         {
-            influx_metric->set_timestamp(nanoseconds);
+            influx_metric->set_timestamp(cached_clock::get_microseconds() * 1000); // influx要求unix纳秒时间戳
             collect_impl(*influx_metric);
         }
         else if(auto* prom_metric = dynamic_cast<bee::prometheus_metric*>(&metric))
@@ -14,6 +14,7 @@
 #include "reactor.h"
 #ifdef _REENTRANT
 #include "threadpool.h"
+#include "threadpool_collector.h"
 #endif
 
 namespace bee
@@ -65,6 +66,12 @@ void monitor_engine::init()
         {
             register_collector(new net_collector);
         }
+    #ifdef _REENTRANT
+        else if(collector_name == "threadpool")
+        {
+            register_collector(new threadpool_collector);
+        }
+    #endif
     }
 }
     
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "types.h"
+
+namespace bee
+{
+
+/*
+ * Chase-Lev工作窃取双端队列（参照Lê等人的C11内存模型版本）
+ * 1.只有所属线程调用push/pop，从底部进出，后进先出，缓存更热；
+ * 2.其他线程调用steal从顶部偷，先进先出，和所属线程只在最后一个元素上竞争；
+ * 3.元素必须能原子读写，一般存指针；扩容后的旧数组留到析构时释放，窃取者可能还在读。
+ */
+template<typename T>
+class chase_lev_deque
+{
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(void*), "chase_lev_deque element must be pointer-like");
+
+public:
+    explicit chase_lev_deque(size_t capacity = 256)
+    {
+        size_t cap = 1;
+        while(cap < capacity) cap <<= 1;
+        _array.store(new ring(cap), std::memory_order_relaxed);
+    }
+
+    ~chase_lev_deque()
+    {
+        delete _array.load(std::memory_order_relaxed);
+        for(ring* old : _retired) delete old;
+    }
+
+    chase_lev_deque(const chase_lev_deque&) = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    // 所属线程调用
+    void push(T value)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_acquire);
+        ring* array = _array.load(std::memory_order_relaxed);
+        if(bottom - top > static_cast<int64_t>(array->capacity) - 1)
+        {
+            array = grow(array, top, bottom);
+        }
+        array->put(bottom, value);
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // 所属线程调用，队列为空返回false
+    bool pop(T& value)
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        ring* array = _array.load(std::memory_order_relaxed);
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+
+        if(top > bottom) // 空
+        {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        value = array->get(bottom);
+        if(top == bottom) // 最后一个元素，和窃取者竞争
+        {
+            bool won = _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用，队列为空或者竞争失败返回false
+    bool steal(T& value)
+    {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = _bottom.load(std::memory_order_acquire);
+        if(top >= bottom) return false;
+
+        ring* array = _array.load(std::memory_order_consume);
+        value = array->get(top);
+        return _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    FORCE_INLINE size_t size() const
+    {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+    FORCE_INLINE bool empty() const { return size() == 0; }
+
+private:
+    struct ring
+    {
+        explicit ring(size_t cap) : capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap]) {}
+        ~ring() { delete[] slots; }
+
+        FORCE_INLINE T get(int64_t idx) const { return slots[idx & mask].load(std::memory_order_relaxed); }
+        FORCE_INLINE void put(int64_t idx, T value) { slots[idx & mask].store(value, std::memory_order_relaxed); }
+
+        const size_t capacity;
+        const size_t mask;
+        std::atomic<T>* slots;
+    };
+
+    ring* grow(ring* array, int64_t top, int64_t bottom)
+    {
+        ring* bigger = new ring(array->capacity * 2);
+        for(int64_t i = top; i < bottom; ++i)
+        {
+            bigger->put(i, array->get(i));
+        }
+        _retired.push_back(array);
+        _array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    ALIGN_CACHELINE_SIZE std::atomic<int64_t> _top = 0;
+    ALIGN_CACHELINE_SIZE std::atomic<int64_t> _bottom = 0;
+    std::atomic<ring*> _array = nullptr;
+    std::vector<ring*> _retired; // 只有所属线程会扩容
+};
+
+} // namespace bee
@@ -0,0 +1,211 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "glog.h"
+#include "objectpool.h"
+#include "reactor.h"
+#include "types.h"
+#ifdef _REENTRANT
+#include "threadpool.h"
+#endif
+
+namespace bee
+{
+
+/*
+ * 协程任务，把多步的异步流程写成顺序代码
+ * 1.惰性启动：task被co_await或者co_spawn之后才开始执行，子任务结束后对称转移回调用方，不占用栈；
+ * 2.协程在哪个线程被唤醒就在哪个线程继续执行，rpc回应、http回调都是直接在工作线程上恢复，不会再多切一次线程；
+ * 3.协程帧走线程缓存池分配，不再为每次回调构造std::function。
+ *
+ * task<void> handle_login(...)
+ * {
+ *     auto res = co_await rpc_call<ExampleRPC>(arg, manager, sid);
+ *     if(!res) co_return;
+ *     co_await sleep_for(100);
+ *     co_await switch_to(1);
+ * }
+ * co_spawn(handle_login(...));
+ */
+template<typename T = void>
+class task;
+
+namespace detail
+{
+
+struct promise_base
+{
+    static void* operator new(size_t size) { return thread_cached_pool::alloc(size); }
+    static void operator delete(void* ptr) { thread_cached_pool::free(ptr); }
+
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename promise_type>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+        {
+            promise_base& promise = handle.promise();
+            if(promise._continuation) return promise._continuation; // 对称转移回等待方
+            if(promise._detached)
+            {
+                if(promise._exception)
+                {
+                    local_log("detached coroutine exit with exception!!!");
+                }
+                handle.destroy(); // 没有人等待，自己释放协程帧
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { _exception = std::current_exception(); }
+
+    void rethrow_if_exception()
+    {
+        if(_exception) std::rethrow_exception(_exception);
+    }
+
+    std::coroutine_handle<> _continuation;
+    std::exception_ptr _exception;
+    bool _detached = false;
+};
+
+template<typename T>
+struct promise : promise_base
+{
+    template<typename U>
+    void return_value(U&& value) { _value.emplace(std::forward<U>(value)); }
+
+    T take_result()
+    {
+        rethrow_if_exception();
+        return std::move(*_value);
+    }
+
+    std::optional<T> _value;
+};
+
+template<>
+struct promise<void> : promise_base
+{
+    void return_void() const noexcept {}
+    void take_result() { rethrow_if_exception(); }
+};
+
+} // namespace detail
+
+template<typename T>
+class [[nodiscard]] task
+{
+public:
+    struct promise_type : detail::promise<T>
+    {
+        task get_return_object() noexcept { return task(handle_type::from_promise(*this)); }
+    };
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() = default;
+    task(task&& rhs) noexcept : _handle(std::exchange(rhs._handle, nullptr)) {}
+    task& operator=(task&& rhs) noexcept
+    {
+        if(&rhs != this)
+        {
+            if(_handle) _handle.destroy();
+            _handle = std::exchange(rhs._handle, nullptr);
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() { if(_handle) _handle.destroy(); }
+
+    struct awaiter
+    {
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            handle.promise()._continuation = continuation;
+            return handle;
+        }
+        T await_resume() { return handle.promise().take_result(); }
+
+        handle_type handle;
+    };
+    awaiter operator co_await() && noexcept { return awaiter{_handle}; }
+
+    // 开始执行并放弃所有权，协程结束后自己释放
+    void detach()
+    {
+        handle_type handle = std::exchange(_handle, nullptr);
+        if(!handle) return;
+        handle.promise()._detached = true;
+        handle.resume();
+    }
+
+    FORCE_INLINE bool done() const { return !_handle || _handle.done(); }
+
+private:
+    explicit task(handle_type handle) : _handle(handle) {}
+
+    handle_type _handle;
+};
+
+// 在当前线程启动一个顶层协程，不等待它的结果
+inline void co_spawn(task<void>&& t)
+{
+    t.detach();
+}
+
+// 切换到线程池的指定组继续执行，单线程版本直接继续
+class switch_to
+{
+public:
+    explicit switch_to(int groupidx) : _groupidx(groupidx) {}
+
+#ifdef _REENTRANT
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        // 协程已经挂起，恢复它的任务不能因为队列满被丢弃
+        threadpool::get_instance()->add_task(_groupidx, inline_task([handle]{ handle.resume(); }), true);
+    }
+#else
+    bool await_ready() const noexcept { return true; }
+    void await_suspend(std::coroutine_handle<>) {}
+#endif
+    void await_resume() const noexcept {}
+
+private:
+    int _groupidx = 0;
+};
+
+// 挂起指定毫秒数，在定时器线程或者定时器所属的reactor线程上恢复，后面的逻辑比较重时再co_await switch_to切回工作线程
+class sleep_for
+{
+public:
+    explicit sleep_for(TIMETYPE millseconds) : _millseconds(millseconds) {}
+
+    bool await_ready() const noexcept { return _millseconds <= 0; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        add_timer(_millseconds, [handle]()
+        {
+            handle.resume();
+            return false;
+        });
+    }
+    void await_resume() const noexcept {}
+
+private:
+    TIMETYPE _millseconds = 0;
+};
+
+} // namespace bee
@@ -49,6 +49,19 @@ public:
         printf("one_reader_double_buffer write _writeidx=%d write size=%zu\n", _writeidx, write_buf.size());
     }
 
+    // 批量写入，只加一次锁
+    template<typename iterator>
+    void write(iterator first, iterator last)
+    {
+        lock_guard l(_locker);
+        auto& write_buf = _buffer[_writeidx];
+        for(; first != last; ++first)
+        {
+            write_buf.insert(std::cend(write_buf), *first);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
 private:
     uint8_t _writeidx = 0;
 #if DOUBLE_BUFFER_USE_ATOMIC_FLAG_LOCK
@@ -0,0 +1,148 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "runnable.h"
+#include "types.h"
+
+namespace bee
+{
+
+/*
+ * 只能移动的任务类型，闭包不超过INLINE_SIZE时直接存在对象内部，不再额外分配内存
+ * 1.runnable*只保存指针，执行后调用destroy()，协议等已有的runnable走这条路径；
+ * 2.闭包超过INLINE_SIZE或者移动构造可能抛异常时才退化成堆上分配；
+ * 3.sizeof(inline_task)正好一个缓存行，队列按值存放。
+ */
+class inline_task
+{
+public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+    inline_task() = default;
+    inline_task(runnable* task) : _ops(task ? &runnable_ops : nullptr)
+    {
+        ::new (_storage) runnable*(task);
+    }
+
+    template<typename F>
+        requires (!std::same_as<std::remove_cvref_t<F>, inline_task>) &&
+                 (!std::convertible_to<F, runnable*>) &&
+                 std::invocable<std::decay_t<F>&>
+    inline_task(F&& func)
+    {
+        using functor = std::decay_t<F>;
+        if constexpr(is_inline<functor>)
+        {
+            ::new (_storage) functor(std::forward<F>(func));
+            _ops = &inline_ops<functor>;
+        }
+        else
+        {
+            ::new (_storage) functor*(new functor(std::forward<F>(func)));
+            _ops = &boxed_ops<functor>;
+        }
+    }
+
+    inline_task(inline_task&& rhs) noexcept
+    {
+        if(rhs._ops)
+        {
+            rhs._ops->move(_storage, rhs._storage);
+            _ops = std::exchange(rhs._ops, nullptr);
+        }
+    }
+
+    inline_task& operator=(inline_task&& rhs) noexcept
+    {
+        if(&rhs != this)
+        {
+            reset();
+            if(rhs._ops)
+            {
+                rhs._ops->move(_storage, rhs._storage);
+                _ops = std::exchange(rhs._ops, nullptr);
+            }
+        }
+        return *this;
+    }
+
+    inline_task(const inline_task&) = delete;
+    inline_task& operator=(const inline_task&) = delete;
+
+    ~inline_task() { reset(); }
+
+    FORCE_INLINE void operator()() { _ops->invoke(_storage); }
+    FORCE_INLINE explicit operator bool() const { return _ops != nullptr; }
+
+    // 释放任务持有的资源，runnable调用destroy()
+    void reset()
+    {
+        if(_ops)
+        {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+    // 只对按runnable*构造的任务有效，其他情况返回nullptr
+    FORCE_INLINE runnable* get_runnable() const
+    {
+        return _ops == &runnable_ops ? *std::launder(reinterpret_cast<runnable* const*>(_storage)) : nullptr;
+    }
+
+private:
+    struct ops_type
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src); // 移动到dst并析构src
+        void (*destroy)(void* storage);
+    };
+
+    template<typename T>
+    static T* as(void* storage) { return std::launder(reinterpret_cast<T*>(storage)); }
+
+    template<typename functor>
+    static constexpr bool is_inline = sizeof(functor) <= INLINE_SIZE &&
+                                      alignof(functor) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible_v<functor>;
+
+    static constexpr ops_type runnable_ops =
+    {
+        [](void* storage) { (*as<runnable*>(storage))->run(); },
+        [](void* dst, void* src) { ::new (dst) runnable*(*as<runnable*>(src)); },
+        [](void* storage) { (*as<runnable*>(storage))->destroy(); },
+    };
+
+    template<typename functor>
+    static constexpr ops_type inline_ops =
+    {
+        [](void* storage) { (*as<functor>(storage))(); },
+        [](void* dst, void* src)
+        {
+            functor* f = as<functor>(src);
+            ::new (dst) functor(std::move(*f));
+            f->~functor();
+        },
+        [](void* storage) { as<functor>(storage)->~functor(); },
+    };
+
+    template<typename functor>
+    static constexpr ops_type boxed_ops =
+    {
+        [](void* storage) { (**as<functor*>(storage))(); },
+        [](void* dst, void* src) { ::new (dst) functor*(*as<functor*>(src)); },
+        [](void* storage) { delete *as<functor*>(storage); },
+    };
+
+private:
+    alignas(std::max_align_t) unsigned char _storage[INLINE_SIZE];
+    const ops_type* _ops = nullptr;
+};
+
+static_assert(sizeof(inline_task) == 64);
+
+} // namespace bee
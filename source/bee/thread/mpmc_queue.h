@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "types.h"
+
+namespace bee
+{
+
+/*
+ * 有界多生产者多消费者无锁队列（Vyukov的环形数组实现）
+ * 1.每个槽位带一个序号，生产者和消费者各自CAS自己的位置，槽位序号判断能不能读写；
+ * 2.容量向上取整到2的幂，满了push返回false，由调用方决定丢弃还是重试；
+ * 3.元素按值存放，只要求能移动构造。
+ */
+template<typename T>
+class mpmc_queue
+{
+public:
+    explicit mpmc_queue(size_t capacity)
+        : _mask(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1)
+        , _cells(new cell[_mask + 1])
+    {
+        for(size_t i = 0; i <= _mask; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~mpmc_queue()
+    {
+        T value;
+        while(pop(value)) {}
+        delete[] _cells;
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    bool push(T&& value)
+    {
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        cell* c = nullptr;
+        while(true)
+        {
+            c = &_cells[pos & _mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(diff < 0)
+            {
+                return false; // 满了
+            }
+            else
+            {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        ::new (c->storage) T(std::move(value));
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        cell* c = nullptr;
+        while(true)
+        {
+            c = &_cells[pos & _mask];
+            size_t seq = c->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if(diff < 0)
+            {
+                return false; // 空
+            }
+            else
+            {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        T* slot = std::launder(reinterpret_cast<T*>(c->storage));
+        value = std::move(*slot);
+        slot->~T();
+        c->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似值，只用于统计和判断是否可能有任务
+    FORCE_INLINE size_t size() const
+    {
+        size_t enqueue = _enqueue_pos.load(std::memory_order_seq_cst);
+        size_t dequeue = _dequeue_pos.load(std::memory_order_seq_cst);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+    FORCE_INLINE bool empty() const { return size() == 0; }
+    FORCE_INLINE size_t capacity() const { return _mask + 1; }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    const size_t _mask;
+    cell* const _cells;
+    ALIGN_CACHELINE_SIZE std::atomic<size_t> _enqueue_pos = 0;
+    ALIGN_CACHELINE_SIZE std::atomic<size_t> _dequeue_pos = 0;
+};
+
+} // namespace bee
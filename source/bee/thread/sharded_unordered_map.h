@@ -0,0 +1,116 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <unordered_map>
+#include "lock.h"
+#include "types.h"
+
+namespace bee
+{
+
+// 分片加锁的unordered_map，key按hash分散到SHARDS个分片，每个分片一把读写锁
+// 不同分片上的读写互不阻塞，适合key连续分配、读多写少的场景
+template<
+    typename Key,
+    typename T,
+    size_t SHARDS = 64,
+    typename Hash = std::hash<Key>,
+    typename lock_type = bee::rwlock
+>
+class sharded_unordered_map
+{
+    static_assert(SHARDS > 0 && (SHARDS & (SHARDS - 1)) == 0, "SHARDS must be power of 2");
+
+public:
+    using map_type = std::unordered_map<Key, T, Hash>;
+
+    bool emplace(const Key& key, const T& value)
+    {
+        auto& shard = get_shard(key);
+        typename lock_type::wrscoped l(shard.locker);
+        if(!shard.map.emplace(key, value).second) return false;
+        _size.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool erase(const Key& key)
+    {
+        auto& shard = get_shard(key);
+        typename lock_type::wrscoped l(shard.locker);
+        if(shard.map.erase(key) == 0) return false;
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    T get(const Key& key, const T& default_value = T{})
+    {
+        auto& shard = get_shard(key);
+        typename lock_type::rdscoped l(shard.locker);
+        auto iter = shard.map.find(key);
+        return iter != shard.map.end() ? iter->second : default_value;
+    }
+
+    bool contains(const Key& key)
+    {
+        auto& shard = get_shard(key);
+        typename lock_type::rdscoped l(shard.locker);
+        return shard.map.contains(key);
+    }
+
+    // 持有分片读锁执行func(value)，期间元素不会被删除，返回是否找到
+    template<typename Func>
+    bool apply(const Key& key, Func&& func)
+    {
+        auto& shard = get_shard(key);
+        typename lock_type::rdscoped l(shard.locker);
+        auto iter = shard.map.find(key);
+        if(iter == shard.map.end()) return false;
+        func(iter->second);
+        return true;
+    }
+
+    // 逐个分片加读锁遍历，不是全表快照
+    template<typename Func>
+    void for_each(Func&& func)
+    {
+        for(auto& shard : _shards)
+        {
+            typename lock_type::rdscoped l(shard.locker);
+            for(auto& [key, value] : shard.map)
+            {
+                func(key, value);
+            }
+        }
+    }
+
+    void clear()
+    {
+        for(auto& shard : _shards)
+        {
+            typename lock_type::wrscoped l(shard.locker);
+            _size.fetch_sub(shard.map.size(), std::memory_order_relaxed);
+            shard.map.clear();
+        }
+    }
+
+    FORCE_INLINE size_t size() const { return _size.load(std::memory_order_relaxed); }
+    FORCE_INLINE bool empty() const { return size() == 0; }
+
+private:
+    struct ALIGN_CACHELINE_SIZE shard_type
+    {
+        lock_type locker;
+        map_type map;
+    };
+
+    FORCE_INLINE shard_type& get_shard(const Key& key)
+    {
+        return _shards[Hash{}(key) & (SHARDS - 1)];
+    }
+
+private:
+    std::array<shard_type, SHARDS> _shards;
+    std::atomic<size_t> _size{0};
+};
+
+} // namespace bee
@@ -1,128 +1,584 @@
 #include <assert.h>
 #include <atomic>
+#include <bit>
 #include <bits/chrono.h>
+#include <linux/futex.h>
 #include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <utility>
 
 #include "threadpool.h"
+#include "chase_lev_deque.h"
+#include "objectpool.h"
 #include "runnable.h"
 #include "glog.h"
 #include "config.h"
-#include "randgen.h"
+#include "systemtime.h"
 
 namespace bee
 {
 
-thread_group::thread_group(size_t idx, size_t maxsize, size_t threadcnt)
-    : _idx(idx), _maxsize(maxsize), _threadcnt(threadcnt)
+struct thread_group::task_node
 {
+    static void* operator new(size_t size) { return thread_cached_pool::alloc(size); }
+    static void operator delete(void* ptr) { thread_cached_pool::free(ptr); }
+
+    inline_task task;
+    thread_group* group = nullptr; // 投递到的组，被其他组偷走后仍记在原来的组上
+    task_node* next = nullptr;
+};
+
+struct ALIGN_CACHELINE_SIZE thread_group::worker
+{
+    enum STATE : uint32_t
+    {
+        RUNNING,
+        PARKED,
+        NOTIFIED,
+    };
+
+    chase_lev_deque<task_node*> local;
+    ALIGN_CACHELINE_SIZE std::atomic<task_node*> inbox = nullptr; // 其他线程投递的任务，后进先出的栈，任何线程都可以整个取走
+    ALIGN_CACHELINE_SIZE std::atomic<uint32_t> state = RUNNING; // futex字
+    size_t index = 0;
+};
+
+struct ALIGN_CACHELINE_SIZE thread_group::serial_lane
+{
+    static constexpr size_t BATCH = 32; // 一次最多连续执行的任务数，执行完重新排队，让其他lane也有机会
+
+    void drain()
+    {
+        for(size_t i = 0; i < BATCH; ++i)
+        {
+            inline_task task;
+            {
+                spinlock::scoped l(locker);
+                if(queue.empty())
+                {
+                    scheduled = false;
+                    return;
+                }
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+            try
+            {
+                task();
+            }
+            catch(...)
+            {
+                local_log("serial task run throw exception!!!");
+            }
+        }
+        group->add_task(inline_task([this]{ drain(); }), true); // 已经在排队的任务不能丢
+    }
+
+    spinlock locker;
+    TASK_QUEUE queue;
+    bool scheduled = false; // drain任务是否已经投递
+    thread_group* group = nullptr;
+};
+
+static void run_task(inline_task& task)
+{
+    try
+    {
+        task();
+    }
+    catch(...)
+    {
+        local_log("thread_task run throw exception!!!");
+    }
+    task.reset();
+}
+
+bool essential_lane::push(inline_task&& task)
+{
+    item it{std::move(task), systemtime::get_microseconds()};
+    if(!_queue.push(std::move(it)))
+    {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _pushed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool essential_lane::pop(inline_task& task)
+{
+    item it;
+    if(!_queue.pop(it)) return false;
+
+    TIMETYPE wait = std::max<TIMETYPE>(systemtime::get_microseconds() - it.enqueue_time, 0);
+    _executed.fetch_add(1, std::memory_order_relaxed);
+    _wait_count.fetch_add(1, std::memory_order_relaxed);
+    _wait_total.fetch_add(wait, std::memory_order_relaxed);
+    TIMETYPE max = _wait_max.load(std::memory_order_relaxed);
+    while(wait > max && !_wait_max.compare_exchange_weak(max, wait, std::memory_order_relaxed));
+    task = std::move(it.task);
+    return true;
+}
+
+auto essential_lane::get_stats() -> stats
+{
+    stats s;
+    s.depth = _queue.size();
+    s.pushed = _pushed.load(std::memory_order_relaxed);
+    s.executed = _executed.load(std::memory_order_relaxed);
+    s.dropped = _dropped.load(std::memory_order_relaxed);
+    uint64_t count = _wait_count.exchange(0, std::memory_order_relaxed);
+    TIMETYPE total = _wait_total.exchange(0, std::memory_order_relaxed);
+    s.wait_avg_us = count ? total / (TIMETYPE)count : 0;
+    s.wait_max_us = _wait_max.exchange(0, std::memory_order_relaxed);
+    return s;
+}
+
+static void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* addr)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+thread_group::thread_group(size_t idx, size_t maxsize, size_t threadcnt, bool work_stealing, size_t serial_lanes, size_t essential_maxsize)
+    : _idx(idx), _maxsize(maxsize), _threadcnt(threadcnt), _work_stealing(work_stealing), _essential(essential_maxsize)
+{
+    assert(threadcnt > 0);
     _threads.resize(threadcnt);
     _stop = false;
+    if(serial_lanes > 0)
+    {
+        size_t count = std::bit_ceil(serial_lanes);
+        _lane_shift = 64 - std::countr_zero(count);
+        _lanes = new serial_lane[count];
+        for(size_t i = 0; i < count; ++i)
+        {
+            _lanes[i].group = this;
+        }
+    }
+    if(_work_stealing)
+    {
+        _workers.resize(threadcnt);
+        for(size_t i = 0; i < _threadcnt; ++i)
+        {
+            _workers[i] = new worker;
+            _workers[i]->index = i;
+        }
+    }
     for(size_t i = 0; i < _threadcnt; ++i)
     {
-        _threads[i] = (new std::thread([this]
+        if(_work_stealing)
         {
-            auto pool = threadpool::get_instance();
-            while(true)
+            _threads[i] = new std::thread([this, i]{ run_stealing(_workers[i]); });
+        }
+        else
+        {
+            _threads[i] = new std::thread([this]{ run_shared(); });
+        }
+    }
+}
+
+void thread_group::run_shared()
+{
+    auto pool = threadpool::get_instance();
+    size_t essential_streak = 0;
+    while(true)
+    {
+        inline_task task;
+        {
+            std::unique_lock<std::mutex> l(_queue_lock);
+            while(!has_task()) // 循环判断条件是否满足，避免cond的假唤醒，增加程序的健壮性
             {
-                runnable* task = nullptr;
+                if(this->_stop.load(std::memory_order_acquire)) return;
+
+                if(pool->is_steal())
                 {
-                    std::unique_lock<std::mutex> l(_queue_lock);
-                    while(!has_task()) // 循环判断条件是否满足，避免cond的假唤醒，增加程序的健壮性
-                    {
-                        if(this->_stop.load(std::memory_order_acquire)) return;
-
-                        if(pool->is_steal())
-                        {
-                            l.unlock();
-                            pool->try_steal_one((int)_idx, task);
-                            if(task) break;
-                            l.lock();
-                        }
-
-                        this->_cond.wait(l, [this]
-                        {
-                            return this->_stop.load(std::memory_order_acquire) || has_task();
-                        });
-                    }
-
-                    // 从任务队列里取任务
-                    if(!task)
-                    {
-                        if(!_essential_task_queue.empty())
-                        {
-                            task = _essential_task_queue.front();
-                            _essential_task_queue.pop_front();
-                        }
-                        else if(!this->_task_queue.empty())
-                        {
-                            task = this->_task_queue.front();
-                            this->_task_queue.pop_front();
-                        }
-                    }
+                    l.unlock();
+                    pool->try_steal_one((int)_idx, task);
+                    if(task) break;
+                    l.lock();
                 }
 
-                ++_busy;
-                try
+                this->_cond.wait(l, [this]
+                {
+                    return this->_stop.load(std::memory_order_acquire) || has_task();
+                });
+            }
+
+            // 从任务队列里取任务，高优先级的优先，连续执行太多时让普通任务先执行一个
+            if(!task)
+            {
+                bool has_normal = !this->_task_queue.empty();
+                if((essential_streak < essential_lane::ESSENTIAL_BURST || !has_normal) && pop_essential(task))
                 {
-                    task->run();
-                    //local_log("thread_task run success");
+                    ++essential_streak;
                 }
-                catch(...)
+                else if(has_normal)
                 {
-                    local_log("thread_task run throw exception!!!");
+                    task = std::move(this->_task_queue.front());
+                    this->_task_queue.pop_front();
+                    essential_streak = 0;
                 }
-                task->destroy();
-                --_busy;
+            }
+        }
+        if(!task) continue; // 全局通道的任务被其他组的线程先取走了
+
+        ++_busy;
+        run_task(task);
+        --_busy;
+
+        {
+            std::lock_guard<std::mutex> l(this->_queue_lock);
+            if(_busy == 0 && !has_task())
+            {
+                this->_cond.notify_all(); // 这里只是为了去通知wait_for_all_done
+            }
+        }
+    }
+}
+
+void thread_group::run_stealing(worker* self)
+{
+    _current_group = this;
+    _current_worker = self;
+    size_t essential_streak = 0;
+    while(true)
+    {
+        // 高优先级的优先，连续执行太多时先找一个普通任务，没有普通任务再接着执行高优先级的
+        inline_task task;
+        if(essential_streak < essential_lane::ESSENTIAL_BURST && pop_essential(task))
+        {
+            ++essential_streak;
+            ++_busy;
+            run_task(task);
+            --_busy;
+            continue;
+        }
+        essential_streak = 0;
+
+        task_node* node = find_task(self);
+        if(!node && pop_essential(task))
+        {
+            ++essential_streak;
+            ++_busy;
+            run_task(task);
+            --_busy;
+            continue;
+        }
+        if(!node)
+        {
+            // 先标记再查一遍，和投递方先入队再检查状态配对，不会漏掉唤醒
+            self->state.store(worker::PARKED, std::memory_order_seq_cst);
+            _parked.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            node = find_task(self);
+            if(!node && !has_essential() && !_stop.load(std::memory_order_seq_cst))
+            {
+                futex_wait(&self->state, worker::PARKED);
+            }
+            _parked.fetch_sub(1, std::memory_order_relaxed);
 
+            // 状态已经不是PARKED说明是被unpark叫醒的，叫醒方替我们计入了_searching
+            uint32_t expected = worker::PARKED;
+            bool notified = !self->state.compare_exchange_strong(expected, worker::RUNNING, std::memory_order_seq_cst);
+            self->state.store(worker::RUNNING, std::memory_order_relaxed);
+            if(notified)
+            {
+                if(!node) node = find_task(self);
+                if(_searching.fetch_sub(1, std::memory_order_seq_cst) == 1 && node)
                 {
-                    std::lock_guard<std::mutex> l(this->_queue_lock);
-                    if(_busy == 0 && !has_task())
-                    {
-                        this->_cond.notify_all(); // 这里只是为了去通知wait_for_all_done
-                    }
+                    notify_idle(); // 最后一个找任务的线程找到了，再叫醒一个接着找
                 }
-            } 
-        }));
+            }
+            if(!node)
+            {
+                if(_stop.load(std::memory_order_acquire) && _pending.load(std::memory_order_acquire) == 0) return;
+                continue;
+            }
+        }
+
+        ++_busy;
+        run_task(node->task);
+        thread_group* group = node->group;
+        delete node; // 析构时释放任务
+        group->_pending.fetch_sub(1, std::memory_order_release);
+        --_busy;
     }
 }
 
-thread_group::~thread_group()
+auto thread_group::find_task(worker* self) -> task_node*
+{
+    task_node* node = nullptr;
+    if(self->local.pop(node)) return node;
+    if((node = take_inbox(self, self))) return node;
+    if((node = steal_task(self))) return node;
+
+    auto pool = threadpool::get_instance();
+    if(pool->is_steal())
+    {
+        return pool->try_steal_node((int)_idx, self);
+    }
+    return nullptr;
+}
+
+auto thread_group::steal_task(worker* thief) -> task_node*
+{
+    size_t count = _workers.size();
+    size_t offset = thief->index + 1; // 每个线程从不同的位置开始偷，错开竞争
+    for(size_t i = 0; i < count; ++i)
+    {
+        worker* victim = _workers[(offset + i) % count];
+        if(victim == thief) continue;
+
+        task_node* node = nullptr;
+        if(victim->local.steal(node)) return node;
+        if((node = take_inbox(victim, thief))) return node;
+    }
+    return nullptr;
+}
+
+// 整个取走from的收件箱，返回最早投递的那个，其余放进self的本地队列
+auto thread_group::take_inbox(worker* from, worker* self) -> task_node*
+{
+    if(!from->inbox.load(std::memory_order_seq_cst)) return nullptr;
+    task_node* node = from->inbox.exchange(nullptr, std::memory_order_acquire);
+    if(!node) return nullptr;
+
+    // 栈里是从新到旧，按这个顺序压进本地队列，pop出来就是从旧到新
+    while(node->next)
+    {
+        task_node* next = node->next;
+        node->next = nullptr;
+        self->local.push(node);
+        node = next;
+    }
+    if(!self->local.empty() && _current_group)
+    {
+        _current_group->notify_idle(); // 一次拿到了多个任务，叫醒一个兄弟来偷
+    }
+    return node;
+}
+
+bool thread_group::unpark(worker* w)
+{
+    _searching.fetch_add(1, std::memory_order_seq_cst); // 先替它计数，它醒来后找完任务再减
+    uint32_t expected = worker::PARKED;
+    if(w->state.compare_exchange_strong(expected, worker::NOTIFIED, std::memory_order_seq_cst))
+    {
+        futex_wake(&w->state);
+        return true;
+    }
+    _searching.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool thread_group::unpark_one()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst); // 和挂起前的_parked计数配对，投递的任务对挂起方可见
+    if(_parked.load(std::memory_order_seq_cst) == 0) return false;
+    size_t count = _workers.size();
+    size_t offset = _next_worker.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(unpark(_workers[(offset + i) % count])) return true;
+    }
+    return false;
+}
+
+void thread_group::notify_idle()
+{
+    if(_searching.load(std::memory_order_seq_cst) == 0)
+    {
+        unpark_one();
+    }
+}
+
+void thread_group::join()
 {
     {
         std::lock_guard<std::mutex> lock(_queue_lock);
         _stop.store(true, std::memory_order_release);
     }
     _cond.notify_all();
+    for(worker* w : _workers)
+    {
+        unpark(w);
+    }
     for(size_t i = 0 ; i < _threadcnt; ++i)
     {
         if(_threads[i]->joinable())
         {
             _threads[i]->join();
         }
+    }
+}
+
+thread_group::~thread_group()
+{
+    join();
+    for(size_t i = 0 ; i < _threadcnt; ++i)
+    {
         delete _threads[i];
     }
+    for(worker* w : _workers)
+    {
+        task_node* node = nullptr;
+        while(w->local.pop(node)) delete node;
+        node = w->inbox.exchange(nullptr);
+        while(node)
+        {
+            task_node* next = node->next;
+            delete node;
+            node = next;
+        }
+        delete w;
+    }
+    delete[] _lanes; // 工作线程都退出了，lane里没执行的任务随队列析构释放
+}
+
+bool thread_group::has_task() const
+{
+    if(has_essential()) return true;
+    if(_work_stealing)
+    {
+        return _pending.load(std::memory_order_acquire) > 0;
+    }
+    return !_task_queue.empty();
+}
+
+bool thread_group::pop_essential(inline_task& task)
+{
+    if(_essential.pop(task)) return true;
+    essential_lane* global = threadpool::get_instance()->_essential;
+    return global && global->pop(task);
+}
+
+bool thread_group::has_essential() const
+{
+    if(!_essential.empty()) return true;
+    essential_lane* global = threadpool::get_instance()->_essential;
+    return global && !global->empty();
 }
 
-void thread_group::add_task(runnable* task)
+void thread_group::wakeup_for_essential()
 {
+    if(_work_stealing)
+    {
+        unpark_one();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> l(_queue_lock); // 和等待方检查条件串行，入队后再通知不会漏掉
+    }
+    _cond.notify_one();
+}
+
+void thread_group::add_essential_task(inline_task&& task)
+{
+    if(_stop.load(std::memory_order_acquire))
+    {
+        local_log("thread group %d is stopped, add_essential_task failed.", (int)_idx);
+        task.reset();
+        return;
+    }
+    if(!_essential.push(std::move(task)))
+    {
+        local_log("thread group %d essential lane is full!!!", (int)_idx);
+        return;
+    }
+    wakeup_for_essential();
+}
+
+void thread_group::add_task(inline_task&& task, bool force)
+{
+    if(_work_stealing)
+    {
+        if(!force && _pending.load(std::memory_order_relaxed) >= _maxsize)
+        {
+            local_log("thread group %d task_queue is full!!!", (int)_idx);
+            task.reset();
+            return;
+        }
+        if(_stop.load(std::memory_order_acquire))
+        {
+            local_log("thread group %d is stopped, add_task failed.", (int)_idx);
+            task.reset();
+            return;
+        }
+
+        _pending.fetch_add(1, std::memory_order_relaxed);
+        task_node* node = new task_node;
+        node->task = std::move(task);
+        node->group = this;
+        if(_current_group == this)
+        {
+            _current_worker->local.push(node); // 组内线程投递的放自己队列里，缓存更热
+            notify_idle();
+            return;
+        }
+
+        worker* w = _workers[_next_worker.fetch_add(1, std::memory_order_relaxed) % _workers.size()];
+        task_node* head = w->inbox.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = head;
+        } while(!w->inbox.compare_exchange_weak(head, node, std::memory_order_seq_cst, std::memory_order_relaxed));
+
+        // 选中的线程在忙就叫醒一个空闲的来偷，已经有线程在找任务就不用了；本组都在忙再看其他组
+        if(!unpark(w) && _searching.load(std::memory_order_seq_cst) == 0 && !unpark_one())
+        {
+            auto pool = threadpool::get_instance();
+            if(pool->is_steal()) pool->unpark_other_group((int)_idx);
+        }
+        return;
+    }
+
     std::lock_guard<std::mutex> l(_queue_lock);
-    if(_task_queue.size() >= _maxsize)
+    if(!force && _task_queue.size() >= _maxsize)
     {
         local_log("thread group %d task_queue is full!!!", (int)_idx);
-        task->destroy();
+        task.reset();
         return;
     }
     if(_stop.load(std::memory_order_acquire))
     {
         local_log("thread group %d is stopped, add_task failed.", (int)_idx);
-        task->destroy();
+        task.reset();
         return;
     }
-   _task_queue.push_back(task);
+   _task_queue.push_back(std::move(task));
    _cond.notify_one();
 }
 
+void thread_group::add_serial_task(uint64_t key, inline_task&& task)
+{
+    if(!_lanes)
+    {
+        add_task(std::move(task));
+        return;
+    }
+
+    serial_lane& lane = _lanes[_lane_shift < 64 ? (key * 0x9E3779B97F4A7C15ull) >> _lane_shift : 0]; // 斐波那契哈希，连续的key也能打散
+    {
+        spinlock::scoped l(lane.locker);
+        if(lane.queue.size() >= _maxsize)
+        {
+            local_log("thread group %d serial lane is full!!!", (int)_idx);
+            task.reset();
+            return;
+        }
+        lane.queue.push_back(std::move(task));
+        if(lane.scheduled) return; // 前面的drain任务执行完会接着执行
+        lane.scheduled = true;
+    }
+    add_task(inline_task([&lane]{ lane.drain(); }), true);
+}
+
 void thread_group::notify_one()
 {
     _cond.notify_one();
@@ -130,6 +586,17 @@ void thread_group::notify_one()
 
 bool thread_group::wait_for_all_done(TIMETYPE millsecond)
 {
+    if(_work_stealing) // 工作线程执行完不会通知，轮询等待
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(millsecond);
+        while(has_task())
+        {
+            if(millsecond > 0 && std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
     std::unique_lock<std::mutex> l(_queue_lock);
     if(!has_task()){ return true; }
     if(millsecond <= 0)
@@ -156,14 +623,21 @@ void threadpool::start()
         groups.emplace_back(std::stoi(result[i]), std::stoi(result[i + 1]));
     }
 
+    _is_work_stealing = cfg->get("threadpool", "work_stealing", false);
+    size_t serial_lanes = cfg->get<size_t>("threadpool", "serial_lanes", 1024);
+    size_t essential_maxsize = cfg->get<size_t>("threadpool", "essential_maxsize", 4096);
+    if(!_essential)
+    {
+        _essential = new essential_lane(essential_maxsize); // 工作线程启动前创建
+    }
     _groups.resize(groups.size(), nullptr);
     for(size_t i = 0; i < groups.size() ; ++i)
     {
         const auto& [maxsize, threadcnt] = groups[i];
         if(_groups[i] == nullptr)
         {
-            _groups[i] = new thread_group(i, maxsize, threadcnt);
-            local_log("thread group %d run %d threads, task queue maxsize:%d.", (int)i, threadcnt, maxsize);
+            _groups[i] = new thread_group(i, maxsize, threadcnt, _is_work_stealing, serial_lanes, essential_maxsize);
+            local_log("thread group %d run %d threads, task queue maxsize:%d, work stealing:%d, serial lanes:%zu.", (int)i, threadcnt, maxsize, _is_work_stealing, serial_lanes);
         }
         else
         {
@@ -183,73 +657,114 @@ void threadpool::stop()
     _stop.store(true, std::memory_order_release);
     for(auto group : _groups)
     {
-        if(group && group->wait_for_all_done(0))
-        {
-            delete group;
-        }
+        if(group) group->wait_for_all_done(0);
+    }
+    // 开启窃取时线程会访问其他组，所有组的线程都退出后才能释放
+    for(auto group : _groups)
+    {
+        if(group) group->join();
+    }
+    for(auto group : _groups)
+    {
+        delete group;
     }
     _groups.clear();
     _groups.shrink_to_fit();
+    delete _essential; // 工作线程都退出了
+    _essential = nullptr;
 }
 
-void threadpool::add_task(int groupidx, runnable* task)
+void threadpool::add_task(int groupidx, inline_task&& task, bool force)
 {
     if(_stop.load(std::memory_order_acquire))
     {
         local_log("threadpool is stopped, add_task failed.");
-        task->destroy();
+        task.reset();
         return;
     }
     ASSERT(groupidx >= 0 && groupidx < static_cast<int>(_groups.size()));
-    _groups[groupidx]->add_task(task);
+    _groups[groupidx]->add_task(std::move(task), force);
 }
 
-void threadpool::add_task(int groupidx, const std::function<void()>& task)
+void threadpool::add_essential_task(inline_task&& task)
 {
-    add_task(groupidx, new functional_runnable(std::move(task)));
-}
+    if(_stop.load(std::memory_order_acquire))
+    {
+        local_log("threadpool is stopped, add_essential_task failed.");
+        task.reset();
+        return;
+    }
+    if(!_essential->push(std::move(task)))
+    {
+        local_log("threadpool essential lane is full!!!");
+        return;
+    }
 
-void threadpool::add_task(int groupidx, std::function<void()>&& task)
-{
-    add_task(groupidx, new functional_runnable(std::move(task)));
+    // 优先叫醒还有空闲线程的组，都在忙就轮流通知
+    size_t count = _groups.size();
+    size_t offset = _next_essential_group.fetch_add(1, std::memory_order_relaxed);
+    for(size_t i = 0; i < count; ++i)
+    {
+        thread_group* group = _groups[(offset + i) % count];
+        if(group->_busy.load(std::memory_order_relaxed) < (int)group->_threadcnt)
+        {
+            group->wakeup_for_essential();
+            return;
+        }
+    }
+    _groups[offset % count]->wakeup_for_essential();
 }
 
-void threadpool::add_essential_task(runnable* task)
+void threadpool::add_essential_task(int groupidx, inline_task&& task)
 {
     if(_stop.load(std::memory_order_acquire))
     {
         local_log("threadpool is stopped, add_essential_task failed.");
-        task->destroy();
+        task.reset();
         return;
     }
-    _essential_task_queue.push_back(task);
+    ASSERT(groupidx >= 0 && groupidx < static_cast<int>(_groups.size()));
+    _groups[groupidx]->add_essential_task(std::move(task));
 }
 
-void threadpool::add_essential_task(const std::function<void()>& task)
+auto threadpool::get_essential_stats(int groupidx) -> essential_lane::stats
 {
-    add_essential_task(new functional_runnable(std::move(task)));
+    if(groupidx < 0)
+    {
+        return _essential ? _essential->get_stats() : essential_lane::stats{};
+    }
+    ASSERT(groupidx < static_cast<int>(_groups.size()));
+    return _groups[groupidx]->_essential.get_stats();
 }
 
-void threadpool::add_essential_task(std::function<void()>&& task)
+void threadpool::add_serial_task(int groupidx, uint64_t key, inline_task&& task)
 {
-    add_essential_task(new functional_runnable(std::move(task)));
+    if(_stop.load(std::memory_order_acquire))
+    {
+        local_log("threadpool is stopped, add_serial_task failed.");
+        task.reset();
+        return;
+    }
+    ASSERT(groupidx >= 0 && groupidx < static_cast<int>(_groups.size()));
+    _groups[groupidx]->add_serial_task(key, std::move(task));
 }
 
-void threadpool::try_steal_one(int current_idx, runnable*& task)
+void threadpool::try_steal_one(int current_idx, inline_task& task)
 {
     int group_size = _groups.size();
-    int offset = random::range(0, group_size - 1);
+    int offset = current_idx + 1; // 每个组从不同的位置开始偷，错开竞争
     for(auto i = 0; i < group_size; ++i)
     {
         size_t idx = (offset + i) % group_size;
         if(idx == (size_t)current_idx) continue;
 
+        // 只偷普通任务，高优先级通道由所属组自己的线程执行
         std::unique_lock<std::mutex> l(_groups[idx]->_queue_lock, std::try_to_lock);
-        if(l.owns_lock() && _groups[idx]->has_task())
+        if(l.owns_lock() && !_groups[idx]->_task_queue.empty())
         {
-            task = _groups[idx]->_task_queue.front();
+            task = std::move(_groups[idx]->_task_queue.front());
             _groups[idx]->_task_queue.pop_front();
-            if(_groups[idx]->has_task())
+            if(!_groups[idx]->_task_queue.empty())
             {
                 _groups[idx]->notify_one(); // 继续唤醒等待中的线程来窃取任务
             }
@@ -259,4 +774,29 @@ void threadpool::try_steal_one(int current_idx, runnable*& task)
     }
 }
 
-} // namespace bee
\ No newline at end of file
+auto threadpool::try_steal_node(int current_idx, thread_group::worker* thief) -> thread_group::task_node*
+{
+    int group_size = _groups.size();
+    int offset = current_idx + 1;
+    for(auto i = 0; i < group_size; ++i)
+    {
+        size_t idx = (offset + i) % group_size;
+        if(idx == (size_t)current_idx) continue;
+        if(thread_group::task_node* node = _groups[idx]->steal_task(thief))
+        {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+void threadpool::unpark_other_group(int current_idx)
+{
+    for(size_t idx = 0; idx < _groups.size(); ++idx)
+    {
+        if(idx == (size_t)current_idx) continue;
+        if(_groups[idx]->unpark_one()) return;
+    }
+}
+
+} // namespace bee
@@ -8,35 +8,106 @@
 #include <condition_variable>
 #include <vector>
 
+#include "inline_task.h"
+#include "lock.h"
+#include "mpmc_queue.h"
 #include "types.h"
 
 namespace bee
 {
 class runnable;
 
-using TASK_QUEUE = std::deque<runnable*>;
-
-inline thread_local TASK_QUEUE _essential_task_queue;
+using TASK_QUEUE = std::deque<inline_task>;
 
 class threadpool;
 
+/*
+ * 高优先级任务通道，心跳、踢人这类控制消息在过载时也要能及时执行
+ * 1.每个组一个，另外线程池还有一个全局的，所有组的线程都会取；
+ * 2.工作线程优先取这里的任务，连续执行ESSENTIAL_BURST个后让普通任务执行一个，普通任务不会饿死；
+ * 3.统计排队深度和等待时间，等待时间是区间值，每次get_stats后重新统计。
+ */
+class essential_lane
+{
+public:
+    static constexpr size_t ESSENTIAL_BURST = 8;
+
+    struct stats
+    {
+        size_t depth = 0;
+        uint64_t pushed = 0;
+        uint64_t executed = 0;
+        uint64_t dropped = 0;
+        TIMETYPE wait_avg_us = 0;
+        TIMETYPE wait_max_us = 0;
+    };
+
+    explicit essential_lane(size_t capacity) : _queue(capacity) {}
+    bool push(inline_task&& task);
+    bool pop(inline_task& task);
+    FORCE_INLINE bool empty() const { return _queue.empty(); }
+    stats get_stats();
+
+private:
+    struct item
+    {
+        inline_task task;
+        TIMETYPE enqueue_time = 0; // us
+    };
+
+    mpmc_queue<item> _queue;
+    std::atomic<uint64_t> _pushed = 0;
+    std::atomic<uint64_t> _executed = 0;
+    std::atomic<uint64_t> _dropped = 0;
+    std::atomic<uint64_t> _wait_count = 0;
+    std::atomic<TIMETYPE> _wait_total = 0;
+    std::atomic<TIMETYPE> _wait_max = 0;
+};
+
+/*
+ * 两种调度模式：
+ * 1.共享队列：组内线程共用一个deque，mutex+条件变量；
+ * 2.工作窃取：每个线程一个Chase-Lev队列，外部线程投递到选中线程的收件箱，
+ *   空闲线程先偷同组的，再偷其他组的（需要开启steal），没活干时用futex挂起。
+ * 串行投递：同一个key的任务按投递顺序逐个执行，不会并发，不同key分散到组内所有线程。
+ */
 class thread_group
 {
 public:
     
-    thread_group(size_t idx, size_t maxsize, size_t threadcnt);
+    thread_group(size_t idx, size_t maxsize, size_t threadcnt, bool work_stealing = false, size_t serial_lanes = 0, size_t essential_maxsize = 4096);
     ~thread_group();
-    void add_task(runnable* task);
-    bool has_task() const { return !_essential_task_queue.empty() || !_task_queue.empty(); }
+    void add_task(inline_task&& task, bool force = false); // force为true时不受队列上限限制
+    void add_serial_task(uint64_t key, inline_task&& task);
+    void add_essential_task(inline_task&& task);
+    bool has_task() const;
     
     void notify_one();
     bool wait_for_all_done(TIMETYPE millsecond);
+    void join(); // 停止并等待所有线程退出，析构时也会调用
 
 private:
     friend threadpool;
+    struct task_node;
+    struct worker;
+    struct serial_lane;
+
+    void run_shared();
+    void run_stealing(worker* self);
+    bool pop_essential(inline_task& task);
+    bool has_essential() const;
+    void wakeup_for_essential();
+    task_node* find_task(worker* self);
+    task_node* steal_task(worker* thief); // 从本组的线程偷，thief为其他组的线程时也可以调用
+    task_node* take_inbox(worker* from, worker* self);
+    bool unpark(worker* w);
+    bool unpark_one();
+    void notify_idle();
+
     const size_t _idx       = 0;
     const size_t _maxsize   = 0;
     const size_t _threadcnt = 0;
+    const bool _work_stealing = false;
 
     std::atomic_bool _stop = true;
     std::atomic_int _busy = 0;
@@ -44,6 +115,20 @@ private:
     std::condition_variable _cond;
     std::vector<std::thread*> _threads;
     TASK_QUEUE _task_queue;
+    essential_lane _essential;
+
+    // 工作窃取模式
+    std::vector<worker*> _workers;
+    std::atomic<size_t> _next_worker = 0;
+    std::atomic<size_t> _pending = 0; // 投递了还没执行完的任务数
+    std::atomic<int> _parked = 0;
+    std::atomic<int> _searching = 0; // 被叫醒后还在找任务的线程数，有人在找就不用再叫醒别人
+    inline static thread_local thread_group* _current_group = nullptr;
+    inline static thread_local worker* _current_worker = nullptr;
+
+    // 串行投递，key哈希到固定数量的lane上，同一个lane同时只有一个drain任务在组里排队或执行
+    serial_lane* _lanes = nullptr;
+    size_t _lane_shift = 64;
 };
 
 class threadpool : public singleton_support<threadpool>
@@ -53,22 +138,38 @@ public:
     void start();
     void stop();
 
-    void add_task(int groupidx, runnable* task);
-    void add_task(int groupidx, const std::function<void()>& task);
-    void add_task(int groupidx, std::function<void()>&& task);
+    // runnable*直接入队，不经过闭包包装，执行完调用destroy()
+    void add_task(int groupidx, runnable* task) { add_task(groupidx, inline_task(task)); }
+    void add_task(int groupidx, inline_task&& task, bool force = false); // force为true时不受队列上限限制
 
-    void add_essential_task(runnable* task);
-    void add_essential_task(const std::function<void()>& task);
-    void add_essential_task(std::function<void()>&& task);
+    // 高优先级任务，不指定组时投递到全局通道，任何组的空闲线程都会执行
+    void add_essential_task(runnable* task) { add_essential_task(inline_task(task)); }
+    void add_essential_task(inline_task&& task);
+    void add_essential_task(int groupidx, runnable* task) { add_essential_task(groupidx, inline_task(task)); }
+    void add_essential_task(int groupidx, inline_task&& task);
+    // groupidx为-1时返回全局通道的统计
+    essential_lane::stats get_essential_stats(int groupidx);
+    FORCE_INLINE size_t group_count() const { return _groups.size(); }
+
+    // 同一个key的任务先进先出、互不重叠地执行，比如key取会话id保证同一个连接的协议有序；没有开启串行lane时退化成add_task
+    void add_serial_task(int groupidx, uint64_t key, runnable* task) { add_serial_task(groupidx, key, inline_task(task)); }
+    void add_serial_task(int groupidx, uint64_t key, inline_task&& task);
 
     bool is_steal() { return _is_steal; }
-    void try_steal_one(int current_idx, runnable*& task);
+    bool is_work_stealing() { return _is_work_stealing; }
+    void try_steal_one(int current_idx, inline_task& task);
     
 private:
     friend thread_group;
+    thread_group::task_node* try_steal_node(int current_idx, thread_group::worker* thief);
+    void unpark_other_group(int current_idx);
+
     std::atomic_bool _stop = true;
     std::atomic_bool _is_steal = false;
+    bool _is_work_stealing = false;
     std::vector<thread_group*> _groups;
+    essential_lane* _essential = nullptr;
+    std::atomic<size_t> _next_essential_group = 0;
 };
 
 } // namespace bee
\ No newline at end of file
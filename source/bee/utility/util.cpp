@@ -1,3 +1,5 @@
+#include <zlib.h>
+
 #include "util.h"
 #include "format.h"
 
@@ -111,4 +113,24 @@ std::string url_decode(std::string_view str, bool space_as_plus)
     return result.str();
 }
 
-} // namespace bee::util
\ No newline at end of file
+bool zlib_compress(const char* data, size_t len, octets& out, int level)
+{
+    size_t pos = out.size();
+    uLongf destlen = compressBound(len);
+    out.reserve(pos + destlen);
+    if(compress2((Bytef*)out.data() + pos, &destlen, (const Bytef*)data, len, level) != Z_OK) return false;
+    out.fast_resize(destlen);
+    return true;
+}
+
+bool zlib_uncompress(const char* data, size_t len, size_t rawsize, octets& out)
+{
+    size_t pos = out.size();
+    uLongf destlen = rawsize;
+    out.reserve(pos + rawsize);
+    if(uncompress((Bytef*)out.data() + pos, &destlen, (const Bytef*)data, len) != Z_OK || destlen != rawsize) return false;
+    out.fast_resize(destlen);
+    return true;
+}
+
+} // namespace bee::util
@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <string_view>
+
+#include "octets.h"
 
 namespace bee::util
 {
@@ -8,4 +11,8 @@ namespace bee::util
 std::string url_encode(std::string_view str, bool space_as_plus = true);
 std::string url_decode(std::string_view str, bool space_as_plus = true);
 
+// zlib，结果追加到out后面
+bool zlib_compress(const char* data, size_t len, octets& out, int level = 1);
+bool zlib_uncompress(const char* data, size_t len, size_t rawsize, octets& out);
+
 } // namespace bee::util
\ No newline at end of file
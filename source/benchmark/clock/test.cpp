@@ -0,0 +1,109 @@
+#include <sys/time.h>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include "cached_clock.h"
+#include "common.h"
+#include "systemtime.h"
+
+using namespace bee;
+
+#define TESTCOUNT 10000000
+#define THREADCOUNT 4
+
+// 防止读取被优化掉
+static volatile TIMETYPE g_sink = 0;
+
+static void read_clock(clockid_t clockid)
+{
+    struct timespec ts;
+    for(size_t i = 0; i < TESTCOUNT; ++i)
+    {
+        clock_gettime(clockid, &ts);
+        g_sink = ts.tv_nsec;
+    }
+}
+
+int main()
+{
+    printf("%d clock_gettime(CLOCK_REALTIME): ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        read_clock(CLOCK_REALTIME);
+        GET_TIME_END();
+    }
+
+    printf("%d clock_gettime(CLOCK_MONOTONIC): ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        read_clock(CLOCK_MONOTONIC);
+        GET_TIME_END();
+    }
+
+    printf("%d clock_gettime(CLOCK_MONOTONIC_COARSE): ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        read_clock(CLOCK_MONOTONIC_COARSE);
+        GET_TIME_END();
+    }
+
+    printf("%d systemtime::get_millseconds: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i) g_sink = systemtime::get_millseconds();
+        GET_TIME_END();
+    }
+
+    // 刷新线程没启动时退回到直接读系统时钟
+    printf("%d cached_clock::get_millseconds (not running): ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i) g_sink = cached_clock::get_millseconds();
+        GET_TIME_END();
+    }
+
+    cached_clock::start(1);
+    printf("%d cached_clock::get_millseconds: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i) g_sink = cached_clock::get_millseconds();
+        GET_TIME_END();
+    }
+
+    printf("%d cached_clock::get_monotonic_seconds: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i) g_sink = cached_clock::get_monotonic_seconds();
+        GET_TIME_END();
+    }
+
+    // 多个线程同时读，缓存行只读共享，不会互相影响
+    printf("%d threads x %d cached_clock::get_monotonic_millseconds: ", THREADCOUNT, TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        std::vector<std::thread> threads;
+        for(int t = 0; t < THREADCOUNT; ++t)
+        {
+            threads.emplace_back([]()
+            {
+                for(size_t i = 0; i < TESTCOUNT; ++i) g_sink = cached_clock::get_monotonic_millseconds();
+            });
+        }
+        for(auto& th : threads) th.join();
+        GET_TIME_END();
+    }
+
+    // 最大误差：缓存值和系统时钟的差
+    TIMETYPE maxlag = 0;
+    for(size_t i = 0; i < 100000; ++i)
+    {
+        TIMETYPE cached = cached_clock::get_monotonic_microseconds();
+        TIMETYPE real = systemtime::get_monotonic_microseconds();
+        maxlag = std::max(maxlag, real - cached);
+    }
+    printf("max staleness: %ldus\n", maxlag);
+    cached_clock::stop();
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "config.h"
+#include "log_appender.h"
+#include "log_event.h"
+#include "log_formatter.h"
+#include "octets.h"
+
+using namespace bee;
+
+#define TESTCOUNT   1000000
+#define THREADCOUNT 4
+#define LINERATE    1000000 // 每秒写入的行数
+#define BATCHSIZE   1024
+
+// 统计每个线程的堆分配次数
+static thread_local size_t g_allocs = 0;
+
+void* operator new(size_t size)
+{
+    ++g_allocs;
+    if(void* ptr = malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+static log_event make_event(size_t i)
+{
+    log_event event;
+    event.process_name = "benchmark";
+    event.filename = "benchmark/log/test.cpp";
+    event.line = 42;
+    event.timestamp = 1700000000 + i / 100000; // 同一秒内有很多条日志
+    event.threadid = 12345;
+    event.fiberid = 0;
+    event.elapse = "123456";
+    event.content = "player login, roleid=10086 account=benchmark zoneid=1 ip=127.0.0.1";
+    return event;
+}
+
+static void write_config(const char* mmap_sync)
+{
+    std::ofstream conf("log_test.conf");
+    conf << "[log]\n"
+         << "pattern = [%d{%Y-%m-%d %H:%M:%S}]%T[%p]%T[%c]%T%t%T%f:%l: %m%n\n"
+         << "interval = 100\n"
+         << "threshold = 65536\n"
+         << "buffer_size = 1048576\n"
+         << "backpressure = block\n"
+         << "mmap_chunk_size = 64\n"
+         << "mmap_sync = " << mmap_sync << "\n"
+         << "mmap_sync_interval = 100\n";
+}
+
+// 单线程连续写TESTCOUNT行
+static void bench_throughput(const char* name, log_appender& appender, const std::vector<log_event>& events)
+{
+    printf("%d %s log: ", TESTCOUNT, name);
+    GET_TIME_BEGIN();
+    for(size_t i = 0; i < TESTCOUNT; ++i)
+    {
+        appender.log(LOG_LEVEL::INFO, events[i & 15]);
+    }
+    GET_TIME_END();
+}
+
+// THREADCOUNT个线程合计按每秒LINERATE行匀速写入，统计每次log调用的耗时分布
+static void bench_rate(const char* name, log_appender& appender, const std::vector<log_event>& events)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr size_t PERTHREAD = TESTCOUNT / THREADCOUNT;
+    const auto interval = std::chrono::nanoseconds(1000000000LL * THREADCOUNT / LINERATE);
+    std::vector<std::vector<uint32_t>> latencies(THREADCOUNT, std::vector<uint32_t>(PERTHREAD));
+
+    auto begin = clock::now();
+    std::vector<std::thread> threads;
+    for(int t = 0; t < THREADCOUNT; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            auto& samples = latencies[t];
+            for(size_t i = 0; i < PERTHREAD; ++i)
+            {
+                while(clock::now() < begin + interval * i); // 落后时不等待，追赶到目标速率
+                auto start = clock::now();
+                appender.log(LOG_LEVEL::INFO, events[i & 15]);
+                samples[i] = (uint32_t)std::min<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count(), UINT32_MAX);
+            }
+        });
+    }
+    for(auto& th : threads) th.join();
+    if(auto* async = dynamic_cast<async_appender*>(&appender)) async->stop(); // 算上后台线程写完的时间
+    double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+
+    std::vector<uint32_t> all;
+    all.reserve(TESTCOUNT);
+    for(auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all[std::min(all.size() - 1, (size_t)(all.size() * p))]; };
+    printf("%-22s lines/s:%-9.0f p50:%uns p99:%uns p99.9:%uns max:%uns\n",
+        name, TESTCOUNT / seconds, percentile(0.5), percentile(0.99), percentile(0.999), all.back());
+}
+
+int main()
+{
+    write_config("none");
+    config::get_instance()->init("log_test.conf");
+    log_formatter formatter(config::get_instance()->get("log", "pattern"));
+    std::vector<log_event> events;
+    for(size_t i = 0; i < 16; ++i) events.push_back(make_event(i * 100000));
+
+    // 1.返回std::string的格式化，每条都要分配
+    printf("%d format to std::string: ", TESTCOUNT);
+    {
+        size_t total = 0;
+        size_t allocs = g_allocs;
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            total += formatter.format(LOG_LEVEL::INFO, events[i & 15]).size();
+        }
+        GET_TIME_END();
+        printf("  bytes:%zu allocs/line:%.2f\n", total, double(g_allocs - allocs) / TESTCOUNT);
+    }
+
+    // 2.直接追加到复用的octets，稳定后应该没有分配
+    printf("%d format to octets: ", TESTCOUNT);
+    {
+        octets buf;
+        size_t total = 0;
+        formatter.format(buf, LOG_LEVEL::INFO, log_record(events[0])); // 预热容量
+        size_t allocs = g_allocs;
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            buf.clear();
+            formatter.format(buf, LOG_LEVEL::INFO, log_record(events[i & 15]));
+            total += buf.size();
+        }
+        GET_TIME_END();
+        printf("  bytes:%zu allocs/line:%.2f\n", total, double(g_allocs - allocs) / TESTCOUNT);
+    }
+
+    // 3.多个线程写async_appender，格式化和写文件都在后台线程
+    printf("%d threads x %d async_appender log: ", THREADCOUNT, TESTCOUNT / THREADCOUNT);
+    {
+        async_appender appender("log_test", "async");
+        std::atomic<size_t> producer_allocs = 0;
+        GET_TIME_BEGIN();
+        std::vector<std::thread> threads;
+        for(int t = 0; t < THREADCOUNT; ++t)
+        {
+            threads.emplace_back([&]()
+            {
+                appender.log(LOG_LEVEL::INFO, events[0]); // 第一次会注册线程缓冲区
+                size_t allocs = g_allocs;
+                for(size_t i = 1; i < TESTCOUNT / THREADCOUNT; ++i)
+                {
+                    appender.log(LOG_LEVEL::INFO, events[i & 15]);
+                }
+                producer_allocs += g_allocs - allocs;
+            });
+        }
+        for(auto& th : threads) th.join();
+        appender.stop();
+        GET_TIME_END();
+        auto st = appender.get_stats();
+        printf("  written:%lu dropped_oldest:%lu dropped_newest:%lu blocked:%lu producer allocs/line:%.2f\n",
+            st.written, st.dropped_oldest, st.dropped_newest, st.blocked, double(producer_allocs) / TESTCOUNT);
+    }
+
+    // 4.单线程吞吐：file_appender每行一次write+flush，mmap_appender每行一次memcpy
+    {
+        file_appender appender("log_test", "file");
+        bench_throughput("file_appender", appender, events);
+    }
+    {
+        mmap_appender appender("log_test", "mmap");
+        bench_throughput("mmap_appender", appender, events);
+    }
+
+    // 5.按每秒100万行写入时log调用的耗时
+    printf("%d threads at %d lines/s:\n", THREADCOUNT, LINERATE);
+    {
+        file_appender appender("log_test", "rate_file");
+        bench_rate("file_appender", appender, events);
+    }
+    {
+        async_appender appender("log_test", "rate_async");
+        bench_rate("async_appender", appender, events);
+    }
+    {
+        mmap_appender appender("log_test", "rate_mmap");
+        bench_rate("mmap_appender(none)", appender, events);
+    }
+
+    // 6.mmap_sync = batch：按logserver收到的批次写入，每批之后fdatasync
+    write_config("batch");
+    config::get_instance()->reload();
+    printf("%d mmap_appender(batch) log in batches of %d: ", TESTCOUNT, BATCHSIZE);
+    {
+        mmap_appender appender("log_test", "mmap_batch");
+        std::vector<LOG_LEVEL> levels(BATCHSIZE, LOG_LEVEL::INFO);
+        std::vector<log_event> batch;
+        for(size_t i = 0; i < BATCHSIZE; ++i) batch.push_back(events[i & 15]);
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT / BATCHSIZE; ++i)
+        {
+            appender.log(levels.data(), batch.data(), batch.size(), LOG_LEVEL::TRACE);
+        }
+        GET_TIME_END();
+    }
+
+    // 7.mmap_sync = periodic：后台线程每100ms fdatasync一次，写日志的线程不等待
+    write_config("periodic");
+    config::get_instance()->reload();
+    {
+        mmap_appender appender("log_test", "mmap_periodic");
+        bench_throughput("mmap_appender(periodic)", appender, events);
+    }
+    return 0;
+}
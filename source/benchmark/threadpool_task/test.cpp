@@ -0,0 +1,101 @@
+#include <sys/time.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <new>
+#include "common.h"
+#include "inline_task.h"
+#include "runnable.h"
+
+// 统计全局分配次数，对比每个任务的分配开销
+static std::atomic<size_t> g_alloc_count = 0;
+
+void* operator new(size_t size)
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if(void* ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+using namespace bee;
+
+// 模拟解码出来的协议
+class testprotocol : public runnable
+{
+public:
+    virtual void run() override { g_sum += _value; }
+    size_t _value = 1;
+    static inline size_t g_sum = 0;
+};
+
+#define TESTCOUNT 1000000
+#define BATCH 1024
+
+template<typename QUEUE, typename PUSH, typename POP>
+void run_case(const char* name, PUSH push, POP pop)
+{
+    QUEUE queue;
+    size_t before = g_alloc_count.load();
+    GET_TIME_BEGIN();
+    for(size_t i = 0; i < TESTCOUNT; i += BATCH)
+    {
+        for(size_t j = 0; j < BATCH; ++j) push(queue);
+        while(!queue.empty()) pop(queue);
+    }
+    GET_TIME_END();
+    size_t allocs = g_alloc_count.load() - before;
+    printf("%s: %.2f allocs/op\n", name, (double)allocs / TESTCOUNT);
+}
+
+int main()
+{
+    // 改动前：协议包一层lambda，再装进functional_runnable
+    run_case<std::deque<runnable*>>("functional_runnable + lambda",
+        [](auto& queue)
+        {
+            testprotocol* prot = new testprotocol;
+            queue.push_back(new functional_runnable([prot]() { prot->run(); delete prot; }));
+        },
+        [](auto& queue)
+        {
+            runnable* task = queue.front();
+            queue.pop_front();
+            task->run();
+            task->destroy();
+        });
+
+    // 改动后：协议直接作为runnable入队
+    run_case<std::deque<inline_task>>("inline_task runnable*",
+        [](auto& queue)
+        {
+            queue.emplace_back(static_cast<runnable*>(new testprotocol));
+        },
+        [](auto& queue)
+        {
+            inline_task task = std::move(queue.front());
+            queue.pop_front();
+            task();
+        });
+
+    // 改动后：普通闭包存在inline_task内部
+    run_case<std::deque<inline_task>>("inline_task closure",
+        [](auto& queue)
+        {
+            size_t a = 1, b = 2, c = 3, d = 4, e = 5;
+            queue.emplace_back([a, b, c, d, e]() { testprotocol::g_sum += a + b + c + d + e; });
+        },
+        [](auto& queue)
+        {
+            inline_task task = std::move(queue.front());
+            queue.pop_front();
+            task();
+        });
+
+    printf("sum: %zu\n", testprotocol::g_sum);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <sys/time.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include "common.h"
+#include "config.h"
+#include "timewheel.h"
+
+using namespace bee;
+
+#define TESTCOUNT 1000000
+#define TICKTIME  10 // ms
+
+// 简单的线性同余，保证每次运行的定时器分布一样
+static uint64_t g_seed = 12345;
+static uint64_t next_rand()
+{
+    g_seed = g_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return g_seed >> 33;
+}
+
+static size_t g_fired = 0;
+static size_t g_late  = 0;
+
+int main()
+{
+    {
+        std::ofstream conf("timewheel_test.conf");
+        conf << "[timer]\ninterval = " << TICKTIME << "\npoolsize = " << TESTCOUNT + 1 << "\n";
+    }
+    config::get_instance()->init("timewheel_test.conf");
+    auto wheel = timewheel::get_instance();
+    wheel->init();
+    std::vector<TIMERID> timerids(TESTCOUNT);
+
+    // 1.添加1M个1秒到1小时之间的定时器，大部分落在高级别的槽里
+    printf("add %d timers: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            TIMETYPE timeout = 1000 + next_rand() % 3600000;
+            timerids[i] = wheel->add_timer(true, timeout, -1, [](void*) { return true; }, nullptr);
+        }
+        wheel->tick(); // 把changelist里的定时器放进时间轮
+        GET_TIME_END();
+    }
+
+    // 2.推进一段时间，每256个tick降级一次，只处理到期的那个槽
+    printf("advance 16384 ticks with %zu timers: ", wheel->get_timer_count());
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < 16384; ++i) wheel->tick();
+        GET_TIME_END();
+    }
+
+    // 3.全部重新计时，模拟频繁推迟的超时（比如rpc、空闲连接）
+    printf("mod %d timers: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            wheel->mod_timer(timerids[i], 1000 + next_rand() % 3600000);
+        }
+        wheel->tick();
+        GET_TIME_END();
+    }
+    printf("timers after mod: %zu\n", wheel->get_timer_count());
+
+    // 4.全部删除
+    printf("del %d timers: ", TESTCOUNT);
+    {
+        GET_TIME_BEGIN();
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            wheel->del_timer(timerids[i]);
+        }
+        wheel->tick();
+        GET_TIME_END();
+    }
+    printf("timers left: %zu\n", wheel->get_timer_count());
+
+    // 5.1M个定时器全部到期，检查都在预期的tick执行
+    printf("fire %d timers: ", TESTCOUNT);
+    {
+        uint64_t base = wheel->get_tickcount();
+        uint64_t maxticks = 0;
+        for(size_t i = 0; i < TESTCOUNT; ++i)
+        {
+            uint64_t ticks = next_rand() % 70000;
+            maxticks = std::max(maxticks, ticks);
+            wheel->add_timer(true, ticks * TICKTIME, 1, [](void* param)
+            {
+                ++g_fired;
+                if(timewheel::get_instance()->get_tickcount() != (uint64_t)(uintptr_t)param) ++g_late;
+                return false;
+            }, (void*)(uintptr_t)(base + ticks));
+        }
+        GET_TIME_BEGIN();
+        for(uint64_t i = 0; i <= maxticks; ++i) wheel->tick();
+        GET_TIME_END();
+    }
+    printf("fired: %zu, not on time: %zu, timers left: %zu\n", g_fired, g_late, wheel->get_timer_count());
+    return 0;
+}
@@ -23,9 +23,30 @@
 #include "timewheel.h"
 #include "ExampleRPC.h"
 #include "httpclient.h" 
+#include "coroutine.h"
+#include "rpc_awaitable.h"
+#include "http_awaitable.h"
 
 using namespace bee;
 
+// 协程写法：rpc、定时等待、http请求按顺序写，不用嵌套回调
+task<void> example_coroutine(server_manager* servermgr, httpclient* http_client)
+{
+    auto res = co_await rpc_call<ExampleRPC>(ExampleRPCArg(1, 2), [servermgr](const protocol& prot) { servermgr->send(prot); });
+    if(!res)
+    {
+        local_log("coroutine rpc timeout.");
+        co_return;
+    }
+    local_log_f("coroutine rpc result:{}", res->sum);
+
+    co_await sleep_for(100);
+    co_await switch_to(0);
+
+    auto rsp = co_await http_get(http_client, "/test/hello");
+    local_log("coroutine receive httpresponse status:%d.", rsp.status);
+}
+
 bool sigusr1_handler(int signum)
 {
     add_timer(3000, []()
@@ -123,6 +144,12 @@ int main(int argc, char* argv[])
     });
     local_log("timerid: %lu", timerid);
 
+    add_timer(5000, [servermgr, http_client]()
+    {
+        co_spawn(example_coroutine(servermgr, http_client));
+        return true;
+    });
+
     looper->run();
     timer_thread.join();
     if(cli_thread.joinable()) cli_thread.join();
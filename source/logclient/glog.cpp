@@ -2,7 +2,12 @@
 #include "logger.h"
 #include "remotelog.h"
 #include "remoteinfluxlog.h"
+#include "remotelog_binary.h"
+#include "common.h"
+#include "cached_clock.h"
 #include "logserver_manager.h"
+#include "log_batcher.h"
+#include "log_spool.h"
 #ifdef _REENTRANT
 #include "threadpool.h"
 #endif
@@ -12,10 +17,13 @@ namespace bee
 
 thread_local bee::remotelog g_remotelog;
 thread_local bee::remoteinfluxlog g_influxremotelog;
+thread_local bee::remotelog_binary g_binaryremotelog;
 
 void logclient::set_logserver(logserver_manager* logserver)
 {
     _logserver = logserver;
+    log_batcher::get_instance()->init();
+    log_spool::get_instance()->init();
 }
 
 void logclient::commit_log(LOG_LEVEL level, const log_event& event)
@@ -32,11 +40,32 @@ void logclient::commit_log(LOG_LEVEL level, const log_event& event)
     }
     else // logclient
     {
-        if(_logserver && _logserver->is_connect())
+        auto spool = log_spool::get_instance();
+        if(_logserver && _logserver->is_connect() && !spool->is_pending())
+        {
+            g_remotelog.loglevel = level;
+            g_remotelog.logevent = event;
+            if(auto batcher = log_batcher::get_instance(); batcher->is_enabled())
+            {
+                batcher->append(g_remotelog);
+            }
+            else
+            {
+                _logserver->send(g_remotelog);
+            }
+        }
+        else if(spool->is_enabled()) // 断开期间或者缓存还没重发完，写进本地缓存
         {
             g_remotelog.loglevel = level;
             g_remotelog.logevent = event;
-            _logserver->send(g_remotelog);
+            if(auto batcher = log_batcher::get_instance(); batcher->is_enabled())
+            {
+                batcher->append(g_remotelog);
+            }
+            else if(!spool->append(g_remotelog) && _console_logger)
+            {
+                _console_logger->log(level, event);
+            }
         }
         else if(_console_logger)
         {
@@ -45,6 +74,38 @@ void logclient::commit_log(LOG_LEVEL level, const log_event& event)
     }
 }
 
+bool logclient::is_binlog_enabled() const
+{
+    // 本地缓存有积压时改用文本日志，缓存的记录才能在进程重启后重发
+    return _binlog && !_is_logserver && _logserver && _logserver->is_connect() && !log_spool::get_instance()->is_pending();
+}
+
+void logclient::commit_binlog(LOG_LEVEL level, uint32_t formatid, const char* filename, int line, const octets& args)
+{
+    if(!is_binlog_enabled() || !_logserver->send_binlog_formats(formatid))
+    {
+        decode_binlog(level, formatid, filename, line, args);
+        return;
+    }
+
+    g_binaryremotelog.loglevel  = level;
+    g_binaryremotelog.formatid  = formatid;
+    g_binaryremotelog.timestamp = cached_clock::get_time();
+    g_binaryremotelog.threadid  = gettid();
+    g_binaryremotelog.fiberid   = 0;
+    g_binaryremotelog.elapse    = get_process_elapse();
+    g_binaryremotelog.args      = octets_view(args.data(), args.size(), nullptr); // 发送时立即编码，不需要持有
+    if(auto batcher = log_batcher::get_instance(); batcher->is_enabled())
+    {
+        batcher->append(g_binaryremotelog);
+    }
+    else
+    {
+        _logserver->send(g_binaryremotelog);
+    }
+    g_binaryremotelog.args.reset();
+}
+
 void logclient::commit_influxlog(const influxlog_event& event)
 {
     if(_is_logserver)
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <mutex>
+
+#include "log_batcher.h"
+#include "config.h"
+#include "glog.h"
+#include "log_spool.h"
+#include "logserver_manager.h"
+#include "protocol.h"
+#include "reactor.h"
+#include "remotelog_batch.h"
+#include "remotelog_binary.h"
+#include "util.h"
+
+namespace bee
+{
+
+void log_batcher::init()
+{
+    auto cfg = config::get_instance();
+    _enabled    = cfg->get<bool>("log", "batch", false);
+    _compress   = cfg->get<bool>("log", "batch_compress", false);
+    _batch_size = cfg->get<int>("log", "batch_size", 16384);
+    _interval   = cfg->get<int>("log", "batch_interval", 20);
+    _batch_size = std::clamp<size_t>(_batch_size, 1024, 65536); // 远小于remotelog_batch的maxsize
+    _interval   = std::max<TIMETYPE>(_interval, 1);
+    if(!_enabled) return;
+
+    // 压缩和发送放到io reactor上，不占用主reactor的accept循环
+    add_timer(reactor::get_instance()->pick_io_reactor((uintptr_t)this / sizeof(void*)), _interval, [this]()
+    {
+        flush_all();
+        return true;
+    });
+}
+
+log_batcher::buffer* log_batcher::get_buffer()
+{
+    // 线程退出时发掉剩余的日志，定时器之后会移除它
+    struct holder
+    {
+        ~holder()
+        {
+            if(!buf) return;
+            {
+                std::unique_lock<bee::spinlock> lock(buf->locker);
+                log_batcher::get_instance()->flush(buf.get());
+            }
+            buf->closed.store(true, std::memory_order_release);
+        }
+        std::shared_ptr<buffer> buf;
+    };
+    thread_local holder local;
+
+    if(PREDICT_FALSE(!local.buf))
+    {
+        local.buf = std::make_shared<buffer>();
+        local.buf->os.data().reserve(_batch_size + 2048);
+        std::unique_lock<bee::mutex> lock(_buffers_locker);
+        _buffers.push_back(local.buf);
+    }
+    return local.buf.get();
+}
+
+void log_batcher::append(const protocol& prot)
+{
+    buffer* buf = get_buffer();
+    std::unique_lock<bee::spinlock> lock(buf->locker);
+    buf->os << compact_int(prot.get_type());
+    prot.pack(buf->os);
+    ++buf->count;
+    if(prot.get_type() == remotelog_binary::TYPE)
+    {
+        buf->binary = true;
+        buf->max_formatid = std::max(buf->max_formatid, static_cast<const remotelog_binary&>(prot).formatid);
+    }
+    if(buf->os.size() >= _batch_size)
+    {
+        flush(buf);
+    }
+}
+
+void log_batcher::flush_all()
+{
+    thread_local std::vector<std::shared_ptr<buffer>> snapshot;
+    {
+        std::unique_lock<bee::mutex> lock(_buffers_locker);
+        snapshot.assign(_buffers.begin(), _buffers.end());
+        std::erase_if(_buffers, [](const std::shared_ptr<buffer>& buf) { return buf->closed.load(std::memory_order_acquire); });
+    }
+    for(auto& buf : snapshot)
+    {
+        std::unique_lock<bee::spinlock> lock(buf->locker);
+        flush(buf.get());
+    }
+    snapshot.clear();
+}
+
+void log_batcher::flush(buffer* buf)
+{
+    if(buf->count == 0) return;
+
+    // 缓存里还有没重发完的日志时继续往缓存后面追加，保证顺序；
+    // 断线前缓冲的remotelog_binary可能在重连后才发，先补发新连接上还没有的格式串
+    octets& raw = buf->os.data();
+    auto spool = log_spool::get_instance();
+    if(spool->is_pending()
+        || (buf->binary && !logserver_manager::get_instance()->send_binlog_formats(buf->max_formatid))
+        || !send_batch(raw.data(), raw.size(), buf->count))
+    {
+        if(!spool->append(raw.data(), raw.size(), buf->count, buf->binary))
+        {
+            _dropped_count.fetch_add(buf->count, std::memory_order_relaxed);
+        }
+    }
+    buf->os.clear();
+    buf->count = 0;
+    buf->binary = false;
+    buf->max_formatid = 0;
+}
+
+bool log_batcher::send_batch(const char* data, size_t size, uint32_t count)
+{
+    thread_local remotelog_batch batch;
+    thread_local octets compressed;
+    batch.compress = 0;
+    batch.rawsize  = size;
+    batch.count    = count;
+    batch.data     = octets_view(data, size, nullptr); // 发送时立即编码，不需要持有
+
+    if(_compress)
+    {
+        compressed.clear();
+        if(util::zlib_compress(data, size, compressed) && compressed.size() < size)
+        {
+            batch.compress = 1;
+            batch.data = octets_view(compressed.data(), compressed.size(), nullptr);
+        }
+    }
+
+    bool ok = logserver_manager::get_instance()->send(batch);
+    if(ok)
+    {
+        _batch_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    batch.data.reset();
+    return ok;
+}
+
+} // namespace bee
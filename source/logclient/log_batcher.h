@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "lock.h"
+#include "marshal.h"
+#include "types.h"
+
+namespace bee
+{
+class protocol;
+
+/*
+ * remotelog批量发送
+ * 1.每个线程把remotelog/remotelog_binary编码进自己的缓冲区，只在写满batch_size字节时才发送，
+ *   其余的由定时器每batch_interval毫秒统一发一次；
+ * 2.一批日志在logserver上只产生一个任务，文件也只写一次；
+ * 3.batch_compress开启时用zlib压缩，压缩后没有变小就按原样发送；
+ * 4.发送失败或本地缓存还有积压时，整批写进log_spool。
+ */
+class log_batcher : public singleton_support<log_batcher>
+{
+public:
+    void init();
+    FORCE_INLINE bool is_enabled() const { return _enabled; }
+
+    void append(const protocol& prot);
+    void flush_all(); // 定时器线程调用
+    bool send_batch(const char* data, size_t size, uint32_t count); // 按remotelog_batch发送一批编码好的记录
+
+    FORCE_INLINE uint64_t get_batch_count() const { return _batch_count.load(std::memory_order_relaxed); }
+    FORCE_INLINE uint64_t get_dropped_count() const { return _dropped_count.load(std::memory_order_relaxed); }
+
+private:
+    struct buffer
+    {
+        bee::spinlock locker;
+        octetsstream os;
+        uint32_t count = 0;
+        bool binary = false; // 含有remotelog_binary
+        uint32_t max_formatid = 0; // remotelog_binary用到的最大格式串编号，发送前要保证已经发到当前连接
+        std::atomic_bool closed = false; // 所属线程已经退出
+    };
+    buffer* get_buffer();
+    void flush(buffer* buf); // 调用方持有buf->locker
+
+private:
+    bool _enabled = false;
+    bool _compress = false;
+    size_t _batch_size = 0;
+    TIMETYPE _interval = 0; // ms
+
+    bee::mutex _buffers_locker;
+    std::vector<std::shared_ptr<buffer>> _buffers;
+
+    std::atomic<uint64_t> _batch_count = 0;
+    std::atomic<uint64_t> _dropped_count = 0; // 既没发出去也没能写进本地缓存的日志条数
+};
+
+} // namespace bee
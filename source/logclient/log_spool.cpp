@@ -0,0 +1,294 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+#include "log_spool.h"
+#include "binlog.h"
+#include "config.h"
+#include "glog.h"
+#include "log_batcher.h"
+#include "logserver_manager.h"
+#include "monitor.h"
+#include "protocol.h"
+#include "reactor.h"
+#include "remotelog_batch.h"
+
+namespace bee
+{
+
+/*
+ * 段文件由连续的记录组成，每条记录是spool_entry加上8字节对齐的数据，
+ * 数据先写，magic最后写，magic为0的位置就是段的末尾。
+ * 重发成功后magic改成SPOOL_CONSUMED_MAGIC，重启后跳过这些记录。
+ */
+static constexpr uint32_t SPOOL_ENTRY_MAGIC    = 0x4C4F4753;
+static constexpr uint32_t SPOOL_CONSUMED_MAGIC = 0x444F4E45;
+static constexpr uint32_t SPOOL_FLAG_BINARY    = 0x1;
+
+struct spool_entry
+{
+    uint32_t magic;
+    uint32_t size;  // 数据长度，不含对齐
+    uint32_t count; // 日志条数
+    uint32_t flags;
+};
+
+static FORCE_INLINE size_t spool_entry_space(size_t size)
+{
+    return sizeof(spool_entry) + ((size + 7) & ~(size_t)7);
+}
+
+void log_spool::init()
+{
+    auto cfg = config::get_instance();
+    _enabled         = cfg->get<bool>("log", "spool", false);
+    _dir             = cfg->get("log", "spool_dir", std::string("./logspool"));
+    _segment_size    = cfg->get<int>("log", "spool_segment_size", 4 * 1024 * 1024);
+    _max_bytes       = (size_t)cfg->get<int>("log", "spool_max_mb", 256) * 1024 * 1024;
+    _replay_rate     = cfg->get<int>("log", "spool_replay_rate", 4 * 1024 * 1024);
+    _replay_interval = 10;
+    _segment_size    = std::clamp<size_t>(_segment_size, 1024 * 1024, 256 * 1024 * 1024) & ~(size_t)4095;
+    _max_bytes       = std::max(_max_bytes, _segment_size);
+    _replay_rate     = std::max<size_t>(_replay_rate, 64 * 1024);
+    if(!_enabled) return;
+
+    if(std::error_code ec; !std::filesystem::create_directories(_dir, ec) && ec)
+    {
+        local_log("log_spool create directory failed, dir:%s err:%s.", _dir.data(), ec.message().data());
+        _enabled = false;
+        return;
+    }
+
+    recover();
+    monitor_engine::get_instance()->register_collector(new logspool_collector);
+    // 读映射段和发送都在io reactor上做，不占用主reactor的accept循环
+    add_timer(reactor::get_instance()->pick_io_reactor((uintptr_t)this / sizeof(void*)), _replay_interval, [this]()
+    {
+        replay();
+        return true;
+    });
+}
+
+bool log_spool::map_segment(segment& seg, int fd, size_t size)
+{
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED)
+    {
+        local_log("log_spool mmap failed, path:%s err:%s.", seg.path.data(), strerror(errno));
+        return false;
+    }
+    seg.base = (char*)addr;
+    seg.size = size;
+    return true;
+}
+
+log_spool::segment* log_spool::new_segment()
+{
+    segment seg;
+    seg.seq = ++_next_seq;
+    seg.path = _dir + "/" + std::to_string(seg.seq) + ".spool";
+
+    int fd = open(seg.path.data(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        local_log("log_spool open failed, path:%s err:%s.", seg.path.data(), strerror(errno));
+        return nullptr;
+    }
+    bool ok = ftruncate(fd, _segment_size) == 0 && map_segment(seg, fd, _segment_size);
+    close(fd);
+    if(!ok)
+    {
+        unlink(seg.path.data());
+        return nullptr;
+    }
+    return &_segments.emplace_back(std::move(seg));
+}
+
+void log_spool::close_segment(segment& seg, bool remove)
+{
+    if(seg.base)
+    {
+        munmap(seg.base, seg.size);
+        seg.base = nullptr;
+    }
+    if(remove)
+    {
+        unlink(seg.path.data());
+    }
+}
+
+void log_spool::recover()
+{
+    std::vector<uint64_t> seqs;
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(_dir, ec))
+    {
+        if(!entry.is_regular_file() || entry.path().extension() != ".spool") continue;
+        const std::string stem = entry.path().stem().string();
+        if(stem.empty() || !std::all_of(stem.begin(), stem.end(), ::isdigit)) continue;
+        seqs.push_back(std::stoull(stem));
+    }
+    std::sort(seqs.begin(), seqs.end());
+
+    bee::mutex::scoped l(_locker);
+    size_t pending = 0;
+    for(uint64_t seq : seqs)
+    {
+        segment seg;
+        seg.seq = seq;
+        seg.path = _dir + "/" + std::to_string(seq) + ".spool";
+        _next_seq = std::max(_next_seq, seq);
+
+        struct stat st;
+        int fd = open(seg.path.data(), O_RDWR);
+        bool ok = fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(spool_entry) && map_segment(seg, fd, st.st_size);
+        if(fd >= 0) close(fd);
+        if(!ok)
+        {
+            unlink(seg.path.data());
+            continue;
+        }
+
+        // 跳过已经重发的记录，找到段的末尾
+        size_t pos = 0;
+        bool reading = true;
+        while(pos + sizeof(spool_entry) <= seg.size)
+        {
+            auto* header = (spool_entry*)(seg.base + pos);
+            if(header->magic != SPOOL_ENTRY_MAGIC && header->magic != SPOOL_CONSUMED_MAGIC) break;
+            if(header->size > seg.size - pos - sizeof(spool_entry)) break;
+            if(header->magic == SPOOL_CONSUMED_MAGIC && reading)
+            {
+                seg.read_pos = pos + spool_entry_space(header->size);
+            }
+            else
+            {
+                reading = false;
+                pending += spool_entry_space(header->size);
+            }
+            pos += spool_entry_space(header->size);
+        }
+        seg.write_pos = pos;
+
+        if(seg.read_pos == seg.write_pos)
+        {
+            close_segment(seg, true);
+            continue;
+        }
+        local_log("log_spool recover segment %s, pending %zu bytes.", seg.path.data(), seg.write_pos - seg.read_pos);
+        _segments.emplace_back(std::move(seg));
+    }
+    _recovered_seq = _next_seq;
+    _pending_bytes.store(pending, std::memory_order_release);
+}
+
+bool log_spool::append(const char* data, size_t size, uint32_t count, bool binary)
+{
+    if(!_enabled) return false;
+
+    size_t space = spool_entry_space(size);
+    bee::mutex::scoped l(_locker);
+    segment* seg = _segments.empty() ? nullptr : &_segments.back();
+    if(!seg || seg->seq <= _recovered_seq || seg->write_pos + space > seg->size)
+    {
+        // 上次运行留下的段不再追加，新旧记录分开
+        if(space > _segment_size || (_segments.size() + 1) * _segment_size > _max_bytes || !(seg = new_segment()))
+        {
+            _dropped_records.fetch_add(count, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    auto* header = (spool_entry*)(seg->base + seg->write_pos);
+    memcpy(seg->base + seg->write_pos + sizeof(spool_entry), data, size);
+    header->size  = size;
+    header->count = count;
+    header->flags = binary ? SPOOL_FLAG_BINARY : 0;
+    std::atomic_ref<uint32_t>(header->magic).store(SPOOL_ENTRY_MAGIC, std::memory_order_release);
+    seg->write_pos += space;
+
+    _spooled_records.fetch_add(count, std::memory_order_relaxed);
+    _incoming_bytes.fetch_add(space, std::memory_order_relaxed);
+    _pending_bytes.fetch_add(space, std::memory_order_release);
+    return true;
+}
+
+bool log_spool::append(const protocol& prot)
+{
+    thread_local octetsstream os;
+    os.clear();
+    os << compact_int(prot.get_type());
+    prot.pack(os);
+    return append(os.data().data(), os.size(), 1, false);
+}
+
+void log_spool::replay()
+{
+    // 断开期间追加的不算，只有连接上之后还在追加的新日志需要额外的额度
+    size_t incoming = _incoming_bytes.exchange(0, std::memory_order_relaxed);
+    auto logserver = logserver_manager::get_instance();
+    if(!is_pending() || !logserver->is_connect()) return;
+
+    // 本次运行中缓存的remotelog_binary依赖的格式串要先发到logserver
+    if(!logserver->send_binlog_formats(binlog_registry::get_instance()->size())) return;
+
+    auto batcher = log_batcher::get_instance();
+    size_t budget = std::max<size_t>(_replay_rate * _replay_interval / 1000, 1) + incoming;
+    size_t sent = 0;
+
+    bee::mutex::scoped l(_locker);
+    while(!_segments.empty())
+    {
+        segment& seg = _segments.front();
+        if(seg.read_pos < seg.write_pos)
+        {
+            if(sent >= budget) break;
+            auto* header = (spool_entry*)(seg.base + seg.read_pos);
+            size_t space = spool_entry_space(header->size);
+            if(seg.seq <= _recovered_seq && (header->flags & SPOOL_FLAG_BINARY))
+            {
+                // 格式串编号只在写入它的那次运行中有效，无法再还原
+                _dropped_records.fetch_add(header->count, std::memory_order_relaxed);
+            }
+            else if(batcher->send_batch(seg.base + seg.read_pos + sizeof(spool_entry), header->size, header->count))
+            {
+                _replayed_records.fetch_add(header->count, std::memory_order_relaxed);
+            }
+            else
+            {
+                return; // 连接又断开了，下次继续
+            }
+            std::atomic_ref<uint32_t>(header->magic).store(SPOOL_CONSUMED_MAGIC, std::memory_order_release);
+            seg.read_pos += space;
+            sent += space;
+            _pending_bytes.fetch_sub(space, std::memory_order_release);
+            continue;
+        }
+
+        // 读完了，仍在写的最后一个段保留下来继续用
+        if(_segments.size() == 1 && seg.seq > _recovered_seq && seg.write_pos + sizeof(spool_entry) < seg.size) break;
+        close_segment(seg, true);
+        _segments.pop_front();
+    }
+}
+
+log_spool::stats log_spool::get_stats()
+{
+    stats st;
+    {
+        bee::mutex::scoped l(_locker);
+        st.segments = _segments.size();
+    }
+    st.pending_bytes    = _pending_bytes.load(std::memory_order_relaxed);
+    st.spooled_records  = _spooled_records.load(std::memory_order_relaxed);
+    st.replayed_records = _replayed_records.load(std::memory_order_relaxed);
+    st.dropped_records  = _dropped_records.load(std::memory_order_relaxed);
+    return st;
+}
+
+} // namespace bee
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include "lock.h"
+#include "metric_collector.h"
+#include "types.h"
+
+namespace bee
+{
+class protocol;
+
+/*
+ * logserver断开期间的本地日志缓存
+ * 1.日志按批写进spool_dir下的段文件，每个段spool_segment_size字节，mmap后直接memcpy，
+ *   总量超过spool_max_bytes后新日志丢弃并计数；
+ * 2.重连后定时器按spool_replay_rate字节每秒的速度从最旧的段开始按顺序重发，
+ *   缓存没有发完之前新日志也继续追加到缓存末尾，保证顺序；
+ *   每次重发的额度再加上上一个周期新追加的字节数，积压总是按spool_replay_rate减少，不会越积越多；
+ * 3.已经重发的记录在文件里打上标记，进程重启后从剩下的段文件继续重发；
+ *   数据只依赖页缓存，不做msync，进程崩溃不丢，机器掉电可能丢。
+ */
+class log_spool : public singleton_support<log_spool>
+{
+public:
+    struct stats
+    {
+        uint64_t pending_bytes = 0;    // 还没有重发的字节数
+        uint64_t segments = 0;
+        uint64_t spooled_records = 0;  // 累计写入缓存的日志条数
+        uint64_t replayed_records = 0; // 累计重发的日志条数
+        uint64_t dropped_records = 0;  // 缓存满了丢弃的日志条数
+    };
+
+    void init();
+    FORCE_INLINE bool is_enabled() const { return _enabled; }
+    FORCE_INLINE bool is_pending() const { return _pending_bytes.load(std::memory_order_acquire) > 0; }
+
+    // 一批remotelog_batch格式的记录，binary表示其中有remotelog_binary
+    bool append(const char* data, size_t size, uint32_t count, bool binary);
+    bool append(const protocol& prot); // 单条remotelog
+    void replay();                                              // 定时器线程调用
+    stats get_stats();
+
+private:
+    struct segment
+    {
+        uint64_t seq = 0;
+        std::string path;
+        char* base = nullptr;
+        size_t size = 0;
+        size_t write_pos = 0;
+        size_t read_pos = 0;
+    };
+    segment* new_segment();
+    bool map_segment(segment& seg, int fd, size_t size);
+    void close_segment(segment& seg, bool remove);
+    void recover();
+
+private:
+    bool _enabled = false;
+    std::string _dir;
+    size_t _segment_size = 0;
+    size_t _max_bytes = 0;      // 所有段文件的总大小上限
+    size_t _replay_rate = 0; // 字节/秒
+    TIMETYPE _replay_interval = 0; // ms
+
+    bee::mutex _locker;
+    std::deque<segment> _segments;
+    uint64_t _next_seq = 0;
+    uint64_t _recovered_seq = 0; // 小于等于这个编号的段是上次运行留下的
+    std::atomic<size_t> _pending_bytes = 0;
+    std::atomic<size_t> _incoming_bytes = 0; // 上次重发之后新追加的字节数
+
+    std::atomic<uint64_t> _spooled_records = 0;
+    std::atomic<uint64_t> _replayed_records = 0;
+    std::atomic<uint64_t> _dropped_records = 0;
+};
+
+// 上报缓存积压和丢弃情况
+class logspool_collector : public metric_collector
+{
+public:
+    logspool_collector() : metric_collector("logspool")
+    {
+        set_interval(1000);
+    }
+
+protected:
+    virtual void collect_impl(influx_metric& metric) override
+    {
+        auto st = log_spool::get_instance()->get_stats();
+        metric.add_field("pending_bytes", st.pending_bytes);
+        metric.add_field("segments", st.segments);
+        metric.add_field("spooled_records", st.spooled_records);
+        metric.add_field("replayed_records", st.replayed_records);
+        metric.add_field("dropped_records", st.dropped_records);
+    }
+};
+
+} // namespace bee
@@ -1,31 +1,63 @@
+#include <mutex>
+
 #include "logserver_manager.h"
 #include "address.h"
 #include "glog.h"
+#include "binlog.h"
+#include "remotelog_format.h"
 
 namespace bee
 {
 
 void logserver_manager::on_add_session(SID sid)
 {
-    _localsid = sid;
+    {
+        // 和send_binlog_formats互斥，否则旧连接上正在补发的循环会在清零之后写回编号
+        std::unique_lock<bee::mutex> lock(_formats_locker);
+        _sent_formatid.store(0, std::memory_order_release); // 新连接上格式串要重新发
+        _localsid.store(sid, std::memory_order_release);
+    }
     local_log("logserver_manager on_add_session %lu %s.", sid, get_addr()->to_string().data());
 }
 
 void logserver_manager::on_del_session(SID sid)
 {
-    _localsid = 0;
+    _localsid.store(0, std::memory_order_release);
     local_log("logserver_manager on_del_session %lu.", sid);
     reconnect();
 }
 
 bool logserver_manager::send(const protocol& prot)
 {
-    if(_localsid > 0)
+    SID sid = _localsid.load(std::memory_order_acquire);
+    if(sid > 0)
     {
-        send_protocol(_localsid, prot);
+        send_protocol(sid, prot);
         return true;
     }
     return false;   
 }
 
+bool logserver_manager::send_binlog_formats(uint32_t formatid)
+{
+    if(PREDICT_TRUE(formatid <= _sent_formatid.load(std::memory_order_acquire))) return is_connect();
+
+    std::unique_lock<bee::mutex> lock(_formats_locker);
+    uint32_t sent = _sent_formatid.load(std::memory_order_relaxed);
+    binlog_format format;
+    remotelog_format prot;
+    prot.process_name = logclient::get_instance()->get_process_name();
+    for(uint32_t id = sent + 1; id <= formatid; ++id)
+    {
+        if(!binlog_registry::get_instance()->get(id, format)) return false;
+        prot.formatid = format.formatid;
+        prot.filename = format.filename;
+        prot.line     = format.line;
+        prot.fmt      = format.fmt;
+        if(!send(prot)) return false;
+        _sent_formatid.store(id, std::memory_order_release);
+    }
+    return true;
+}
+
 } // namespace bee
\ No newline at end of file
@@ -1,4 +1,7 @@
 #pragma once
+#include <atomic>
+
+#include "lock.h"
 #include "session_manager.h"
 
 namespace bee
@@ -14,11 +17,16 @@ public:
     virtual void on_add_session(SID sid) override;
     virtual void on_del_session(SID sid) override;
     bool send(const protocol& prot);
+    bool send_binlog_formats(uint32_t formatid); // 保证formatid及之前的格式串已经在当前连接上发过
+
 
-    FORCE_INLINE bool is_connect() { return _localsid > 0; }
+    FORCE_INLINE bool is_connect() { return _localsid.load(std::memory_order_acquire) > 0; }
 
 private:
-    SID _localsid = 0;
+    std::atomic<SID> _localsid = 0; // 日志线程、定时器和网络线程都会读
+    bee::mutex _formats_locker;
+    std::atomic<uint32_t> _sent_formatid = 0; // 当前连接上已经发送的格式串编号
+
 };
 
 } // namespace bee
\ No newline at end of file
@@ -4,6 +4,11 @@
 #include "config.h"
 #include "remotelog.h"
 #include "remoteinfluxlog.h"
+#include "remotelog_format.h"
+#include "remotelog_binary.h"
+#include "remotelog_batch.h"
+#include "util.h"
+#include "log_event.h"
 
 namespace bee
 {
@@ -17,11 +22,16 @@ void log_manager::init()
         std::string filename = cfg->get("log", "filename");
         assert(logdir.size() && filename.size());
         bool asynclog = cfg->get<bool>("log", "asynclog", false);
+        bool mmaplog  = cfg->get<bool>("log", "mmaplog", false);
         auto loglevel = cfg->get<int>("log", "loglevel", LOG_LEVEL::TRACE);
         if(asynclog)
         {
             _file_logger = new logger((LOG_LEVEL)loglevel, new async_appender(logdir, filename));
         }
+        else if(mmaplog)
+        {
+            _file_logger = new logger((LOG_LEVEL)loglevel, new mmap_appender(logdir, filename));
+        }
         else
         {
             _file_logger = new logger((LOG_LEVEL)loglevel, new file_appender(logdir, filename));
@@ -54,6 +64,163 @@ void log_manager::influxlog(const influxlog_event& event)
     _influx_logger->influxlog(event);
 }
 
+void log_manager::add_binlog_format(SID sid, uint32_t formatid, const std::string& process_name, const std::string& filename, uint16_t line, const std::string& fmt)
+{
+    if(formatid == 0) return;
+    std::unique_lock<bee::mutex> lock(_binlog_locker);
+    auto& source = _binlog_sources[sid];
+    if(!source) source = std::make_shared<binlog_source>();
+    source->process_name = process_name;
+    if(source->formats.size() < formatid)
+    {
+        source->formats.resize(formatid);
+    }
+    binlog_format& format = source->formats[formatid - 1];
+    format.formatid = formatid;
+    format.filename = filename;
+    format.line = line;
+    format.fmt = fmt;
+}
+
+std::shared_ptr<log_manager::binlog_source> log_manager::find_binlog_source(SID sid)
+{
+    std::unique_lock<bee::mutex> lock(_binlog_locker);
+    auto iter = _binlog_sources.find(sid);
+    return iter != _binlog_sources.end() ? iter->second : nullptr;
+}
+
+/*
+ * source->formats在锁外读取：同一个会话的协议默认按serial_key(即sid)串行执行，
+ * remotelog_format和用到它的remotelog_binary/remotelog_batch在同一个串行队列上，
+ * 读的时候不会有同一个source的add_binlog_format在执行
+ */
+void log_manager::decode_binlog(const binlog_source* source, uint32_t formatid, uint64_t timestamp, uint32_t threadid, uint32_t fiberid, uint64_t elapse, std::string_view args, log_event& event)
+{
+    event.content.clear();
+    if(source && formatid > 0 && formatid <= source->formats.size())
+    {
+        const binlog_format& format = source->formats[formatid - 1];
+        event.process_name = source->process_name;
+        event.filename = format.filename;
+        event.line = format.line;
+        binlog::format(event.content, format.fmt, args.data(), args.size());
+    }
+    else
+    {
+        event.process_name.clear();
+        event.filename.clear();
+        event.line = 0;
+        event.content.assign("<<binlog unknown format>>");
+    }
+    event.timestamp = timestamp;
+    event.threadid = threadid;
+    event.fiberid = fiberid;
+    event.elapse = std::to_string(elapse);
+}
+
+void log_manager::binlog(SID sid, LOG_LEVEL level, uint32_t formatid, uint64_t timestamp, uint32_t threadid, uint32_t fiberid, uint64_t elapse, std::string_view args)
+{
+    std::shared_ptr<binlog_source> source = find_binlog_source(sid);
+    thread_local log_event event;
+    decode_binlog(source.get(), formatid, timestamp, threadid, fiberid, elapse, args, event);
+    log(level, event);
+}
+
+static constexpr size_t LOG_BATCH_MAX_RAWSIZE = 131072;
+
+void log_manager::log_batch(SID sid, bool compress, size_t rawsize, std::string_view data)
+{
+    thread_local octetsstream os;
+    thread_local remotelog record;
+    thread_local remotelog_binary binrecord;
+    thread_local std::vector<LOG_LEVEL> levels;
+    thread_local std::vector<log_event> events; // 复用字符串容量
+
+    // 客户端按batch_size(最大64K)加一条记录分批，解压后不会超过remotelog_batch的maxsize，
+    // rawsize来自网络，不检查的话会按它预留最多4G内存
+    if(rawsize > LOG_BATCH_MAX_RAWSIZE)
+    {
+        local_log("log_manager log_batch rawsize too large, sid=%lu size=%zu rawsize=%zu.", sid, data.size(), rawsize);
+        return;
+    }
+
+    os.clear();
+    os.enable_views(); // remotelog_binary的参数直接引用解压后的缓冲区
+    if(compress)
+    {
+        if(!util::zlib_uncompress(data.data(), data.size(), rawsize, os.data()))
+        {
+            local_log("log_manager log_batch uncompress failed, sid=%lu size=%zu rawsize=%zu.", sid, data.size(), rawsize);
+            return;
+        }
+    }
+    else
+    {
+        os.data().append(data.data(), data.size());
+    }
+
+    std::shared_ptr<binlog_source> source;
+    size_t count = 0;
+    try
+    {
+        while(os.data_ready(1))
+        {
+            if(count == events.size())
+            {
+                events.emplace_back();
+                levels.emplace_back();
+            }
+            compact_int<PROTOCOLID> type;
+            os >> type;
+            if(type.get() == remotelog::TYPE)
+            {
+                record.unpack(os);
+                levels[count] = (LOG_LEVEL)record.loglevel;
+                events[count] = record.logevent;
+            }
+            else if(type.get() == remotelog_binary::TYPE)
+            {
+                binrecord.unpack(os);
+                if(!source) source = find_binlog_source(sid);
+                levels[count] = (LOG_LEVEL)binrecord.loglevel;
+                decode_binlog(source.get(), binrecord.formatid, binrecord.timestamp, binrecord.threadid, binrecord.fiberid, binrecord.elapse, binrecord.args, events[count]);
+                binrecord.args.reset();
+            }
+            else
+            {
+                local_log("log_manager log_batch unknown record type %u, sid=%lu.", (uint32_t)type.get(), sid);
+                break;
+            }
+            ++count;
+        }
+    }
+    catch(octetsstream::exception& e)
+    {
+        local_log("log_manager log_batch decode failed, sid=%lu err=%s.", sid, e.what());
+    }
+    if(count == 0) return;
+
+    if(PREDICT_FALSE(!_file_logger))
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            logclient::get_instance()->get_console_logger()->log(levels[i], events[i]);
+        }
+        return;
+    }
+    _file_logger->log(levels.data(), events.data(), count);
+    for(const auto& [_, logger] : _loggers)
+    {
+        logger->log(levels.data(), events.data(), count);
+    }
+}
+
+void log_manager::del_binlog_source(SID sid)
+{
+    std::unique_lock<bee::mutex> lock(_binlog_locker);
+    _binlog_sources.erase(sid);
+}
+
 logger* log_manager::get_logger(std::string name)
 {
     auto iter = _loggers.find(name);
@@ -85,4 +252,20 @@ void remoteinfluxlog::run()
     log_manager::get_instance()->influxlog(logevent);
 }
 
+void remotelog_format::run()
+{
+    // 不能重写serial_key：解码时锁外读格式串，依赖和同一会话的remotelog_binary在同一个串行队列上
+    log_manager::get_instance()->add_binlog_format(_sid, formatid, process_name, filename, line, fmt);
+}
+
+void remotelog_batch::run()
+{
+    log_manager::get_instance()->log_batch(_sid, compress != 0, rawsize, data);
+}
+
+void remotelog_binary::run()
+{
+    log_manager::get_instance()->binlog(_sid, (LOG_LEVEL)loglevel, formatid, timestamp, threadid, fiberid, elapse, args);
+}
+
 } // namespace bee
\ No newline at end of file
@@ -1,7 +1,13 @@
 #pragma once
+#include <memory>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "binlog.h"
 #include "glog.h"
+#include "lock.h"
 
 namespace bee
 {
@@ -16,14 +22,33 @@ public:
     void log(LOG_LEVEL level, const log_event& event);
     void influxlog(const influxlog_event& event);
 
+    // 二进制日志，格式串按连接保存，同一个连接上的协议按顺序执行
+    void add_binlog_format(SID sid, uint32_t formatid, const std::string& process_name, const std::string& filename, uint16_t line, const std::string& fmt);
+    void binlog(SID sid, LOG_LEVEL level, uint32_t formatid, uint64_t timestamp, uint32_t threadid, uint32_t fiberid, uint64_t elapse, std::string_view args);
+    void del_binlog_source(SID sid);
+
+    // remotelog_batch，整批解码后交给logger，文件只写一次
+    void log_batch(SID sid, bool compress, size_t rawsize, std::string_view data);
+
     logger* get_logger(std::string name);
     bool add_logger(std::string name, logger* logger);
     bool del_logger(std::string name);
     
 private:
+    struct binlog_source
+    {
+        std::string process_name;
+        std::vector<binlog_format> formats; // 下标是formatid-1
+    };
+
+    std::shared_ptr<binlog_source> find_binlog_source(SID sid);
+    void decode_binlog(const binlog_source* source, uint32_t formatid, uint64_t timestamp, uint32_t threadid, uint32_t fiberid, uint64_t elapse, std::string_view args, log_event& event);
+
     logger* _file_logger = nullptr;
     influx_logger* _influx_logger = nullptr;
     std::unordered_map<std::string, logger*> _loggers;
+    bee::mutex _binlog_locker;
+    std::unordered_map<SID, std::shared_ptr<binlog_source>> _binlog_sources;
 };
 
 } // namespace bee
\ No newline at end of file
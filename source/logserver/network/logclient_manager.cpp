@@ -1,4 +1,5 @@
 #include "logclient_manager.h"
+#include "log_manager.h"
 
 namespace bee
 {
@@ -11,6 +12,7 @@ void logclient_manager::on_add_session(SID sid)
 void logclient_manager::on_del_session(SID sid)
 {
     printf("logclient_manager on_del_session sid=%lu\n", sid);
+    log_manager::get_instance()->del_binlog_source(sid);
 }
 
 } // namespace bee
\ No newline at end of file